@@ -0,0 +1,507 @@
+/*
+ * Binder transaction benchmark
+ *
+ * Measures round trip latency and aggregate throughput of synchronous
+ * binder transactions, either as a single ping-pong pair or as many
+ * client processes hammering one multi-threaded server.
+ *
+ * With -B the request is small and only the reply carries the payload,
+ * copied through the binder buffer. -a sends that payload as an ashmem
+ * BINDER_TYPE_FD_REGION instead, which the driver maps into the client
+ * rather than copying. In both bulk modes the client reads every page
+ * of the payload, so e.g.
+ *
+ *   binder-bench -B -s 1048576 -n 1000
+ *   binder-bench -a -s 1048576 -n 1000
+ *
+ * compare the copy and zero-copy paths.
+ *
+ * The server registers itself as context manager, so run this where no
+ * servicemanager is active (e.g. stop it first, or boot a minimal
+ * initramfs).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Cross-compile with
+ *   cross-gcc -O2 -I/path/to/kernel/drivers/staging/android \
+ *	binder-bench.c -o binder-bench -lpthread
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/types.h>
+#include <linux/ioctl.h>
+#include <linux/ashmem.h>
+#include "binder.h"
+
+#define MAP_SIZE	(2 * 1024 * 1024)
+#define MAX_PAYLOAD	(1024 * 1024)
+
+static const char *device = "/dev/binder";
+static int clients = 1;
+static int server_threads = 1;
+static int iterations = 10000;
+static size_t payload = 128;
+static int bulk;
+static int use_region;
+
+/* the reply sent by the server in -a mode */
+static struct binder_fd_region_object region;
+static size_t region_offset;
+
+struct binder_ctx {
+	int fd;
+	void *map;
+};
+
+struct client_result {
+	unsigned long long min_ns;
+	unsigned long long max_ns;
+	unsigned long long total_ns;
+	int done;
+	int failed;
+};
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void binder_ctx_open(struct binder_ctx *ctx)
+{
+	struct binder_version vers;
+
+	ctx->fd = open(device, O_RDWR);
+	if (ctx->fd < 0)
+		pabort("can't open device");
+	if (ioctl(ctx->fd, BINDER_VERSION, &vers) < 0 ||
+	    vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder protocol version mismatch\n");
+		exit(1);
+	}
+	ctx->map = mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, ctx->fd, 0);
+	if (ctx->map == MAP_FAILED)
+		pabort("can't map binder");
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *rconsumed)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_buffer = (unsigned long)wbuf;
+	bwr.write_size = wsize;
+	bwr.read_buffer = (unsigned long)rbuf;
+	bwr.read_size = rsize;
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (rconsumed)
+		*rconsumed = bwr.read_consumed;
+	return ret;
+}
+
+/*
+ * Walk a read buffer and return the first transaction or reply found,
+ * along with its command. Everything else is skipped.
+ */
+static uint32_t binder_parse(uint32_t *rbuf, size_t size,
+			     struct binder_transaction_data *txn)
+{
+	char *p = (char *)rbuf;
+	char *end = p + size;
+
+	while (p + sizeof(uint32_t) <= end) {
+		uint32_t cmd = *(uint32_t *)p;
+
+		p += sizeof(uint32_t);
+		switch (cmd) {
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(txn, p, sizeof(*txn));
+			return cmd;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			return cmd;
+		default:
+			p += _IOC_SIZE(cmd);
+			break;
+		}
+	}
+	return 0;
+}
+
+static void *server_thread(void *arg)
+{
+	struct binder_ctx *ctx = arg;
+	char *reply_data;
+	uint32_t rbuf[128];
+	struct {
+		uint32_t free_cmd;
+		void *free_ptr;
+		uint32_t reply_cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) out;
+	uint32_t enter = BC_ENTER_LOOPER;
+
+	reply_data = calloc(1, payload);
+	if (!reply_data)
+		pabort("can't allocate reply");
+	if (binder_write_read(ctx->fd, &enter, sizeof(enter), NULL, 0, NULL) < 0)
+		pabort("can't enter looper");
+
+	for (;;) {
+		struct binder_transaction_data txn;
+		size_t consumed;
+
+		if (binder_write_read(ctx->fd, NULL, 0,
+				      rbuf, sizeof(rbuf), &consumed) < 0)
+			pabort("server read");
+		if (binder_parse(rbuf, consumed, &txn) != BR_TRANSACTION)
+			continue;
+
+		memset(&out, 0, sizeof(out));
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_ptr = (void *)txn.data.ptr.buffer;
+		out.reply_cmd = BC_REPLY;
+		out.tr.code = txn.code;
+		if (use_region) {
+			out.tr.data_size = sizeof(region);
+			out.tr.offsets_size = sizeof(region_offset);
+			out.tr.data.ptr.buffer = &region;
+			out.tr.data.ptr.offsets = &region_offset;
+		} else {
+			out.tr.data_size = payload;
+			out.tr.data.ptr.buffer = reply_data;
+		}
+		if (binder_write_read(ctx->fd, &out, sizeof(out),
+				      NULL, 0, NULL) < 0)
+			pabort("server reply");
+	}
+	return NULL;
+}
+
+static void setup_region(void)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t len = (payload + page - 1) & ~(page - 1);
+	void *p;
+	int fd;
+
+	fd = open("/dev/ashmem", O_RDWR);
+	if (fd < 0)
+		pabort("can't open ashmem");
+	if (ioctl(fd, ASHMEM_SET_SIZE, len) < 0)
+		pabort("can't size ashmem region");
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		pabort("can't map ashmem region");
+	memset(p, 0x5a, len);
+
+	region.type = BINDER_TYPE_FD_REGION;
+	region.fd = fd;
+	region.offset = 0;
+	region.length = len;
+	region_offset = 0;
+}
+
+static void run_server(int ready_fd)
+{
+	struct binder_ctx ctx;
+	pthread_t tid;
+	int i;
+
+	if (use_region)
+		setup_region();
+	binder_ctx_open(&ctx);
+	if (ioctl(ctx.fd, BINDER_SET_MAX_THREADS, &(size_t){ 0 }) < 0)
+		pabort("can't set max threads");
+	if (ioctl(ctx.fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		pabort("can't become context manager");
+
+	for (i = 1; i < server_threads; i++)
+		if (pthread_create(&tid, NULL, server_thread, &ctx))
+			pabort("can't create server thread");
+	if (write(ready_fd, "r", 1) != 1)
+		pabort("can't signal ready");
+	close(ready_fd);
+	server_thread(&ctx);
+}
+
+/* read one byte per page, as a consumer of the payload would */
+static unsigned int touch_pages(const volatile char *p, size_t len)
+{
+	unsigned int sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i += 4096)
+		sum += p[i];
+	return sum;
+}
+
+static void run_client(int result_fd)
+{
+	struct binder_ctx ctx;
+	struct client_result res;
+	char *data;
+	uint32_t rbuf[128];
+	struct {
+		uint32_t free_cmd;
+		void *free_ptr;
+		uint32_t txn_cmd;
+		struct binder_transaction_data tr;
+	} __attribute__((packed)) out;
+	void *reply_ptr = NULL;
+	int i;
+
+	binder_ctx_open(&ctx);
+	data = calloc(1, payload);
+	if (!data)
+		pabort("can't allocate payload");
+
+	memset(&res, 0, sizeof(res));
+	res.min_ns = ~0ULL;
+	for (i = 0; i < iterations; i++) {
+		struct binder_transaction_data txn;
+		unsigned long long t0, dt;
+		uint32_t cmd = 0;
+		size_t consumed;
+		char *wbuf;
+		size_t wsize;
+
+		memset(&out, 0, sizeof(out));
+		/* piggy-back the free of the previous reply */
+		out.free_cmd = BC_FREE_BUFFER;
+		out.free_ptr = reply_ptr;
+		out.txn_cmd = BC_TRANSACTION;
+		out.tr.target.handle = 0;
+		out.tr.code = i;
+		out.tr.flags = TF_ACCEPT_FDS;
+		out.tr.data_size = bulk ? sizeof(int) : payload;
+		out.tr.data.ptr.buffer = data;
+		wbuf = (char *)&out;
+		wsize = sizeof(out);
+		if (!reply_ptr) {
+			wbuf += offsetof(typeof(out), txn_cmd);
+			wsize -= offsetof(typeof(out), txn_cmd);
+		}
+
+		t0 = now_ns();
+		if (binder_write_read(ctx.fd, wbuf, wsize,
+				      rbuf, sizeof(rbuf), &consumed) < 0)
+			pabort("client transaction");
+		for (;;) {
+			cmd = binder_parse(rbuf, consumed, &txn);
+			if (cmd)
+				break;
+			if (binder_write_read(ctx.fd, NULL, 0, rbuf,
+					      sizeof(rbuf), &consumed) < 0)
+				pabort("client read");
+		}
+		if (cmd != BR_REPLY) {
+			res.failed++;
+			reply_ptr = NULL;
+			continue;
+		}
+		reply_ptr = (void *)txn.data.ptr.buffer;
+
+		if (use_region) {
+			const struct binder_fd_region_object *rp = reply_ptr;
+
+			if (txn.data_size < sizeof(*rp) ||
+			    rp->type != BINDER_TYPE_FD_REGION || !rp->addr) {
+				res.failed++;
+				continue;
+			}
+			touch_pages(rp->addr, rp->length);
+			close(rp->fd);
+		} else if (bulk)
+			touch_pages(reply_ptr, txn.data_size);
+		dt = now_ns() - t0;
+
+		res.done++;
+		res.total_ns += dt;
+		if (dt < res.min_ns)
+			res.min_ns = dt;
+		if (dt > res.max_ns)
+			res.max_ns = dt;
+	}
+
+	if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+		pabort("can't report result");
+	exit(0);
+}
+
+static void print_usage(const char *prog)
+{
+	printf("Usage: %s [-DcnstBa]\n", prog);
+	puts("  -D --device   device to use (default /dev/binder)\n"
+	     "  -c --clients  client processes (default 1, ping-pong)\n"
+	     "  -t --threads  server looper threads (default 1)\n"
+	     "  -n --iter     transactions per client (default 10000)\n"
+	     "  -s --size     payload bytes each way (default 128)\n"
+	     "  -B --bulk     payload in the reply only, copied\n"
+	     "  -a --ashmem   payload in the reply only, as an fd region\n");
+	exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+	while (1) {
+		static const struct option lopts[] = {
+			{ "device",  1, 0, 'D' },
+			{ "clients", 1, 0, 'c' },
+			{ "threads", 1, 0, 't' },
+			{ "iter",    1, 0, 'n' },
+			{ "size",    1, 0, 's' },
+			{ "bulk",    0, 0, 'B' },
+			{ "ashmem",  0, 0, 'a' },
+			{ NULL, 0, 0, 0 },
+		};
+		int c;
+
+		c = getopt_long(argc, argv, "D:c:t:n:s:Ba", lopts, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'D':
+			device = optarg;
+			break;
+		case 'c':
+			clients = atoi(optarg);
+			break;
+		case 't':
+			server_threads = atoi(optarg);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			payload = atoi(optarg);
+			break;
+		case 'B':
+			bulk = 1;
+			break;
+		case 'a':
+			bulk = 1;
+			use_region = 1;
+			break;
+		default:
+			print_usage(argv[0]);
+			break;
+		}
+	}
+	if (clients < 1 || server_threads < 1 || iterations < 1 ||
+	    payload > MAX_PAYLOAD || (bulk && payload < sizeof(int)))
+		print_usage(argv[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct client_result total, res;
+	unsigned long long t0, elapsed;
+	int ready[2], results[2];
+	pid_t server;
+	char c;
+	int i;
+
+	parse_opts(argc, argv);
+
+	if (pipe(ready) < 0 || pipe(results) < 0)
+		pabort("can't create pipe");
+
+	server = fork();
+	if (server < 0)
+		pabort("can't fork server");
+	if (server == 0) {
+		close(ready[0]);
+		run_server(ready[1]);
+		exit(0);
+	}
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1) {
+		fprintf(stderr, "server failed to start\n");
+		return 1;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < clients; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			pabort("can't fork client");
+		if (pid == 0) {
+			close(results[0]);
+			run_client(results[1]);
+		}
+	}
+	close(results[1]);
+
+	memset(&total, 0, sizeof(total));
+	total.min_ns = ~0ULL;
+	for (i = 0; i < clients; i++) {
+		if (read(results[0], &res, sizeof(res)) != sizeof(res)) {
+			fprintf(stderr, "client %d died\n", i);
+			continue;
+		}
+		total.done += res.done;
+		total.failed += res.failed;
+		total.total_ns += res.total_ns;
+		if (res.min_ns < total.min_ns)
+			total.min_ns = res.min_ns;
+		if (res.max_ns > total.max_ns)
+			total.max_ns = res.max_ns;
+	}
+	elapsed = now_ns() - t0;
+	for (i = 0; i < clients; i++)
+		wait(NULL);
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+
+	if (!total.done) {
+		fprintf(stderr, "no transaction completed (%d failed)\n",
+			total.failed);
+		return 1;
+	}
+	printf("%d clients, %d server threads, %zu bytes: %d ok, %d failed\n",
+	       clients, server_threads, payload,
+	       total.done, total.failed);
+	printf("round trip us: min %llu avg %llu max %llu\n",
+	       total.min_ns / 1000, total.total_ns / total.done / 1000,
+	       total.max_ns / 1000);
+	printf("throughput: %llu transactions/s\n",
+	       total.done * 1000000000ULL / elapsed);
+	if (bulk)
+		printf("payload: %llu KB/s (%s)\n",
+		       total.done * (unsigned long long)payload *
+		       1000000ULL / elapsed, use_region ? "fd region" : "copy");
+	return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * launch-bench.c - application launch time under writeback benchmark
+ *
+ * Times cold "application launches" on a flash block device, first on an
+ * idle device and then while two other processes load it with writes: one
+ * streams a bulk file through the page cache, so writeback runs all the
+ * time, and one does small random writes to a database file, each followed
+ * by fdatasync as SQLite does for its journal.
+ *
+ * A launch drops the application file from the page cache and then reads
+ * it like a starting application does: the first half sequentially in
+ * large reads (code, libraries), the rest as random page sized reads (page
+ * faults, resources). Reported are the launch times and what the writers
+ * got done meanwhile. Run it once with each I/O scheduler selected in
+ * /sys/block/<dev>/queue/scheduler to compare them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Cross-compile with
+ *   cross-gcc -O2 -static launch-bench.c -o launch-bench
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define PAGE		4096
+#define SEQ_READ	(128 * 1024)
+#define DB_SIZE		(4 * 1024 * 1024)
+
+static const char *dir = "/data/local/tmp";
+static const char *queue = "mmcblk0";
+static int app_mb = 16;
+static int bulk_mb = 256;
+static int random_reads = 512;
+static int rounds = 5;
+
+/* written by the writers, read by the parent */
+static volatile struct {
+	uint64_t bulk_bytes;
+	uint64_t sync_ops;
+	uint64_t sync_us;
+	uint64_t sync_max_us;
+} *stats;
+
+static char buf[SEQ_READ] __attribute__((aligned(PAGE)));
+
+static uint64_t now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int open_file(const char *name, int flags)
+{
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, flags, 0600);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	return fd;
+}
+
+static void create_file(const char *name, size_t size)
+{
+	size_t done;
+	int fd;
+
+	fd = open_file(name, O_WRONLY | O_CREAT | O_TRUNC);
+	for (done = 0; done < size; done += sizeof(buf)) {
+		memset(buf, (int)(done >> 12), sizeof(buf));
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("write");
+			exit(1);
+		}
+	}
+	if (fsync(fd))
+		perror("fsync");
+	close(fd);
+}
+
+/* streams the bulk file through the page cache, round and round */
+static void bulk_writer(void)
+{
+	size_t size = (size_t)bulk_mb * 1024 * 1024;
+	size_t done = 0;
+	int fd;
+
+	fd = open_file("launch-bulk", O_WRONLY | O_CREAT | O_TRUNC);
+	memset(buf, 0xa5, sizeof(buf));
+	for (;;) {
+		if (done >= size) {
+			lseek(fd, 0, SEEK_SET);
+			done = 0;
+		}
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			perror("bulk write");
+			exit(1);
+		}
+		done += sizeof(buf);
+		stats->bulk_bytes += sizeof(buf);
+	}
+}
+
+/* small random writes to the database, each made durable */
+static void sync_writer(void)
+{
+	uint32_t seed = 1;
+	char page[PAGE];
+	int fd;
+
+	fd = open_file("launch-db", O_WRONLY);
+	memset(page, 0x3c, sizeof(page));
+	for (;;) {
+		uint64_t start = now_us(), us;
+		off_t off;
+
+		seed = seed * 1103515245 + 12345;
+		off = (off_t)(seed >> 8) % (DB_SIZE / PAGE) * PAGE;
+		if (pwrite(fd, page, sizeof(page), off) != sizeof(page) ||
+		    fdatasync(fd)) {
+			perror("db write");
+			exit(1);
+		}
+		us = now_us() - start;
+		stats->sync_ops++;
+		stats->sync_us += us;
+		if (us > stats->sync_max_us)
+			stats->sync_max_us = us;
+		usleep(20000);
+	}
+}
+
+static pid_t start_writer(void (*fn)(void))
+{
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (!pid) {
+		fn();
+		exit(0);
+	}
+	return pid;
+}
+
+/* reads the application file cold, returns the time it took */
+static uint64_t launch(void)
+{
+	size_t size = (size_t)app_mb * 1024 * 1024;
+	uint32_t seed = 42;
+	uint64_t start;
+	size_t off;
+	int fd, i;
+
+	fd = open_file("launch-app", O_RDONLY);
+	if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+		perror("posix_fadvise");
+
+	start = now_us();
+	for (off = 0; off < size / 2; off += SEQ_READ) {
+		if (pread(fd, buf, SEQ_READ, off) != SEQ_READ) {
+			perror("read");
+			exit(1);
+		}
+	}
+	for (i = 0; i < random_reads; i++) {
+		seed = seed * 1103515245 + 12345;
+		off = size / 2 + (size_t)(seed >> 8) % (size / 2 / PAGE) * PAGE;
+		if (pread(fd, buf, PAGE, off) != PAGE) {
+			perror("read");
+			exit(1);
+		}
+	}
+	start = now_us() - start;
+	close(fd);
+	return start;
+}
+
+static void run_launches(const char *what)
+{
+	uint64_t us, total = 0, min = ~0ULL, max = 0;
+	int r;
+
+	for (r = 0; r < rounds; r++) {
+		us = launch();
+		total += us;
+		if (us < min)
+			min = us;
+		if (us > max)
+			max = us;
+		sleep(1);
+	}
+	printf("%-16s launch min %6llu ms, avg %6llu ms, max %6llu ms\n", what,
+	       (unsigned long long)min / 1000,
+	       (unsigned long long)total / rounds / 1000,
+	       (unsigned long long)max / 1000);
+}
+
+static void show_scheduler(void)
+{
+	char path[128], line[128];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/%s/queue/scheduler", queue);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	if (fgets(line, sizeof(line), f))
+		printf("%s scheduler: %s", queue, line);
+	fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d dir] [-q queue] [-a app MB] [-b bulk MB] "
+		"[-n random reads] [-r rounds]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pid_t bulk, sync_pid;
+	uint64_t start, us;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:q:a:b:n:r:")) != -1) {
+		switch (c) {
+		case 'd': dir = optarg; break;
+		case 'q': queue = optarg; break;
+		case 'a': app_mb = atoi(optarg); break;
+		case 'b': bulk_mb = atoi(optarg); break;
+		case 'n': random_reads = atoi(optarg); break;
+		case 'r': rounds = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (app_mb < 1 || bulk_mb < 1 || random_reads < 0 || rounds < 1)
+		usage(argv[0]);
+
+	stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	show_scheduler();
+	printf("app %d MB, %d random reads, bulk file %d MB\n",
+	       app_mb, random_reads, bulk_mb);
+	fflush(stdout);
+
+	create_file("launch-app", (size_t)app_mb * 1024 * 1024);
+	create_file("launch-db", DB_SIZE);
+
+	run_launches("idle:");
+
+	bulk = start_writer(bulk_writer);
+	sync_pid = start_writer(sync_writer);
+	start = now_us();
+	/* let the dirty pages pile up until writeback runs flat out */
+	sleep(5);
+	run_launches("under writeback:");
+	us = now_us() - start;
+
+	kill(bulk, SIGKILL);
+	kill(sync_pid, SIGKILL);
+	waitpid(bulk, NULL, 0);
+	waitpid(sync_pid, NULL, 0);
+
+	printf("bulk writer: %llu KB/s into the page cache\n",
+	       (unsigned long long)(stats->bulk_bytes * 1000 / 1024 / (us / 1000)));
+	if (stats->sync_ops)
+		printf("db writer: %llu fdatasyncs, avg %llu ms, max %llu ms\n",
+		       (unsigned long long)stats->sync_ops,
+		       (unsigned long long)(stats->sync_us / stats->sync_ops / 1000),
+		       (unsigned long long)stats->sync_max_us / 1000);
+
+	sync();
+	return 0;
+}
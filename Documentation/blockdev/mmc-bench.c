@@ -0,0 +1,212 @@
+/*
+ * mmc-bench.c - MMC block device throughput and CPU cost benchmark
+ *
+ * Reads (or, with -w, writes) a region of an MMC block device in large
+ * requests and reports the throughput and the CPU time it took, as the
+ * busy time from /proc/stat turned into CPU cycles per MB at the clock
+ * rate cpu0 ran at. Run it on kernels with and without a change to the
+ * MMC request path to compare both.
+ *
+ * The I/O is O_DIRECT by default so that the page cache doesn't hide the
+ * device. With -B it goes through the page cache like a normal reader,
+ * which includes the cost of the copies made on the way.
+ *
+ * Writing destroys the data in the region, so -w needs an explicit
+ * offset with -o.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Cross-compile with
+ *   cross-gcc -O2 -static mmc-bench.c -o mmc-bench
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+static const char *dev = "/dev/block/mmcblk0";
+static int total_mb = 64;
+static int req_kb = 256;
+static long offset_mb = -1;
+static int do_write;
+static int buffered;
+
+struct cpu_stat {
+	unsigned long long busy;
+	unsigned long long total;
+};
+
+static uint64_t now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int read_cpu_stat(struct cpu_stat *st)
+{
+	unsigned long long v[8] = { 0 };
+	FILE *f;
+	int i, n;
+
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		return -1;
+	n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+		   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+	fclose(f);
+	if (n < 4)
+		return -1;
+
+	st->total = 0;
+	for (i = 0; i < 8; i++)
+		st->total += v[i];
+	/* idle and iowait are not CPU work */
+	st->busy = st->total - v[3] - v[4];
+	return 0;
+}
+
+/* current clock of cpu0 in kHz, 0 if unknown */
+static unsigned long cpu_khz(void)
+{
+	unsigned long khz = 0;
+	FILE *f;
+
+	f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%lu", &khz) != 1)
+		khz = 0;
+	fclose(f);
+	return khz;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s MB] [-b request KB] [-o offset MB] [-w] [-B] "
+		"[device]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	size_t req, done, total;
+	struct cpu_stat st0, st1;
+	unsigned long khz0, khz1;
+	double secs, busy_s, mb;
+	uint64_t start, us;
+	long hz;
+	char *buf;
+	int fd, c, flags;
+
+	while ((c = getopt(argc, argv, "s:b:o:wB")) != -1) {
+		switch (c) {
+		case 's': total_mb = atoi(optarg); break;
+		case 'b': req_kb = atoi(optarg); break;
+		case 'o': offset_mb = atol(optarg); break;
+		case 'w': do_write = 1; break;
+		case 'B': buffered = 1; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		dev = argv[optind];
+	if (total_mb < 1 || req_kb < 4 || (req_kb & 3))
+		usage(argv[0]);
+	if (do_write && offset_mb < 0) {
+		fprintf(stderr, "writing needs an offset (-o), the data there "
+			"is destroyed\n");
+		return 1;
+	}
+	if (offset_mb < 0)
+		offset_mb = 0;
+
+	req = (size_t)req_kb * 1024;
+	total = (size_t)total_mb * 1024 * 1024;
+	if (posix_memalign((void **)&buf, 4096, req)) {
+		perror("posix_memalign");
+		return 1;
+	}
+	memset(buf, 0x5a, req);
+
+	flags = do_write ? O_WRONLY : O_RDONLY;
+	if (!buffered)
+		flags |= O_DIRECT;
+	fd = open(dev, flags);
+	if (fd < 0) {
+		perror(dev);
+		return 1;
+	}
+	if (lseek(fd, (off_t)offset_mb * 1024 * 1024, SEEK_SET) < 0) {
+		perror("lseek");
+		return 1;
+	}
+
+	/* drop what is cached so that buffered reads hit the device */
+	sync();
+	c = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (c >= 0) {
+		if (write(c, "3", 1) != 1)
+			perror("drop_caches");
+		close(c);
+	}
+
+	khz0 = cpu_khz();
+	if (read_cpu_stat(&st0)) {
+		perror("/proc/stat");
+		return 1;
+	}
+	start = now_us();
+
+	for (done = 0; done < total; done += req) {
+		ssize_t n;
+
+		if (do_write)
+			n = write(fd, buf, req);
+		else
+			n = read(fd, buf, req);
+		if (n != (ssize_t)req) {
+			perror(do_write ? "write" : "read");
+			break;
+		}
+	}
+	if (do_write && fsync(fd))
+		perror("fsync");
+
+	us = now_us() - start;
+	read_cpu_stat(&st1);
+	khz1 = cpu_khz();
+	close(fd);
+
+	hz = sysconf(_SC_CLK_TCK);
+	secs = us / 1e6;
+	busy_s = (double)(st1.busy - st0.busy) / hz;
+	mb = done / (1024.0 * 1024.0);
+
+	printf("%s %.0f MB in %lu KB requests (%s): %.3f s, %.0f KB/s\n",
+	       do_write ? "wrote" : "read", mb, (unsigned long)req_kb,
+	       buffered ? "buffered" : "direct", secs,
+	       secs > 0 ? mb * 1024 / secs : 0);
+	printf("cpu busy %.3f s (%.1f%%)", busy_s,
+	       st1.total > st0.total ? 100.0 * (st1.busy - st0.busy) /
+	       (st1.total - st0.total) : 0);
+	if (khz0 && khz0 == khz1 && mb > 0)
+		printf(", %.2f Mcycles/MB at %lu MHz\n",
+		       busy_s * khz0 / 1000.0 / mb, khz0 / 1000);
+	else
+		printf(", cpu clock changed or unknown, pin it for "
+		       "cycles/MB\n");
+
+	free(buf);
+	return 0;
+}
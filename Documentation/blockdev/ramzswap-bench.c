@@ -0,0 +1,308 @@
+/*
+ * ramzswap-bench.c - app switch memory headroom benchmark
+ *
+ * Starts a number of "applications", each a process holding a heap of
+ * anonymous memory with roughly the mix of zero, compressible and random
+ * pages of a real application, then switches between them round robin.
+ * Each switch touches the whole heap of the application brought to the
+ * front, which faults back whatever was swapped out.
+ *
+ * Reported are the number of applications still alive at the end (the
+ * rest were killed by the low memory killer or the OOM killer), the switch
+ * latency and the ramzswap statistics. Run once without swap and once after
+ * "swapon /dev/ramzswap0" to compare.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Cross-compile with
+ *   cross-gcc -O2 -static ramzswap-bench.c -o ramzswap-bench
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#define PAGE		4096
+#define MAX_APPS	64
+
+static int apps = 8;
+static int app_mb = 16;
+static int zero_pct = 20;
+static int random_pct = 20;
+static int rounds = 5;
+static int oom_adj = 8;
+
+static pid_t pid[MAX_APPS];
+static int cmd_fd[MAX_APPS];
+static int res_fd[MAX_APPS];
+
+static const char text[] =
+	"I/ActivityManager(  123): Displayed activity com.bn.nook.reader/"
+	".ReaderActivity: 512 ms (total 512 ms) lorem ipsum dolor sit amet ";
+
+static uint64_t now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t page_seed(int app, size_t page)
+{
+	return (uint32_t)(app * 2654435761u) ^ (uint32_t)(page * 40503u);
+}
+
+/* fills a page with zeroes, random bytes or log-like text */
+static void fill_page(unsigned char *p, int app, size_t page)
+{
+	uint32_t seed = page_seed(app, page);
+	unsigned int kind = seed % 100;
+	size_t i;
+
+	if (kind < (unsigned int)zero_pct) {
+		memset(p, 0, PAGE);
+	} else if (kind < (unsigned int)(zero_pct + random_pct)) {
+		for (i = 0; i < PAGE; i++) {
+			seed = seed * 1103515245 + 12345;
+			p[i] = seed >> 16;
+		}
+	} else {
+		for (i = 0; i < PAGE; i++)
+			p[i] = text[(i + seed) % (sizeof(text) - 1)];
+	}
+	/* tag every non-zero page so that corruption shows */
+	if (kind >= (unsigned int)zero_pct)
+		memcpy(p, &page, sizeof(page));
+}
+
+static void app_main(int app, int cmd, int res)
+{
+	size_t pages = (size_t)app_mb * 1024 * 1024 / PAGE;
+	unsigned char *heap;
+	char path[64];
+	size_t i;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/oom_adj", getpid());
+	fd = open(path, O_WRONLY);
+	if (fd >= 0) {
+		snprintf(path, sizeof(path), "%d", oom_adj);
+		write(fd, path, strlen(path));
+		close(fd);
+	}
+
+	heap = malloc(pages * PAGE);
+	if (!heap)
+		exit(1);
+	for (i = 0; i < pages; i++)
+		fill_page(heap + i * PAGE, app, i);
+
+	for (;;) {
+		uint64_t start;
+		unsigned long bad = 0;
+		char c;
+
+		if (read(cmd, &c, 1) != 1)
+			exit(0);
+
+		/* brought to the front: touch the whole heap */
+		start = now_us();
+		for (i = 0; i < pages; i++) {
+			unsigned char *p = heap + i * PAGE;
+			size_t tag;
+
+			if (page_seed(app, i) % 100 < (unsigned int)zero_pct) {
+				bad += p[PAGE - 1] != 0;
+				continue;
+			}
+			memcpy(&tag, p, sizeof(tag));
+			bad += tag != i;
+			/* dirty it, as a running app would */
+			((volatile unsigned char *)p)[PAGE - 1] = p[PAGE - 1];
+		}
+		start = now_us() - start;
+		if (bad)
+			fprintf(stderr, "app %d: %lu corrupt pages\n", app, bad);
+		if (write(res, &start, sizeof(start)) != sizeof(start))
+			exit(1);
+	}
+}
+
+static int start_app(int app)
+{
+	int cmd[2], res[2];
+
+	if (pipe(cmd) || pipe(res))
+		return -1;
+
+	pid[app] = fork();
+	if (pid[app] < 0)
+		return -1;
+	if (!pid[app]) {
+		int i;
+
+		/* don't keep the other apps' pipes open past their exit */
+		for (i = 0; i < app; i++) {
+			if (pid[i]) {
+				close(cmd_fd[i]);
+				close(res_fd[i]);
+			}
+		}
+		close(cmd[1]);
+		close(res[0]);
+		app_main(app, cmd[0], res[1]);
+		exit(0);
+	}
+	close(cmd[0]);
+	close(res[1]);
+	cmd_fd[app] = cmd[1];
+	res_fd[app] = res[0];
+	return 0;
+}
+
+/* brings an app to the front, returns the switch time or 0 if it died */
+static uint64_t switch_to(int app)
+{
+	uint64_t us;
+
+	if (!pid[app])
+		return 0;
+	if (write(cmd_fd[app], "s", 1) != 1 ||
+	    read(res_fd[app], &us, sizeof(us)) != sizeof(us)) {
+		int status;
+
+		waitpid(pid[app], &status, 0);
+		if (WIFSIGNALED(status))
+			printf("app %d killed by signal %d\n", app,
+			       WTERMSIG(status));
+		pid[app] = 0;
+		return 0;
+	}
+	return us;
+}
+
+static void show_file(const char *name)
+{
+	char path[128], buf[64];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/block/ramzswap0/%s", name);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	if (fgets(buf, sizeof(buf), f))
+		printf("  %-18s %s", name, buf);
+	fclose(f);
+}
+
+static void show_swap(void)
+{
+	static const char *stats[] = {
+		"num_reads", "num_writes", "failed_writes", "pages_zero",
+		"pages_stored", "pages_expand", "orig_data_size",
+		"compr_data_size", "mem_used_total", "compr_ratio",
+		"compr_lat_avg_ns", "compr_lat_max_ns",
+	};
+	char line[128];
+	unsigned int i;
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (f) {
+		while (fgets(line, sizeof(line), f))
+			if (!strncmp(line, "Swap", 4) ||
+			    !strncmp(line, "MemFree", 7))
+				printf("  %s", line);
+		fclose(f);
+	}
+	for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++)
+		show_file(stats[i]);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n apps] [-m MB per app] [-z zero %%] "
+		"[-r random %%] [-R rounds] [-j oom_adj]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t total = 0, max = 0, us;
+	unsigned long switches = 0;
+	int alive, i, r, c;
+
+	while ((c = getopt(argc, argv, "n:m:z:r:R:j:")) != -1) {
+		switch (c) {
+		case 'n': apps = atoi(optarg); break;
+		case 'm': app_mb = atoi(optarg); break;
+		case 'z': zero_pct = atoi(optarg); break;
+		case 'r': random_pct = atoi(optarg); break;
+		case 'R': rounds = atoi(optarg); break;
+		case 'j': oom_adj = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (apps < 1 || apps > MAX_APPS || app_mb < 1 ||
+	    zero_pct + random_pct > 100)
+		usage(argv[0]);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("%d apps of %d MB, %d%% zero, %d%% random pages\n",
+	       apps, app_mb, zero_pct, random_pct);
+	fflush(stdout);
+
+	/* launch the apps one by one, each launch pushes the others back */
+	for (i = 0; i < apps; i++) {
+		if (start_app(i)) {
+			perror("start_app");
+			break;
+		}
+		switch_to(i);
+	}
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < apps; i++) {
+			us = switch_to(i);
+			if (!us)
+				continue;
+			total += us;
+			if (us > max)
+				max = us;
+			switches++;
+		}
+	}
+
+	for (alive = 0, i = 0; i < apps; i++)
+		if (pid[i])
+			alive++;
+
+	printf("alive: %d/%d apps, %d MB resident or swapped\n",
+	       alive, apps, alive * app_mb);
+	if (switches)
+		printf("switch: avg %llu us, max %llu us over %lu switches\n",
+		       (unsigned long long)(total / switches),
+		       (unsigned long long)max, switches);
+	show_swap();
+
+	for (i = 0; i < apps; i++) {
+		if (!pid[i])
+			continue;
+		close(cmd_fd[i]);
+		waitpid(pid[i], NULL, 0);
+	}
+
+	return 0;
+}
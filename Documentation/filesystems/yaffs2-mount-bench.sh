@@ -0,0 +1,122 @@
+#! /bin/sh
+#
+# yaffs2-mount-bench.sh - yaffs2 mount time with and without block summaries
+#
+# Runs on any kernel with yaffs2 and nandsim, no NAND needed. For each mode
+# it loads a fresh nandsim, fills it with files, and then times mounts that
+# have to scan the device: the mounts ignore the checkpoint, which is what
+# happens after a power cut. Run it as root on a device or in qemu.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+#
+# usage: yaffs2-mount-bench.sh [-i id] [-n files] [-k file KB] [-r rounds] [-d]
+#   -i	second nandsim ID byte, i.e. the chip: 0xaa, the default, is a
+#	256 MiB chip with 2 KiB pages and 128 KiB blocks
+#   -n	number of files written, 2000
+#   -k	size of each file in KiB, 64
+#   -r	mounts timed per mode, 5
+#   -d	have nandsim delay its operations like a real chip (25 us page
+#	read, 200 us program, 2 ms erase, 25 ns per byte transferred)
+
+set -e
+me=`basename $0`
+id=0xaa
+files=2000
+kb=64
+rounds=5
+delays=""
+mnt=/mnt/yaffs2-bench
+
+while getopts "i:n:k:r:d" opt; do
+	case $opt in
+	i) id=$OPTARG ;;
+	n) files=$OPTARG ;;
+	k) kb=$OPTARG ;;
+	r) rounds=$OPTARG ;;
+	d) delays="do_delays=1 access_delay=25 programm_delay=200 erase_delay=2 output_cycle=25 input_cycle=25" ;;
+	*) echo "usage: $me [-i id] [-n files] [-k file KB] [-r rounds] [-d]" 1>&2
+	   exit 1 ;;
+	esac
+done
+
+# milliseconds since boot, from /proc/uptime so that busybox will do
+now_ms() {
+	read up idle < /proc/uptime
+	cs=${up#*.}
+	echo $(( ${up%.*} * 1000 + ${cs#0} * 10 ))
+}
+
+load_nandsim() {
+	modprobe nandsim first_id_byte=0x20 second_id_byte=$id \
+		third_id_byte=0x00 fourth_id_byte=0x15 $delays
+	mtd=`grep "NAND simulator" /proc/mtd | head -n 1 | cut -d: -f1`
+	test -n "$mtd" || {
+		echo "$me: no nandsim partition in /proc/mtd" 1>&2
+		exit 1
+	}
+	dev=/dev/mtdblock${mtd#mtd}
+	test -b $dev || {
+		echo "$me: $dev does not exist" 1>&2
+		exit 1
+	}
+}
+
+unload_nandsim() {
+	rmmod nandsim
+}
+
+# bench <summary-enable|summary-disable>
+bench() {
+	mode=$1
+
+	load_nandsim
+
+	mount -t yaffs2 -o no-checkpoint,$mode $dev $mnt
+	i=0
+	while [ $i -lt $files ]; do
+		mkdir -p $mnt/d$(( i / 100 ))
+		dd if=/dev/zero of=$mnt/d$(( i / 100 ))/f$i bs=1024 count=$kb 2>/dev/null
+		i=$(( i + 1 ))
+	done
+	# overwrite a tenth of it, for some garbage to scan through
+	i=0
+	while [ $i -lt $files ]; do
+		dd if=/dev/zero of=$mnt/d$(( i / 100 ))/f$i bs=1024 count=$kb \
+			conv=notrunc 2>/dev/null
+		i=$(( i + 10 ))
+	done
+	df $mnt | tail -n 1
+	umount $mnt
+
+	total=0
+	min=0
+	r=0
+	while [ $r -lt $rounds ]; do
+		start=`now_ms`
+		mount -t yaffs2 -o no-checkpoint,$mode $dev $mnt
+		ms=$(( `now_ms` - start ))
+		total=$(( total + ms ))
+		if [ $min -eq 0 ] || [ $ms -lt $min ]; then
+			min=$ms
+		fi
+		scans=`grep nSummaryScans /proc/yaffs | tail -n 1`
+		umount $mnt
+		r=$(( r + 1 ))
+	done
+	echo "$mode: mount min $min ms, avg $(( total / rounds )) ms, ${scans#*. }" \
+		"blocks from summaries"
+
+	unload_nandsim
+}
+
+if grep -q nandsim /proc/modules; then
+	echo "$me: unload nandsim first, it would be overwritten" 1>&2
+	exit 1
+fi
+mkdir -p $mnt
+
+echo "nandsim id 0x20 $id, $files files of $kb KiB${delays:+, with delays}"
+bench summary-disable
+bench summary-enable
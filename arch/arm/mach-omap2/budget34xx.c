@@ -0,0 +1,406 @@
+/*
+ * linux/arch/arm/mach-omap2/budget34xx.c
+ *
+ * OMAP3 MPU power budget governor
+ *
+ * The MPU OPPs above boost_khz are overclock points meant for bursts: a
+ * fanless tablet can't dissipate their power for long, and their current
+ * draw on a partly discharged battery risks a brownout. This governor caps
+ * the cpufreq policy maximum when
+ *
+ *  - the time spent above boost_khz used up its budget: every second there
+ *    costs one second of a boost_budget_s budget, which refills by one
+ *    second for every refill_ratio seconds spent at or below boost_khz;
+ *    the boost OPPs are blocked until it is back to resume_pct;
+ *  - the average battery discharge current exceeds current_ma; or
+ *  - the battery temperature, the closest sensor to the SoC on these
+ *    boards, reaches temp_c.
+ *
+ * Over the current or temperature limit the cap comes down one OPP per
+ * sample period, not below min_khz. It goes back up one OPP per period
+ * once the current is below current_hyst_pct of its limit and the
+ * temperature temp_hyst_c below its limit.
+ *
+ * Time at each OPP, the budget and the last throttle events are shown in
+ * debugfs, mpu_budget.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
+#include <linux/cpufreq.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <mach/omap-pm.h>
+#include <mach/omap34xx.h>
+
+#define BUDGET_MAX_OPPS		(VDD1_OPP6 + 1)
+#define BUDGET_EVENTS		16
+
+static int enable = 1;
+module_param(enable, int, S_IRUGO | S_IWUSR);
+static int sample_ms = 1000;
+module_param(sample_ms, int, S_IRUGO | S_IWUSR);
+static int boost_khz = 800000;
+module_param(boost_khz, int, S_IRUGO | S_IWUSR);
+static int boost_budget_s = 30;
+module_param(boost_budget_s, int, S_IRUGO | S_IWUSR);
+static int refill_ratio = 2;
+module_param(refill_ratio, int, S_IRUGO | S_IWUSR);
+static int resume_pct = 50;
+module_param(resume_pct, int, S_IRUGO | S_IWUSR);
+static int current_ma = 1500;
+module_param(current_ma, int, S_IRUGO | S_IWUSR);
+static int current_hyst_pct = 80;
+module_param(current_hyst_pct, int, S_IRUGO | S_IWUSR);
+static int temp_c = 45;
+module_param(temp_c, int, S_IRUGO | S_IWUSR);
+static int temp_hyst_c = 3;
+module_param(temp_hyst_c, int, S_IRUGO | S_IWUSR);
+static int min_khz = 600000;
+module_param(min_khz, int, S_IRUGO | S_IWUSR);
+
+enum budget_reason {
+	BUDGET_BOOST,
+	BUDGET_CURRENT,
+	BUDGET_TEMP,
+	BUDGET_RELEASE,
+};
+
+static const char *budget_reason_name[] = {
+	[BUDGET_BOOST]		= "boost",
+	[BUDGET_CURRENT]	= "current",
+	[BUDGET_TEMP]		= "temp",
+	[BUDGET_RELEASE]	= "release",
+};
+
+struct budget_event {
+	unsigned long	when;		/* jiffies */
+	u8		reason;
+	u8		from;
+	u8		to;
+	int		ma;
+	int		temp;
+};
+
+static struct delayed_work budget_work;
+static DEFINE_MUTEX(budget_mutex);
+static DEFINE_SPINLOCK(budget_lock);
+static struct omap_pm_battery *budget_bat;
+
+/* highest OPP allowed, 0 while not capped */
+static int budget_cap;
+static int budget_blocked;
+/* remaining boost budget in ms */
+static long budget_ms;
+static unsigned long budget_last_sample;
+
+static struct {
+	unsigned long time[BUDGET_MAX_OPPS];	/* jiffies */
+	unsigned long boost;			/* jiffies above boost_khz */
+	unsigned long last;
+	int opp;
+	u32 throttles[BUDGET_RELEASE + 1];
+	int ma;
+	int temp;
+	struct budget_event event[BUDGET_EVENTS];
+	unsigned event_next;
+} budget_stats;
+
+static int budget_max_opp(void)
+{
+	return min_t(int, omap_pm_get_max_vdd1_opp(), BUDGET_MAX_OPPS - 1);
+}
+
+static unsigned int budget_khz(int opp)
+{
+	return mpu_opps[opp].rate / 1000;
+}
+
+static int budget_opp_of(unsigned int khz)
+{
+	int opp;
+
+	for (opp = budget_max_opp(); opp > 1; opp--)
+		if (budget_khz(opp) <= khz)
+			break;
+	return opp;
+}
+
+/* the next OPP down from @opp with a lower rate */
+static int budget_opp_below(int opp)
+{
+	int below = opp;
+
+	while (below > 1 && budget_khz(below) >= budget_khz(opp))
+		below--;
+	return budget_khz(below) < budget_khz(opp) ? below : opp;
+}
+
+/* the topmost OPP of the next rate up from @opp */
+static int budget_opp_above(int opp)
+{
+	int max_opp = budget_max_opp();
+	int above = opp;
+
+	while (above < max_opp && budget_khz(above) <= budget_khz(opp))
+		above++;
+	while (above < max_opp && budget_khz(above + 1) == budget_khz(above))
+		above++;
+	return above;
+}
+
+/* must hold budget_lock */
+static void budget_account(void)
+{
+	unsigned long now = jiffies;
+	int opp = budget_stats.opp;
+
+	if (opp > 0 && opp < BUDGET_MAX_OPPS) {
+		budget_stats.time[opp] += now - budget_stats.last;
+		if (budget_khz(opp) > boost_khz)
+			budget_stats.boost += now - budget_stats.last;
+	}
+	budget_stats.last = now;
+}
+
+static int budget_transition(struct notifier_block *nb, unsigned long event,
+			     void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	unsigned long flags;
+
+	if (event != CPUFREQ_POSTCHANGE)
+		return 0;
+	spin_lock_irqsave(&budget_lock, flags);
+	budget_account();
+	budget_stats.opp = budget_opp_of(freqs->new);
+	spin_unlock_irqrestore(&budget_lock, flags);
+	return 0;
+}
+
+static struct notifier_block budget_transition_nb = {
+	.notifier_call	= budget_transition,
+};
+
+static int budget_policy(struct notifier_block *nb, unsigned long event,
+			 void *data)
+{
+	struct cpufreq_policy *policy = data;
+	int cap = budget_cap;
+
+	if (event != CPUFREQ_ADJUST || !cap)
+		return 0;
+	cpufreq_verify_within_limits(policy, 0, budget_khz(cap));
+	return 0;
+}
+
+static struct notifier_block budget_policy_nb = {
+	.notifier_call	= budget_policy,
+};
+
+static void budget_set(int cap, int reason)
+{
+	int max_opp = budget_max_opp();
+	int from = budget_cap ? budget_cap : max_opp;
+	struct budget_event *ev;
+
+	if (cap >= max_opp)
+		cap = 0;
+	if (cap == budget_cap)
+		return;
+
+	ev = &budget_stats.event[budget_stats.event_next++ % BUDGET_EVENTS];
+	ev->when = jiffies;
+	ev->reason = reason;
+	ev->from = from;
+	ev->to = cap ? cap : max_opp;
+	ev->ma = budget_stats.ma;
+	ev->temp = budget_stats.temp;
+	budget_stats.throttles[reason]++;
+	if (reason != BUDGET_RELEASE)
+		pr_info("mpu_budget: %s, MPU capped at %u MHz\n",
+			budget_reason_name[reason], budget_khz(ev->to) / 1000);
+
+	budget_cap = cap;
+	cpufreq_update_policy(0);
+}
+
+static void budget_sample(struct work_struct *work)
+{
+	int max_opp = budget_max_opp();
+	int boost_opp = budget_opp_of(boost_khz);
+	int cap, opp = 0, over = -1, under;
+	unsigned long boost, flags;
+	long full = boost_budget_s * 1000L;
+	long elapsed, used;
+	int ma, temp, sampled = 1;
+
+	mutex_lock(&budget_mutex);
+	elapsed = jiffies_to_msecs(jiffies - budget_last_sample);
+	budget_last_sample = jiffies;
+
+	/* no transition seen yet */
+	if (!budget_stats.opp)
+		opp = budget_opp_of(cpufreq_quick_get(0));
+
+	spin_lock_irqsave(&budget_lock, flags);
+	if (!budget_stats.opp)
+		budget_stats.opp = opp;
+	budget_account();
+	boost = budget_stats.boost;
+	budget_stats.boost = 0;
+	spin_unlock_irqrestore(&budget_lock, flags);
+
+	if (!enable) {
+		budget_blocked = 0;
+		budget_ms = full;
+		budget_set(0, BUDGET_RELEASE);
+		goto out;
+	}
+
+	/* boost time costs its length, the rest refills at 1/refill_ratio */
+	used = jiffies_to_msecs(boost);
+	budget_ms -= used;
+	budget_ms += (elapsed - min(used, elapsed)) / max(refill_ratio, 1);
+	budget_ms = clamp(budget_ms, 0L, full);
+	if (!budget_ms)
+		budget_blocked = 1;
+	else if (budget_ms * 100 >= full * resume_pct)
+		budget_blocked = 0;
+
+	if (budget_bat) {
+		/* a failed read is no sample: keep the last ones, decide nothing */
+		if (budget_bat->get_current(budget_bat->data, &ma) ||
+		    budget_bat->get_temp(budget_bat->data, &temp)) {
+			sampled = 0;
+		} else {
+			/* discharge current, positive, smoothed over ~4 samples */
+			budget_stats.ma = (budget_stats.ma * 3 - ma) / 4;
+			budget_stats.temp = temp;
+			if (budget_stats.temp >= temp_c)
+				over = BUDGET_TEMP;
+			else if (budget_stats.ma > current_ma)
+				over = BUDGET_CURRENT;
+		}
+	}
+	under = sampled && (!budget_bat ||
+		(budget_stats.ma * 100 < current_ma * current_hyst_pct &&
+		 budget_stats.temp <= temp_c - temp_hyst_c));
+
+	cap = budget_cap ? budget_cap : max_opp;
+	if (over >= 0) {
+		if (budget_khz(budget_opp_below(cap)) >= min_khz)
+			cap = budget_opp_below(cap);
+		if (budget_blocked)
+			cap = min(cap, boost_opp);
+		budget_set(cap, over);
+	} else if (budget_blocked && cap > boost_opp) {
+		budget_set(boost_opp, BUDGET_BOOST);
+	} else if (under && cap < max_opp) {
+		cap = budget_opp_above(cap);
+		if (budget_blocked)
+			cap = min(cap, boost_opp);
+		budget_set(cap, BUDGET_RELEASE);
+	}
+out:
+	mutex_unlock(&budget_mutex);
+	schedule_delayed_work(&budget_work,
+			      msecs_to_jiffies(max(sample_ms, 100)));
+}
+
+/**
+ * omap_pm_register_battery - sets the battery the MPU budget monitors
+ * @bat: the battery, or NULL to stop monitoring it
+ */
+void omap_pm_register_battery(struct omap_pm_battery *bat)
+{
+	mutex_lock(&budget_mutex);
+	budget_bat = bat;
+	budget_stats.ma = 0;
+	mutex_unlock(&budget_mutex);
+}
+EXPORT_SYMBOL(omap_pm_register_battery);
+
+static int budget_show(struct seq_file *s, void *unused)
+{
+	int max_opp = budget_max_opp();
+	struct budget_event *ev;
+	unsigned long flags;
+	unsigned i, n;
+	int opp;
+
+	mutex_lock(&budget_mutex);
+	spin_lock_irqsave(&budget_lock, flags);
+	budget_account();
+	spin_unlock_irqrestore(&budget_lock, flags);
+
+	seq_printf(s, "cap %u MHz, boost budget %ld/%d s%s, %s\n",
+		   budget_khz(budget_cap ? budget_cap : max_opp) / 1000,
+		   budget_ms / 1000, boost_budget_s,
+		   budget_blocked ? " (blocked)" : "",
+		   enable ? "enabled" : "disabled");
+	if (budget_bat)
+		seq_printf(s, "battery %d mA, %d C\n", budget_stats.ma,
+			   budget_stats.temp);
+	else
+		seq_printf(s, "no battery monitor\n");
+	seq_printf(s, "throttles: boost %u current %u temp %u, "
+		   "releases %u\n", budget_stats.throttles[BUDGET_BOOST],
+		   budget_stats.throttles[BUDGET_CURRENT],
+		   budget_stats.throttles[BUDGET_TEMP],
+		   budget_stats.throttles[BUDGET_RELEASE]);
+	for (opp = 1; opp <= max_opp; opp++)
+		seq_printf(s, "OPP%d %4u MHz: %u ms\n", opp,
+			   budget_khz(opp) / 1000,
+			   jiffies_to_msecs(budget_stats.time[opp]));
+
+	n = min_t(unsigned, budget_stats.event_next, BUDGET_EVENTS);
+	for (i = budget_stats.event_next - n; i != budget_stats.event_next;
+	     i++) {
+		ev = &budget_stats.event[i % BUDGET_EVENTS];
+		seq_printf(s, "%8u ms ago: %-7s OPP%d -> OPP%d, %d mA, %d C\n",
+			   jiffies_to_msecs(jiffies - ev->when),
+			   budget_reason_name[ev->reason], ev->from, ev->to,
+			   ev->ma, ev->temp);
+	}
+	mutex_unlock(&budget_mutex);
+	return 0;
+}
+
+static int budget_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, budget_show, NULL);
+}
+
+static const struct file_operations budget_fops = {
+	.open		= budget_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init budget_init(void)
+{
+	if (!cpu_is_omap34xx() || !mpu_opps)
+		return -ENODEV;
+
+	budget_ms = boost_budget_s * 1000L;
+	budget_stats.last = jiffies;
+	budget_last_sample = jiffies;
+
+	cpufreq_register_notifier(&budget_transition_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+	cpufreq_register_notifier(&budget_policy_nb, CPUFREQ_POLICY_NOTIFIER);
+	INIT_DELAYED_WORK_DEFERRABLE(&budget_work, budget_sample);
+	schedule_delayed_work(&budget_work, msecs_to_jiffies(sample_ms));
+	debugfs_create_file("mpu_budget", S_IRUGO, NULL, NULL, &budget_fops);
+	return 0;
+}
+late_initcall(budget_init);
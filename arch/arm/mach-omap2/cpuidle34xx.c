@@ -24,6 +24,12 @@
 
 #include <linux/sched.h>
 #include <linux/cpuidle.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/io.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <mach/hardware.h>
 #include <mach/prcm.h>
 #include <mach/powerdomain.h>
 #include <mach/clockdomain.h>
@@ -68,7 +74,167 @@ struct omap3_processor_cx current_cx_state;
 struct powerdomain *mpu_pd, *core_pd, *per_pd, *iva2_pd;
 struct powerdomain *sgx_pd, *usb_pd, *cam_pd, *dss_pd;
 
-static int omap3_idle_bm_check(void)
+struct omap3_idle_sample omap3_idle_sample;
+
+#ifdef CONFIG_PM_DEBUG
+/*
+ * Per state, per phase latency of the idle path, measured with the 32k sync
+ * counter and shown in debugfs, pm_debug/cx_latency.
+ */
+
+enum {
+	OMAP3_IDLE_PHASE_PRE,		/* programming the powerdomains */
+	OMAP3_IDLE_PHASE_SAVE,		/* omap_sram_idle context save */
+	OMAP3_IDLE_PHASE_WAKE,		/* timer expiry until back from sram */
+	OMAP3_IDLE_PHASE_RESTORE,	/* omap_sram_idle context restore */
+	OMAP3_IDLE_PHASE_POST,		/* cleaning up for cpuidle */
+	OMAP3_IDLE_PHASES,
+};
+
+static const char *omap3_idle_phase_names[OMAP3_IDLE_PHASES] = {
+	"pre", "save", "wake", "restore", "post",
+};
+
+/* log2 buckets of ticks: 0, 1, 2-3, 4-7, ... 128-255, >= 256 (7.8ms) */
+#define OMAP3_IDLE_HIST_BUCKETS	10
+
+struct omap3_idle_phase_stats {
+	u32 count;
+	u32 max;
+	u64 total;
+	u32 hist[OMAP3_IDLE_HIST_BUCKETS];
+};
+
+struct omap3_idle_cx_stats {
+	u32 entries;
+	u32 aborted;		/* gave up before wfi */
+	u32 timer_wakeups;
+	u32 bad_wakeups;	/* left before the break-even threshold */
+	struct omap3_idle_phase_stats phase[OMAP3_IDLE_PHASES];
+};
+
+static struct omap3_idle_cx_stats omap3_idle_stats[OMAP3_MAX_STATES];
+static u32 omap3_idle_timer_expiry;
+
+static void omap3_idle_phase(struct omap3_idle_phase_stats *ps, u32 ticks)
+{
+	int bucket = fls(ticks);
+
+	if (bucket >= OMAP3_IDLE_HIST_BUCKETS)
+		bucket = OMAP3_IDLE_HIST_BUCKETS - 1;
+	ps->hist[bucket]++;
+	ps->count++;
+	ps->total += ticks;
+	if (ticks > ps->max)
+		ps->max = ticks;
+}
+
+/* note when the tick timer will fire, the one wakeup we know the time of */
+static void omap3_idle_start(void)
+{
+	s64 us = ktime_to_us(tick_nohz_get_sleep_length());
+
+	omap3_idle_timer_expiry = omap3_idle_sample.stamp[OMAP3_IDLE_STAMP_ENTER]
+		+ (u32)div_u64((u64)max_t(s64, us, 0) << 9, 15625);
+}
+
+static void omap3_idle_account(struct omap3_processor_cx *cx)
+{
+	struct omap3_idle_cx_stats *st = &omap3_idle_stats[cx -
+							   omap3_power_states];
+	u32 *t = omap3_idle_sample.stamp;
+	u32 wake_from;
+
+	st->entries++;
+	if (omap3_idle_sample.aborted) {
+		st->aborted++;
+		return;
+	}
+
+	omap3_idle_phase(&st->phase[OMAP3_IDLE_PHASE_PRE],
+			 t[OMAP3_IDLE_STAMP_SRAM] - t[OMAP3_IDLE_STAMP_ENTER]);
+	omap3_idle_phase(&st->phase[OMAP3_IDLE_PHASE_SAVE],
+			 t[OMAP3_IDLE_STAMP_WFI] - t[OMAP3_IDLE_STAMP_SRAM]);
+	omap3_idle_phase(&st->phase[OMAP3_IDLE_PHASE_RESTORE],
+			 t[OMAP3_IDLE_STAMP_RESTORED] - t[OMAP3_IDLE_STAMP_RESUME]);
+	omap3_idle_phase(&st->phase[OMAP3_IDLE_PHASE_POST],
+			 t[OMAP3_IDLE_STAMP_END] - t[OMAP3_IDLE_STAMP_RESTORED]);
+
+	/*
+	 * Woken by the timer: everything from its expiry until we got back
+	 * from sleep34xx.S is PRCM wakeup transition and ROM/asm restore.
+	 */
+	if ((s32)(t[OMAP3_IDLE_STAMP_RESUME] - omap3_idle_timer_expiry) >= 0) {
+		wake_from = omap3_idle_timer_expiry;
+		if ((s32)(t[OMAP3_IDLE_STAMP_WFI] - wake_from) > 0)
+			wake_from = t[OMAP3_IDLE_STAMP_WFI];
+		omap3_idle_phase(&st->phase[OMAP3_IDLE_PHASE_WAKE],
+				 t[OMAP3_IDLE_STAMP_RESUME] - wake_from);
+		st->timer_wakeups++;
+	}
+
+	if (ticks_to_us(t[OMAP3_IDLE_STAMP_END] - t[OMAP3_IDLE_STAMP_ENTER]) <
+	    cx->threshold)
+		st->bad_wakeups++;
+}
+
+static int omap3_idle_latency_show(struct seq_file *s, void *unused)
+{
+	int i, p, b;
+
+	for (i = OMAP3_STATE_C1; i < OMAP3_MAX_STATES; i++) {
+		struct omap3_idle_cx_stats *st = &omap3_idle_stats[i];
+
+		if (!st->entries)
+			continue;
+
+		seq_printf(s, "C%d: entries %u aborted %u timer wakeups %u "
+			   "bad wakeups %u (threshold %uus)\n", i + 1,
+			   st->entries, st->aborted, st->timer_wakeups,
+			   st->bad_wakeups, omap3_power_states[i].threshold);
+		seq_printf(s, "  phase    count   avg_us   max_us  "
+			   "ticks: 0 1 2-3 4-7 8-15 16-31 32-63 64-127 "
+			   "128-255 >=256\n");
+		for (p = 0; p < OMAP3_IDLE_PHASES; p++) {
+			struct omap3_idle_phase_stats *ps = &st->phase[p];
+
+			seq_printf(s, "  %-7s %6u %8u %8u  ",
+				   omap3_idle_phase_names[p], ps->count,
+				   ps->count ? ticks_to_us(div_u64(ps->total,
+							ps->count)) : 0,
+				   ticks_to_us(ps->max));
+			for (b = 0; b < OMAP3_IDLE_HIST_BUCKETS; b++)
+				seq_printf(s, " %u", ps->hist[b]);
+			seq_printf(s, "\n");
+		}
+	}
+
+	return 0;
+}
+
+static int omap3_idle_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap3_idle_latency_show, NULL);
+}
+
+static const struct file_operations omap3_idle_latency_fops = {
+	.open		= omap3_idle_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void omap3_idle_dbg_init(struct dentry *d)
+{
+	(void) debugfs_create_file("cx_latency", S_IRUGO, d, NULL,
+				   &omap3_idle_latency_fops);
+}
+#else
+static inline void omap3_idle_start(void) { }
+static inline void omap3_idle_account(struct omap3_processor_cx *cx) { }
+#endif /* CONFIG_PM_DEBUG */
+
+int omap3_idle_bm_check(void)
 {
 	if (!omap3_can_sleep())
 		return 1;
@@ -125,6 +291,11 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 	local_irq_disable();
 	local_fiq_disable();
 
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_ENTER);
+	omap3_idle_sample.aborted = 1;
+	omap3_idle_sample.wake_irq = -1;
+	omap3_idle_start();
+
 
 	if (!enable_oswr_ret) {
 		if (mpu_logicl1_ret_state == PWRDM_POWER_OFF)
@@ -166,8 +337,10 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 		pwrdm_for_each_clkdm(core_pd, _cpuidle_deny_idle);
 	}
 
-	/* Execute ARM wfi */
+	/* Execute ARM wfi, omap_sram_idle stamps the way in and out */
+	omap3_idle_sample.aborted = 0;
 	omap_sram_idle();
+	omap3_idle_sample.wake_irq = omap_irq_pending_nr();
 
 	if (cx->type == OMAP3_STATE_C1) {
 		pwrdm_for_each_clkdm(mpu_pd, _cpuidle_allow_idle);
@@ -177,6 +350,8 @@ static int omap3_enter_idle(struct cpuidle_device *dev,
 	pwrdm_set_next_pwrst(mpu_pd, saved_mpu_state);
 
 return_sleep_time:
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_END);
+	omap3_idle_account(cx);
 	getnstimeofday(&ts_postidle);
 	ts_idle = timespec_sub(ts_postidle, ts_preidle);
 
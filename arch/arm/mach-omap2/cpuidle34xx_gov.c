@@ -0,0 +1,406 @@
+/*
+ * linux/arch/arm/mach-omap2/cpuidle34xx_gov.c
+ *
+ * OMAP3 learning idle governor
+ *
+ * The generic menu governor picks a C state from the next timer event and
+ * the static exit_latency/target_residency numbers of the state table. On a
+ * mostly idle device most wakeups are I/O interrupts arriving well before
+ * the timer, so it keeps choosing deep states it is pulled out of again
+ * right away, paying their full exit cost.
+ *
+ * This governor instead:
+ *  - predicts the idle length from the history of each interrupt source
+ *    that woke us (sources that recur at a regular interval are expected to
+ *    do so again), and from how much of the timer sleep length we actually
+ *    got on average,
+ *  - measures the entry and exit cost of every state at runtime and scales
+ *    the table's break-even residency by the measured cost,
+ *  - skips states the bus master check in omap3_enter_idle_bm would veto
+ *    anyway, and attributes residency to the state actually entered.
+ *
+ * Per state predicted vs actual residency, learned costs and the tracked
+ * interrupt sources are shown in debugfs, omap3_idle_governor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos_params.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "pm.h"
+
+/* exponentially weighted averages keep 7/8 of the old value */
+#define EWMA(avg, val)		((avg) = ((avg) * 7 + (val)) / 8)
+
+/* interrupt sources tracked for periodicity */
+#define OMAP3_GOV_SOURCES	8
+/* intervals within 1/4 of the average count as regular */
+#define OMAP3_GOV_JITTER_SHIFT	2
+/* regular wakeups in a row before a source is trusted */
+#define OMAP3_GOV_MIN_CONF	2
+/* periods a trusted source may be missed before it is ignored */
+#define OMAP3_GOV_MAX_MISSED	4
+/* fixed point unit of the timer correction factor */
+#define OMAP3_GOV_CORR_UNIT	1024
+/* slack in 32k ticks when deciding whether the timer was what woke us */
+#define OMAP3_GOV_TIMER_SLACK	1
+
+struct omap3_gov_source {
+	int irq;
+	unsigned int wakes;
+	unsigned int conf;		/* regular intervals in a row */
+	unsigned int interval_us;	/* average interval */
+	u32 last;			/* last wakeup by this source, 32k ticks */
+};
+
+struct omap3_gov_state {
+	/* learned costs, valid once the sample counts are non-zero */
+	unsigned int entry_us;
+	unsigned int exit_us;
+	unsigned int entry_samples;
+	unsigned int exit_samples;
+
+	/* statistics */
+	unsigned int selected;
+	unsigned int entered;
+	unsigned int bm_vetoes;		/* skipped for bus master activity */
+	unsigned int demoted;		/* driver entered a shallower state */
+	unsigned int early;		/* woke before half the prediction */
+	unsigned int late;		/* slept over twice the prediction */
+	u64 predicted_us;
+	u64 actual_us;
+};
+
+struct omap3_gov {
+	int last_idx;
+	unsigned int predicted_us;
+	unsigned int timer_us;
+	u32 select_time;		/* 32k ticks */
+	unsigned int correction;	/* actual / timer sleep length */
+	unsigned int timer_wakes;
+	struct omap3_gov_source sources[OMAP3_GOV_SOURCES];
+	struct omap3_gov_state states[CPUIDLE_STATE_MAX];
+};
+
+static struct omap3_gov omap3_gov;
+
+/* 32k ticks to us, for deltas of the omap3_idle_ticks() time base */
+static unsigned int omap3_gov_us(u32 delta)
+{
+	u64 us;
+
+	if ((s32)delta < 0)
+		return 0;
+	us = ((u64)delta * 15625) >> 9;
+	if (us > UINT_MAX)
+		return UINT_MAX;
+	return us;
+}
+
+static u32 omap3_gov_ticks(unsigned int us)
+{
+	return div_u64((u64)us << 9, 15625);
+}
+
+/* measured entry + exit cost of a state, the table's until we know better */
+static unsigned int omap3_gov_cost(struct cpuidle_state *s,
+				   struct omap3_gov_state *gs)
+{
+	if (!gs->entry_samples || !gs->exit_samples)
+		return s->exit_latency;
+	return gs->entry_us + gs->exit_us;
+}
+
+/*
+ * Break even residency: the table's target_residency holds the energy cost
+ * of a transition relative to its latency, keep that ratio for the measured
+ * cost.
+ */
+static unsigned int omap3_gov_residency(struct cpuidle_state *s,
+					struct omap3_gov_state *gs)
+{
+	if (!s->exit_latency)
+		return s->target_residency;
+	return div_u64((u64)s->target_residency * omap3_gov_cost(s, gs),
+		       s->exit_latency);
+}
+
+/*
+ * omap3_gov_predict - expected idle length: the timer sleep length scaled by
+ * how much of it we usually get, cut short by the next expected wakeup of
+ * any interrupt source that has been recurring regularly.
+ */
+static unsigned int omap3_gov_predict(struct omap3_gov *g, u32 now,
+				      unsigned int timer_us)
+{
+	unsigned int pred;
+	int i;
+
+	pred = div_u64((u64)timer_us * g->correction, OMAP3_GOV_CORR_UNIT);
+
+	for (i = 0; i < OMAP3_GOV_SOURCES; i++) {
+		struct omap3_gov_source *src = &g->sources[i];
+		unsigned int since, periods, next;
+
+		if (src->conf < OMAP3_GOV_MIN_CONF || !src->interval_us)
+			continue;
+
+		since = omap3_gov_us(now - src->last);
+		periods = since / src->interval_us + 1;
+		if (periods > OMAP3_GOV_MAX_MISSED)
+			continue;
+
+		next = periods * src->interval_us - since;
+		if (next < pred)
+			pred = next;
+	}
+
+	return pred;
+}
+
+/**
+ * omap3_gov_select - selects the next idle state to enter
+ * @dev: the CPU
+ */
+static int omap3_gov_select(struct cpuidle_device *dev)
+{
+	struct omap3_gov *g = &omap3_gov;
+	int latency_req = pm_qos_requirement(PM_QOS_CPU_DMA_LATENCY);
+	s64 sleep_us = ktime_to_us(tick_nohz_get_sleep_length());
+	int i;
+
+	g->select_time = omap3_idle_ticks();
+	g->timer_us = clamp_t(s64, sleep_us, 0, UINT_MAX);
+	g->predicted_us = omap3_gov_predict(g, g->select_time, g->timer_us);
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0)) {
+		i = 1;
+		goto out;
+	}
+
+	/* find the deepest idle state that pays off */
+	for (i = CPUIDLE_DRIVER_STATE_START + 1; i < dev->max_state; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+		struct omap3_gov_state *gs = &g->states[i];
+
+		if (omap3_gov_residency(s, gs) > g->predicted_us)
+			break;
+		if (omap3_gov_cost(s, gs) > latency_req)
+			break;
+	}
+
+out:
+	i--;
+
+	/*
+	 * With bus masters active omap3_enter_idle_bm falls back to the safe
+	 * state anyway; go there directly and keep track of how often.
+	 */
+	if ((dev->states[i].flags & CPUIDLE_FLAG_CHECK_BM) &&
+	    omap3_idle_bm_check()) {
+		g->states[i].bm_vetoes++;
+		i = dev->safe_state - dev->states;
+	}
+
+	g->states[i].selected++;
+	g->last_idx = i;
+	return i;
+}
+
+static void omap3_gov_track_source(struct omap3_gov *g, int irq, u32 when)
+{
+	struct omap3_gov_source *src, *oldest = NULL;
+	unsigned int interval;
+	int i;
+
+	for (i = 0; i < OMAP3_GOV_SOURCES; i++) {
+		src = &g->sources[i];
+		if (src->wakes && src->irq == irq)
+			goto found;
+		if (!oldest || (s32)(src->last - oldest->last) < 0)
+			oldest = src;
+	}
+
+	/* replace the source that has been quiet the longest */
+	src = oldest;
+	memset(src, 0, sizeof(*src));
+	src->irq = irq;
+	src->wakes = 1;
+	src->last = when;
+	return;
+
+found:
+	src->wakes++;
+	interval = omap3_gov_us(when - src->last);
+	src->last = when;
+
+	if (src->interval_us && abs((int)(interval - src->interval_us)) <
+	    (src->interval_us >> OMAP3_GOV_JITTER_SHIFT)) {
+		src->conf++;
+		EWMA(src->interval_us, interval);
+	} else {
+		src->conf = 0;
+		src->interval_us = interval;
+	}
+}
+
+/**
+ * omap3_gov_reflect - learns from what happened after entry
+ * @dev: the CPU
+ */
+static void omap3_gov_reflect(struct cpuidle_device *dev)
+{
+	struct omap3_gov *g = &omap3_gov;
+	struct omap3_idle_sample *sample = &omap3_idle_sample;
+	u32 *t = sample->stamp;
+	unsigned int actual = cpuidle_get_last_residency(dev);
+	struct omap3_gov_state *gs;
+	unsigned int entry_us;
+	u32 timer_end;
+	int idx;
+
+	idx = dev->last_state ? dev->last_state - dev->states : g->last_idx;
+	if (idx != g->last_idx)
+		g->states[g->last_idx].demoted++;
+	gs = &g->states[idx];
+
+	gs->entered++;
+	gs->predicted_us += g->predicted_us;
+	gs->actual_us += actual;
+	if (actual < g->predicted_us / 2)
+		gs->early++;
+	else if (actual / 2 > g->predicted_us)
+		gs->late++;
+
+	if (sample->aborted)
+		return;
+
+	entry_us = omap3_gov_us(t[OMAP3_IDLE_STAMP_WFI] -
+				t[OMAP3_IDLE_STAMP_ENTER]);
+	if (!gs->entry_samples++)
+		gs->entry_us = entry_us;
+	else
+		EWMA(gs->entry_us, entry_us);
+
+	timer_end = g->select_time + omap3_gov_ticks(g->timer_us);
+	if ((s32)(t[OMAP3_IDLE_STAMP_END] - timer_end) >=
+	    -OMAP3_GOV_TIMER_SLACK) {
+		/*
+		 * The timer woke us, so we know when the wakeup event
+		 * happened and everything after it is the exit cost.
+		 */
+		unsigned int exit_us;
+
+		if ((s32)(timer_end - t[OMAP3_IDLE_STAMP_WFI]) < 0)
+			timer_end = t[OMAP3_IDLE_STAMP_WFI];
+		exit_us = omap3_gov_us(t[OMAP3_IDLE_STAMP_END] - timer_end);
+		if (!gs->exit_samples++)
+			gs->exit_us = exit_us;
+		else
+			EWMA(gs->exit_us, exit_us);
+		g->timer_wakes++;
+	} else if (sample->wake_irq >= 0) {
+		omap3_gov_track_source(g, sample->wake_irq,
+				       t[OMAP3_IDLE_STAMP_END]);
+	}
+
+	if (g->timer_us) {
+		unsigned int ratio = min_t(u64, OMAP3_GOV_CORR_UNIT,
+			div_u64((u64)actual * OMAP3_GOV_CORR_UNIT,
+				g->timer_us));
+
+		EWMA(g->correction, ratio);
+	}
+}
+
+/**
+ * omap3_gov_enable_device - scans a CPU's states and does setup
+ * @dev: the CPU
+ */
+static int omap3_gov_enable_device(struct cpuidle_device *dev)
+{
+	memset(&omap3_gov, 0, sizeof(omap3_gov));
+	omap3_gov.correction = OMAP3_GOV_CORR_UNIT;
+
+	return 0;
+}
+
+static struct cpuidle_governor omap3_governor = {
+	.name =		"omap3",
+	.rating =	25,
+	.enable =	omap3_gov_enable_device,
+	.select =	omap3_gov_select,
+	.reflect =	omap3_gov_reflect,
+	.owner =	THIS_MODULE,
+};
+
+static int omap3_gov_stats_show(struct seq_file *m, void *unused)
+{
+	struct cpuidle_device *dev = __get_cpu_var(cpuidle_devices);
+	struct omap3_gov *g = &omap3_gov;
+	int i;
+
+	if (!dev)
+		return 0;
+
+	seq_printf(m, "timer correction %u/%u, timer wakeups %u\n",
+		   g->correction, OMAP3_GOV_CORR_UNIT, g->timer_wakes);
+	seq_printf(m, "state selected entered bm_veto demoted early late "
+		   "pred_avg_us actual_avg_us entry_us exit_us "
+		   "table_cost_us residency_us\n");
+	for (i = 0; i < dev->state_count; i++) {
+		struct cpuidle_state *s = &dev->states[i];
+		struct omap3_gov_state *gs = &g->states[i];
+		unsigned int n = gs->entered ? gs->entered : 1;
+
+		seq_printf(m, "%-5s %8u %7u %7u %7u %5u %4u %11llu %13llu "
+			   "%8u %7u %13u %12u\n", s->name, gs->selected,
+			   gs->entered, gs->bm_vetoes, gs->demoted, gs->early,
+			   gs->late, div_u64(gs->predicted_us, n),
+			   div_u64(gs->actual_us, n), gs->entry_us,
+			   gs->exit_us, s->exit_latency,
+			   omap3_gov_residency(s, gs));
+	}
+
+	seq_printf(m, "irq wakes conf interval_us\n");
+	for (i = 0; i < OMAP3_GOV_SOURCES; i++) {
+		struct omap3_gov_source *src = &g->sources[i];
+
+		if (src->wakes)
+			seq_printf(m, "%3d %5u %4u %11u\n", src->irq,
+				   src->wakes, src->conf, src->interval_us);
+	}
+
+	return 0;
+}
+
+static int omap3_gov_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, omap3_gov_stats_show, NULL);
+}
+
+static const struct file_operations omap3_gov_stats_fops = {
+	.open		= omap3_gov_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init omap3_gov_init(void)
+{
+	debugfs_create_file("omap3_idle_governor", S_IRUGO, NULL, NULL,
+			    &omap3_gov_stats_fops);
+	return cpuidle_register_governor(&omap3_governor);
+}
+late_initcall(omap3_gov_init);
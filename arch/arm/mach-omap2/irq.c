@@ -192,6 +192,33 @@ int omap_irq_pending(void)
 
 	return 0;
 }
+
+/*
+ * omap_irq_pending_nr - returns the lowest numbered pending interrupt, or -1
+ * if there is none. The idle code uses this to tell what woke it up.
+ */
+int omap_irq_pending_nr(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(irq_banks); i++) {
+		struct omap_irq_bank *bank = irq_banks + i;
+		int irq;
+
+		for (irq = 0; irq < bank->nr_irqs; irq += IRQ_BITS_PER_REG) {
+			int offset = irq & (~(IRQ_BITS_PER_REG - 1));
+			u32 pending;
+
+			pending = intc_bank_read_reg(bank, (INTC_PENDING_IRQ0 +
+							    offset));
+			if (pending)
+				return irq + __ffs(pending);
+		}
+	}
+
+	return -1;
+}
+
 void omap3_intc_autoidle(int enable)
 {
 	u32 read_val;
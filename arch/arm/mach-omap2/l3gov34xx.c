@@ -0,0 +1,227 @@
+/*
+ * linux/arch/arm/mach-omap2/l3gov34xx.c
+ *
+ * OMAP3 L3 (VDD2) throughput governor
+ *
+ * The VDD2 OPP is a shared resource whose level is the largest L3
+ * throughput any single user asked for with omap_pm_set_min_bus_tput, so
+ * unless VDD1 is high enough to pull it up, L3 stays at its lowest OPP even
+ * when several initiators (DSS, ISP, sDMA for MMC, the DSP) load the
+ * interconnect at once and together need more than any one of them asked
+ * for.
+ *
+ * Every sample period this governor estimates the L3 demand as the sum of
+ * the throughput requests, leaving out the floor VDD1 puts on VDD2, plus a
+ * fixed allowance per running sDMA channel (the OMAP3 has no L3 or SDRC
+ * traffic counters), and requests the lowest OPP whose bandwidth covers it
+ * with up_pct headroom. It raises the OPP as soon as the demand needs it
+ * but only lowers it once the demand has fit the lower OPP with down_pct
+ * headroom for down_samples periods in a row.
+ *
+ * Time in each OPP, transitions and the demand seen are shown in debugfs,
+ * l3_governor.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/device.h>
+#include <linux/jiffies.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <mach/omap-pm.h>
+#include <mach/omap34xx.h>
+#include <mach/resource.h>
+#include <mach/dma.h>
+
+#include "pm.h"
+
+#define L3GOV_MAX_OPPS		(VDD2_OPP3 + 1)
+
+static int enable = 1;
+module_param(enable, int, S_IRUGO | S_IWUSR);
+static int sample_ms = 100;
+module_param(sample_ms, int, S_IRUGO | S_IWUSR);
+/* percentage of an OPP's bandwidth the demand may use before going up */
+static int up_pct = 80;
+module_param(up_pct, int, S_IRUGO | S_IWUSR);
+/* and that it must fit in the lower OPP before going down */
+static int down_pct = 60;
+module_param(down_pct, int, S_IRUGO | S_IWUSR);
+static int down_samples = 5;
+module_param(down_samples, int, S_IRUGO | S_IWUSR);
+/* L3 throughput assumed for each running sDMA channel, in KiB/s */
+static int sdma_kib = 100000;
+module_param(sdma_kib, int, S_IRUGO | S_IWUSR);
+
+static struct device l3gov_dev;
+/*
+ * Left out of the demand: the governor's own request, and the one VDD1
+ * holds on VDD2 at its higher OPPs. That one is a floor the VDD2 resource
+ * applies on its own, not L3 traffic, and counting it would keep VDD2 up
+ * whenever the CPU runs fast.
+ */
+static struct device *l3gov_exclude[] = {
+	&l3gov_dev, &vdd2_floor_dev, NULL
+};
+static struct delayed_work l3gov_work;
+static DEFINE_MUTEX(l3gov_mutex);
+
+/* OPP requested by the governor, 0 while it holds no request */
+static int l3gov_opp;
+static int l3gov_below;
+static unsigned long l3gov_last;
+
+static struct {
+	unsigned long time[L3GOV_MAX_OPPS];	/* jiffies */
+	u32 up;
+	u32 down;
+	u32 samples;
+	long demand;
+	long demand_max;
+	int sdma_active;
+} l3gov_stats;
+
+/* bandwidth of an OPP in KiB/s, the L3 moving 4 bytes per clock */
+static long l3gov_capacity(int opp)
+{
+	return l3_opps[opp].rate / 1000 * 4;
+}
+
+static int l3gov_sdma_active(void)
+{
+	int lch, active = 0;
+
+	for (lch = 0; lch < OMAP_DMA4_LOGICAL_DMA_CH_COUNT; lch++)
+		if (omap_get_dma_active_status(lch))
+			active++;
+	return active;
+}
+
+static void l3gov_account(int opp)
+{
+	unsigned long now = jiffies;
+
+	if (opp >= 0 && opp < L3GOV_MAX_OPPS)
+		l3gov_stats.time[opp] += now - l3gov_last;
+	l3gov_last = now;
+}
+
+static void l3gov_set(int opp, int min_opp)
+{
+	if (opp == l3gov_opp)
+		return;
+	if (opp > l3gov_opp)
+		l3gov_stats.up++;
+	else
+		l3gov_stats.down++;
+	l3gov_opp = opp;
+	if (opp <= min_opp)
+		resource_release("vdd2_opp", &l3gov_dev);
+	else
+		resource_request("vdd2_opp", &l3gov_dev,
+				 l3gov_capacity(opp));
+}
+
+static void l3gov_sample(struct work_struct *work)
+{
+	int min_opp = omap_pm_get_min_vdd2_opp();
+	int max_opp = omap_pm_get_max_vdd2_opp();
+	int cur, target;
+	long demand;
+
+	mutex_lock(&l3gov_mutex);
+	cur = max(l3gov_opp, min_opp);
+	l3gov_account(resource_get_level("vdd2_opp"));
+
+	if (!enable) {
+		l3gov_set(0, min_opp);
+		l3gov_below = 0;
+		goto out;
+	}
+
+	l3gov_stats.sdma_active = l3gov_sdma_active();
+	demand = resource_sum_levels("vdd2_opp", l3gov_exclude);
+	if (demand < 0)
+		goto out;
+	demand += l3gov_stats.sdma_active * sdma_kib;
+	l3gov_stats.demand = demand;
+	if (demand > l3gov_stats.demand_max)
+		l3gov_stats.demand_max = demand;
+	l3gov_stats.samples++;
+
+	for (target = min_opp; target < max_opp; target++)
+		if (demand * 100 <= l3gov_capacity(target) * up_pct)
+			break;
+
+	if (target > cur) {
+		l3gov_below = 0;
+		l3gov_set(target, min_opp);
+	} else if (cur > min_opp &&
+		   demand * 100 <= l3gov_capacity(cur - 1) * down_pct) {
+		if (++l3gov_below >= down_samples) {
+			l3gov_below = 0;
+			l3gov_set(cur - 1, min_opp);
+		}
+	} else {
+		l3gov_below = 0;
+	}
+out:
+	mutex_unlock(&l3gov_mutex);
+	schedule_delayed_work(&l3gov_work,
+			      msecs_to_jiffies(max(sample_ms, 10)));
+}
+
+static int l3gov_show(struct seq_file *s, void *unused)
+{
+	int min_opp = omap_pm_get_min_vdd2_opp();
+	int max_opp = omap_pm_get_max_vdd2_opp();
+	int opp;
+
+	mutex_lock(&l3gov_mutex);
+	l3gov_account(resource_get_level("vdd2_opp"));
+	seq_printf(s, "requested OPP %d, current OPP %d, %s\n",
+		   max(l3gov_opp, min_opp), resource_get_level("vdd2_opp"),
+		   enable ? "enabled" : "disabled");
+	seq_printf(s, "demand %ld KiB/s (max %ld), sdma channels %d, "
+		   "samples %u\n", l3gov_stats.demand, l3gov_stats.demand_max,
+		   l3gov_stats.sdma_active, l3gov_stats.samples);
+	seq_printf(s, "transitions up %u down %u\n",
+		   l3gov_stats.up, l3gov_stats.down);
+	for (opp = min_opp; opp <= max_opp; opp++)
+		seq_printf(s, "OPP%d %3lu MHz %7ld KiB/s: %u ms\n", opp,
+			   l3_opps[opp].rate / 1000000, l3gov_capacity(opp),
+			   jiffies_to_msecs(l3gov_stats.time[opp]));
+	mutex_unlock(&l3gov_mutex);
+	return 0;
+}
+
+static int l3gov_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, l3gov_show, NULL);
+}
+
+static const struct file_operations l3gov_fops = {
+	.open		= l3gov_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init l3gov_init(void)
+{
+	if (!cpu_is_omap34xx() || !l3_opps)
+		return -ENODEV;
+
+	l3gov_last = jiffies;
+	INIT_DELAYED_WORK_DEFERRABLE(&l3gov_work, l3gov_sample);
+	schedule_delayed_work(&l3gov_work, msecs_to_jiffies(sample_ms));
+	debugfs_create_file("l3_governor", S_IRUGO, NULL, NULL, &l3gov_fops);
+	return 0;
+}
+late_initcall(l3gov_init);
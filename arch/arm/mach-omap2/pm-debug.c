@@ -544,6 +544,8 @@ static int __init pm_dbg_init(void)
 
 	pwrdm_for_each_nolock(pwrdms_setup, (void *)d);
 
+	omap3_idle_dbg_init(d);
+
 	pm_dbg_dir = debugfs_create_dir("registers", d);
 	if (IS_ERR(pm_dbg_dir))
 		return PTR_ERR(pm_dbg_dir);
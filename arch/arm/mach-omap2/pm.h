@@ -12,6 +12,9 @@
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
  */
+#include <linux/dcache.h>
+#include <mach/hardware.h>
+#include <mach/io.h>
 #include <mach/powerdomain.h>
 
 extern int omap2_pm_init(void);
@@ -19,8 +22,58 @@ extern int omap3_pm_init(void);
 
 #ifdef CONFIG_CPU_IDLE
 int omap3_idle_init(void);
+int omap3_idle_bm_check(void);
+
+/* 32k sync counter stamps taken along the idle path */
+enum {
+	OMAP3_IDLE_STAMP_ENTER,		/* omap3_enter_idle called */
+	OMAP3_IDLE_STAMP_SRAM,		/* omap_sram_idle called */
+	OMAP3_IDLE_STAMP_WFI,		/* context saved, into sleep34xx.S */
+	OMAP3_IDLE_STAMP_RESUME,	/* back from sleep34xx.S */
+	OMAP3_IDLE_STAMP_RESTORED,	/* omap_sram_idle done restoring */
+	OMAP3_IDLE_STAMP_END,		/* about to re-enable interrupts */
+	OMAP3_IDLE_STAMPS,
+};
+
+/*
+ * The idle path is timed with the 32k sync counter, which keeps running
+ * in off mode and through suspend, where timekeeping is stopped. One tick
+ * is 30.5us.
+ */
+#define OMAP3_32KSYNCT_CR	(OMAP2_32KSYNCT_BASE + 0x10)
+#define ticks_to_us(t)		((u32)(((u64)(t) * 15625) >> 9))
+
+static inline u32 omap3_idle_ticks(void)
+{
+	return omap_readl(OMAP3_32KSYNCT_CR);
+}
+
+/*
+ * Timestamps of the last pass through omap3_enter_idle, from which the
+ * OMAP3 idle governor learns the real entry and exit cost of each state
+ * and the per-phase latency stats are kept.
+ */
+struct omap3_idle_sample {
+	int wake_irq;		/* first pending interrupt at wakeup, or -1 */
+	int aborted;		/* bailed out before wfi */
+	u32 stamp[OMAP3_IDLE_STAMPS];
+};
+extern struct omap3_idle_sample omap3_idle_sample;
+
+static inline void omap3_idle_stamp(int stamp)
+{
+	omap3_idle_sample.stamp[stamp] = omap3_idle_ticks();
+}
+
+#ifdef CONFIG_PM_DEBUG
+extern void omap3_idle_dbg_init(struct dentry *d);
+#else
+static inline void omap3_idle_dbg_init(struct dentry *d) { }
+#endif
 #else
 static inline int omap3_idle_init(void) { return 0; }
+static inline void omap3_idle_stamp(int stamp) { }
+static inline void omap3_idle_dbg_init(struct dentry *d) { }
 #endif
 
 extern unsigned short enable_dyn_sleep;
@@ -29,6 +82,7 @@ extern unsigned short enable_off_idle_path;
 extern unsigned short enable_oswr_ret;
 extern unsigned short voltage_off_while_idle;
 extern atomic_t sleep_block;
+extern struct device vdd2_floor_dev;
 extern void *omap3_secure_ram_storage;
 
 extern unsigned short wakeup_timer_seconds;
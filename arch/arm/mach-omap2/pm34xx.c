@@ -28,6 +28,7 @@
 #include <linux/err.h>
 #include <linux/clk.h>
 #include <linux/reboot.h>
+#include <linux/suspend_profile.h>
 
 #include <mach/gpio.h>
 #include <mach/cpu.h>
@@ -425,6 +426,8 @@ void omap_sram_idle(void)
 	if (!_omap_sram_idle)
 		return;
 
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_SRAM);
+
 	pwrdm_clear_all_prev_pwrst(mpu_pwrdm);
 	pwrdm_clear_all_prev_pwrst(neon_pwrdm);
 	pwrdm_clear_all_prev_pwrst(core_pwrdm);
@@ -650,8 +653,10 @@ void omap_sram_idle(void)
 	 * get saved. The restore path then reads from this
 	 * location and restores them back.
 	 */
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_WFI);
 	_omap_sram_idle(omap3_arm_context, save_state);
 	cpu_init();
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_RESUME);
 
 	/* Restore normal SDRC POWER settings */
 	if (omap_rev() >= OMAP3430_REV_ES3_0 &&
@@ -769,6 +774,7 @@ void omap_sram_idle(void)
 
 	pwrdm_post_transition();
 
+	omap3_idle_stamp(OMAP3_IDLE_STAMP_RESTORED);
 }
 
 
@@ -905,7 +911,10 @@ static int omap3_pm_suspend(void)
 	omap_uart_prepare_suspend();
 	omap3_intc_suspend();
 	regset_save_on_suspend = 1;
+	suspend_profile_stage(SUSPEND_PROFILE_SLEEP);
 	omap_sram_idle();
+	suspend_profile_stage(SUSPEND_PROFILE_WAKEUP);
+	suspend_profile_wakeup_irq(omap_irq_pending_nr());
 	regset_save_on_suspend = 0;
 
 restore:
@@ -1929,8 +1938,30 @@ static ssize_t sr_adjust_vsel_store(struct kobject *kobj,
 	unsigned short value;
 	u8 num_mpu_opps;
 	u8 num_l3_opps;
+	unsigned int opp_no;
+	int vsel;
+	char vdd[4];
 	int i;
 
+	/* "mpu|l3 <opp> <calib v>" restores a calibration saved earlier */
+	if (sscanf(buf, "%3s %u %i", vdd, &opp_no, &vsel) == 3) {
+		if (vsel <= 0 || vsel > 0xff)
+			i = -EINVAL;
+		else if (!strcmp(vdd, "mpu") &&
+			 opp_no <= omap_pm_get_max_vdd1_opp())
+			i = sr_class1p5_restore(SR1, opp_no, vsel);
+		else if (!strcmp(vdd, "l3") &&
+			 opp_no <= omap_pm_get_max_vdd2_opp())
+			i = sr_class1p5_restore(SR2, opp_no, vsel);
+		else
+			i = -EINVAL;
+		if (i) {
+			pr_err("%s: Invalid value %s", __func__, buf);
+			return -EINVAL;
+		}
+		return n;
+	}
+
 	if ((sscanf(buf, "%hu", &value) > 1) || value) {
 		pr_err("%s: Invalid value %d\n", __func__, value);
 		return -EINVAL;
@@ -1939,15 +1970,11 @@ static ssize_t sr_adjust_vsel_store(struct kobject *kobj,
 	num_l3_opps = omap_pm_get_max_vdd2_opp();
 	/* reset the calibrated voltages which are enabled */
 	for (i = 1; i <= num_mpu_opps; i++)
-		if (mpu_opps[i].rate) {
-			mpu_opps[i].sr_adjust_vsel = 0;
-			mpu_opps[i].sr_vsr_step_vsel = 0;
-		}
+		if (mpu_opps[i].rate)
+			sr_class1p5_forget(SR1, i);
 	for (i = 1; i <= num_l3_opps; i++)
-		if (l3_opps[i].rate) {
-			l3_opps[i].sr_adjust_vsel = 0;
-			l3_opps[i].sr_vsr_step_vsel = 0;
-		}
+		if (l3_opps[i].rate)
+			sr_class1p5_forget(SR2, i);
 	return n;
 }
 
@@ -19,6 +19,9 @@
 #include <linux/pm_qos_params.h>
 #include <linux/cpufreq.h>
 #include <linux/delay.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
 #include <mach/powerdomain.h>
 #include <mach/clockdomain.h>
 #include <mach/control.h>
@@ -143,7 +146,8 @@ static struct shared_resource *vdd1_resp;
 static struct shared_resource *vdd2_resp;
 static struct device dummy_mpu_dev;
 static struct device dummy_dsp_dev;
-static struct device vdd2_dev;
+/* VDD1's request on vdd2_opp, a floor for VDD1_THRESHOLD and above */
+struct device vdd2_floor_dev;
 static int vdd1_lock;
 static int vdd2_lock;
 static struct clk *dpll1_clk, *dpll2_clk, *dpll3_clk;
@@ -151,6 +155,249 @@ static int curr_vdd1_opp;
 static int curr_vdd2_opp;
 static DEFINE_MUTEX(dvfs_mutex);
 
+/*
+ * OPP transition statistics.
+ *
+ * Every VDD1/VDD2 transition is timed with sched_clock() (the 32kHz sync
+ * counter, so ~31us resolution) and split into phases, which are then
+ * accumulated per from-OPP/to-OPP pair and exported through debugfs.
+ * The DPLL3 changes made by set_dpll3_volt_freq() are kept apart from the
+ * VDD2 OPP transitions, under OPP_STATS_DPLL3.
+ */
+#define OPP_STATS_DPLL3		(VDD2_OPP + 1)
+
+enum {
+	OPP_PHASE_TOTAL = 0,
+	OPP_PHASE_SR_DISABLE,
+	OPP_PHASE_FREQ,
+	OPP_PHASE_VOLT,
+	OPP_PHASE_SR_ENABLE,
+	OPP_PHASE_MAX,
+};
+
+struct opp_trans_sample {
+	unsigned int valid;	/* bitmask of phases that were timed */
+	u32 phase_us[OPP_PHASE_MAX];
+};
+
+static inline u32 opp_stats_since(unsigned long long t0)
+{
+	u64 us = div_u64(sched_clock() - t0, NSEC_PER_USEC);
+
+	return min_t(u64, us, ~0U);
+}
+
+static inline void opp_sample_set(struct opp_trans_sample *s, int phase,
+		unsigned long long t0)
+{
+	s->phase_us[phase] = opp_stats_since(t0);
+	s->valid |= 1 << phase;
+}
+
+#ifdef CONFIG_DEBUG_FS
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+/* Bucket 0 is < 32us, bucket n is [16us << n, 32us << n) */
+#define OPP_HIST_BUCKETS	11
+#define OPP_STATS_NR_OPPS	(VDD1_OPP6 + 1)
+
+struct opp_phase_stat {
+	u32 count;
+	u32 min_us;
+	u32 max_us;
+	u64 total_us;
+	u32 hist[OPP_HIST_BUCKETS];
+};
+
+struct opp_trans_stat {
+	struct opp_phase_stat phase[OPP_PHASE_MAX];
+};
+
+struct vdd_opp_stats {
+	struct opp_trans_stat trans[OPP_STATS_NR_OPPS][OPP_STATS_NR_OPPS];
+	u32 denied;	/* refused because vdd1_lock/vdd2_lock was held */
+	u32 aborted;	/* programming failed, OPP left unchanged */
+};
+
+static struct vdd_opp_stats vdd1_opp_stats;
+static struct vdd_opp_stats vdd2_opp_stats;
+static struct vdd_opp_stats dpll3_opp_stats;
+static DEFINE_SPINLOCK(opp_stats_lock);
+
+static const char *opp_phase_names[OPP_PHASE_MAX] = {
+	[OPP_PHASE_TOTAL]	= "total",
+	[OPP_PHASE_SR_DISABLE]	= "sr_disable",
+	[OPP_PHASE_FREQ]	= "freq",
+	[OPP_PHASE_VOLT]	= "volt",
+	[OPP_PHASE_SR_ENABLE]	= "sr_enable",
+};
+
+static inline struct vdd_opp_stats *opp_stats_get(int res)
+{
+	if (res == VDD1_OPP)
+		return &vdd1_opp_stats;
+	else if (res == VDD2_OPP)
+		return &vdd2_opp_stats;
+	else if (res == OPP_STATS_DPLL3)
+		return &dpll3_opp_stats;
+	return NULL;
+}
+
+static int opp_stats_bucket(u32 us)
+{
+	int b = 0;
+
+	us >>= 5;
+	while (us && b < OPP_HIST_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+static void opp_stats_record(int res, int from, int to,
+		struct opp_trans_sample *s)
+{
+	struct vdd_opp_stats *vs = opp_stats_get(res);
+	struct opp_trans_stat *ts;
+	unsigned long flags;
+	int i;
+
+	if (!vs || from <= 0 || from >= OPP_STATS_NR_OPPS ||
+			to <= 0 || to >= OPP_STATS_NR_OPPS)
+		return;
+
+	spin_lock_irqsave(&opp_stats_lock, flags);
+	ts = &vs->trans[from][to];
+	for (i = 0; i < OPP_PHASE_MAX; i++) {
+		struct opp_phase_stat *ps = &ts->phase[i];
+		u32 us = s->phase_us[i];
+
+		if (!(s->valid & (1 << i)))
+			continue;
+		if (!ps->count || us < ps->min_us)
+			ps->min_us = us;
+		if (us > ps->max_us)
+			ps->max_us = us;
+		ps->count++;
+		ps->total_us += us;
+		ps->hist[opp_stats_bucket(us)]++;
+	}
+	spin_unlock_irqrestore(&opp_stats_lock, flags);
+}
+
+static void opp_stats_inc(int res, int denied)
+{
+	struct vdd_opp_stats *vs = opp_stats_get(res);
+	unsigned long flags;
+
+	if (!vs)
+		return;
+
+	spin_lock_irqsave(&opp_stats_lock, flags);
+	if (denied)
+		vs->denied++;
+	else
+		vs->aborted++;
+	spin_unlock_irqrestore(&opp_stats_lock, flags);
+}
+
+static int opp_stats_show(struct seq_file *s, void *unused)
+{
+	struct vdd_opp_stats *vs = s->private;
+	int from, to, i, b;
+
+	spin_lock_irq(&opp_stats_lock);
+	seq_printf(s, "denied: %u\naborted: %u\n", vs->denied, vs->aborted);
+
+	for (from = 1; from < OPP_STATS_NR_OPPS; from++) {
+		for (to = 1; to < OPP_STATS_NR_OPPS; to++) {
+			struct opp_trans_stat *ts = &vs->trans[from][to];
+
+			if (!ts->phase[OPP_PHASE_TOTAL].count)
+				continue;
+
+			seq_printf(s, "\nOPP%d->OPP%d: %u transitions\n", from, to,
+				ts->phase[OPP_PHASE_TOTAL].count);
+			seq_printf(s, "%-10s %7s %7s %7s ", "phase(us)", "min",
+				"avg", "max");
+			for (b = 0; b < OPP_HIST_BUCKETS - 1; b++)
+				seq_printf(s, " <%-5u", 32 << b);
+			seq_printf(s, " >=%u\n", 16 << b);
+
+			for (i = 0; i < OPP_PHASE_MAX; i++) {
+				struct opp_phase_stat *ps = &ts->phase[i];
+				u64 avg = ps->total_us;
+
+				if (!ps->count)
+					continue;
+				do_div(avg, ps->count);
+				seq_printf(s, "%-10s %7u %7llu %7u ",
+					opp_phase_names[i], ps->min_us, avg,
+					ps->max_us);
+				for (b = 0; b < OPP_HIST_BUCKETS; b++)
+					seq_printf(s, " %-6u", ps->hist[b]);
+				seq_printf(s, "\n");
+			}
+		}
+	}
+	spin_unlock_irq(&opp_stats_lock);
+
+	return 0;
+}
+
+static int opp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, opp_stats_show, inode->i_private);
+}
+
+static const struct file_operations opp_stats_fops = {
+	.open           = opp_stats_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static int opp_stats_reset_set(void *data, u64 val)
+{
+	spin_lock_irq(&opp_stats_lock);
+	memset(&vdd1_opp_stats, 0, sizeof(vdd1_opp_stats));
+	memset(&vdd2_opp_stats, 0, sizeof(vdd2_opp_stats));
+	memset(&dpll3_opp_stats, 0, sizeof(dpll3_opp_stats));
+	spin_unlock_irq(&opp_stats_lock);
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(opp_stats_reset_fops, NULL, opp_stats_reset_set,
+			"%llu\n");
+
+static int __init opp_stats_init(void)
+{
+	struct dentry *d;
+
+	d = debugfs_create_dir("opp_stats", NULL);
+	if (IS_ERR(d))
+		return PTR_ERR(d);
+
+	(void) debugfs_create_file("vdd1", S_IRUGO, d,
+		&vdd1_opp_stats, &opp_stats_fops);
+	(void) debugfs_create_file("vdd2", S_IRUGO, d,
+		&vdd2_opp_stats, &opp_stats_fops);
+	(void) debugfs_create_file("dpll3", S_IRUGO, d,
+		&dpll3_opp_stats, &opp_stats_fops);
+	(void) debugfs_create_file("reset", S_IWUSR, d,
+		NULL, &opp_stats_reset_fops);
+
+	return 0;
+}
+late_initcall(opp_stats_init);
+#else
+static inline void opp_stats_record(int res, int from, int to,
+		struct opp_trans_sample *s) {}
+static inline void opp_stats_inc(int res, int denied) {}
+#endif
+
 unsigned short get_opp_id(struct omap_opp *opp_freq_table,
 		unsigned long freq)
 {
@@ -305,10 +552,11 @@ u8 sr_class1p5;
 #endif
 
 static int program_opp(int res, struct omap_opp *opp, int target_level,
-		int current_level)
+		int current_level, struct opp_trans_sample *sample)
 {
 	int i, ret = 0, raise;
 	unsigned long t_opp, c_opp;
+	unsigned long long t0;
 	u8 target_v, current_v;
 
 	t_opp = ID_VDD(res) | ID_OPP_NO(opp[target_level].opp_id);
@@ -325,8 +573,12 @@ static int program_opp(int res, struct omap_opp *opp, int target_level,
 	target_v = opp[target_level].vsel;
 	current_v = opp[current_level].vsel;
 	if (!sr_class1p5) {
+		t0 = sched_clock();
 		disable_smartreflex(res);
+		opp_sample_set(sample, OPP_PHASE_SR_DISABLE, t0);
 	} else {
+		/* drop the target's calibration if it went stale */
+		sr_class1p5_check(res, target_level);
 		/* if use class 1.5, decide on which voltage to use */
 		target_v = (opp[target_level].sr_adjust_vsel) ?
 			opp[target_level].sr_vsr_step_vsel : target_v;
@@ -335,19 +587,26 @@ static int program_opp(int res, struct omap_opp *opp, int target_level,
 	}
 
 	for (i = 0; i < 2; i++) {
-		if (i == raise)
+		t0 = sched_clock();
+		if (i == raise) {
 			ret = program_opp_freq(res, target_level,
 					current_level);
-		else {
+			opp_sample_set(sample, OPP_PHASE_FREQ, t0);
+		} else {
 			omap_scale_voltage(t_opp, c_opp,
 				target_v, current_v);
+			opp_sample_set(sample, OPP_PHASE_VOLT, t0);
 		}
 	}
 
-	if (!sr_class1p5)
+	t0 = sched_clock();
+	if (!sr_class1p5) {
 		enable_smartreflex(res);
-	else if (!opp[target_level].sr_adjust_vsel)
+		opp_sample_set(sample, OPP_PHASE_SR_ENABLE, t0);
+	} else if (!opp[target_level].sr_adjust_vsel) {
 		sr_recalibrate(res, t_opp, c_opp);
+		opp_sample_set(sample, OPP_PHASE_SR_ENABLE, t0);
+	}
 
 	return ret;
 }
@@ -359,6 +618,9 @@ int resource_set_opp_level(int res, u32 target_level, int flags)
 	struct cpufreq_freqs freqs_notify;
 #endif
 	struct shared_resource *resp;
+	struct opp_trans_sample sample = { .valid = 0 };
+	unsigned long long t0;
+	int from_level;
 
 	if (res == VDD1_OPP)
 		resp = vdd1_resp;
@@ -375,11 +637,14 @@ int resource_set_opp_level(int res, u32 target_level, int flags)
 
 	mutex_lock(&dvfs_mutex);
 
+	from_level = resp->curr_level;
 	if (res == VDD1_OPP) {
 		if (flags != OPP_IGNORE_LOCK && vdd1_lock) {
+			opp_stats_inc(res, 1);
 			mutex_unlock(&dvfs_mutex);
 			return 0;
 		}
+		t0 = sched_clock();
 		mpu_old_freq = mpu_opps[resp->curr_level].rate;
 		mpu_freq = mpu_opps[target_level].rate;
 
@@ -391,19 +656,27 @@ int resource_set_opp_level(int res, u32 target_level, int flags)
 		cpufreq_notify_transition(&freqs_notify, CPUFREQ_PRECHANGE);
 #endif
 		resp->curr_level = program_opp(res, mpu_opps, target_level,
-			resp->curr_level);
+			resp->curr_level, &sample);
 #ifdef CONFIG_CPU_FREQ
 		/* Send a post notification to CPUFreq */
 		cpufreq_notify_transition(&freqs_notify, CPUFREQ_POSTCHANGE);
 #endif
 	} else {
 		if (!(flags & OPP_IGNORE_LOCK) && vdd2_lock) {
+			opp_stats_inc(res, 1);
 			mutex_unlock(&dvfs_mutex);
 			return 0;
 		}
+		t0 = sched_clock();
 		resp->curr_level = program_opp(res, l3_opps, target_level,
-			resp->curr_level);
+			resp->curr_level, &sample);
 	}
+	opp_sample_set(&sample, OPP_PHASE_TOTAL, t0);
+
+	if (resp->curr_level == target_level)
+		opp_stats_record(res, from_level, target_level, &sample);
+	else
+		opp_stats_inc(res, 0);
 	mutex_unlock(&dvfs_mutex);
 	return 0;
 }
@@ -416,7 +689,7 @@ int set_opp(struct shared_resource *resp, u32 target_level)
 
 	if (resp == vdd1_resp) {
 		if (target_level < VDD1_THRESHOLD)
-			resource_release("vdd2_opp", &vdd2_dev);
+			resource_release("vdd2_opp", &vdd2_floor_dev);
 
 		resource_set_opp_level(VDD1_OPP, target_level, 0);
 		/*
@@ -425,7 +698,7 @@ int set_opp(struct shared_resource *resp, u32 target_level)
 		 * throughput in KiB/s for 200 Mhz = 200 * 1000 * 4.
 		 */
 		if (target_level >= VDD1_THRESHOLD)
-			resource_request("vdd2_opp", &vdd2_dev,
+			resource_request("vdd2_opp", &vdd2_floor_dev,
 				4 * l3_opps[omap_pm_get_max_vdd2_opp()].rate/1000);
 
 	} else if (resp == vdd2_resp) {
@@ -524,6 +797,11 @@ int set_dpll3_volt_freq(bool dpll3_restore)
 	int ret = 0, l3_div;
 	u8 min_opp = 0, max_opp = 0, t_vsel = 0, c_vsel = 0;
 	unsigned long t_opp, c_opp;
+	struct opp_trans_sample sample = { .valid = 0 };
+	unsigned long long t_start, t0;
+	int from_level = resp->curr_level;
+
+	t_start = sched_clock();
 
 	if (cpu_is_omap3430()) {
 		min_opp = omap_pm_get_min_vdd2_opp();
@@ -563,11 +841,14 @@ int set_dpll3_volt_freq(bool dpll3_restore)
 
 	if (resp->curr_level == min_opp) {
 		/* change the voltage only */
+		t0 = sched_clock();
 		omap_scale_voltage(t_opp, c_opp,
 					t_vsel, c_vsel);
+		opp_sample_set(&sample, OPP_PHASE_VOLT, t0);
 
 	} else {
 		/* step1: change the freq */
+		t0 = sched_clock();
 		lock_scratchpad_sem();
 		l3_div = cm_read_mod_reg(CORE_MOD, CM_CLKSEL) &
 			OMAP3430_CLKSEL_L3_MASK;
@@ -587,13 +868,24 @@ int set_dpll3_volt_freq(bool dpll3_restore)
 		omap3_save_scratchpad_contents();
 #endif
 		unlock_scratchpad_sem();
+		opp_sample_set(&sample, OPP_PHASE_FREQ, t0);
 
 		/* step 2: change the volt to 1.2v for 3430 and retain the same for 3630 */
-		if (cpu_is_omap3430())
+		if (cpu_is_omap3430()) {
 			/* change the voltage to recommended value */
+			t0 = sched_clock();
 			omap_scale_voltage(t_opp, c_opp,
 						t_vsel, c_vsel);
+			opp_sample_set(&sample, OPP_PHASE_VOLT, t0);
+		}
 	}
+	opp_sample_set(&sample, OPP_PHASE_TOTAL, t_start);
+
+	if (ret)
+		opp_stats_inc(OPP_STATS_DPLL3, 0);
+	else
+		opp_stats_record(OPP_STATS_DPLL3, from_level, resp->curr_level,
+				&sample);
 
 	return ret;
 }
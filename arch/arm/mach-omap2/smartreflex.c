@@ -26,6 +26,9 @@
 #include <linux/kobject.h>
 #include <linux/i2c/twl4030.h>
 #include <linux/io.h>
+#include <linux/jiffies.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <mach/omap34xx.h>
 #include <mach/control.h>
@@ -106,6 +109,39 @@ extern u8 sr_class1p5;
 
 static omap3_voltagescale_vcbypass_t omap3_volscale_vcbypass_fun;
 
+/*
+ * Class 1.5 keeps the voltage each OPP converged to in sr_adjust_vsel and
+ * uses it for every later switch to that OPP. A calibration is dropped once
+ * it is older than learn_max_age seconds or the temperature has moved more
+ * than learn_temp_delta degrees C since it was made, so the next switch to
+ * that OPP recalibrates. A calibration dropped this way or reset through
+ * sysfs is forgotten entirely, see sr_class1p5_forget(): SR only runs to
+ * recalibrate an OPP without one, and it then always starts the voltage
+ * processor from the nominal voltage with the full settle time, as a stale
+ * converged voltage without margin is no safe place to start from.
+ */
+#define SR_LEARN_OPPS		8
+#define SR_TEMP_UNKNOWN		INT_MIN
+/* a restored calibration may be at most this many percent below nominal */
+#define SR_RESTORE_MAX_DROP	10
+
+struct sr_learn {
+	unsigned long	learned_at;	/* jiffies */
+	int		temp;		/* deg C when learned */
+	u32		calibrations;
+	u32		reuses;
+	u32		aged;
+	u32		heated;
+};
+
+static struct sr_learn sr_learn[2][SR_LEARN_OPPS];
+static int sr_temp = SR_TEMP_UNKNOWN;
+
+static unsigned int learn_max_age = 3600;
+module_param(learn_max_age, uint, S_IRUGO | S_IWUSR);
+static unsigned int learn_temp_delta = 10;
+module_param(learn_temp_delta, uint, S_IRUGO | S_IWUSR);
+
 static inline void sr_write_reg(struct omap_sr *sr, unsigned offset, u32 value)
 {
 	__raw_writel(value, SR_REGADDR(offset));
@@ -869,6 +905,134 @@ u8 omap_twl_uv_to_vsel(unsigned long uv)
 	return (((uv + 99) / 100 - 6000) + 124) / 125;
 }
 
+static struct sr_learn *sr_learn_get(int srid, u32 opp_no)
+{
+	if (srid != SR1 && srid != SR2)
+		return NULL;
+	if (opp_no >= SR_LEARN_OPPS)
+		return NULL;
+	return &sr_learn[srid - 1][opp_no];
+}
+
+static void sr_learn_set(int srid, u32 opp_no, u8 vsel)
+{
+	struct sr_learn *l = sr_learn_get(srid, opp_no);
+	unsigned long v_step;
+
+	if (srid == SR1) {
+		mpu_opps[opp_no].sr_adjust_vsel = vsel;
+		v_step = omap_twl_vsel_to_uv(vsel);
+		v_step += sr1_opp_margin[opp_no];
+		mpu_opps[opp_no].sr_vsr_step_vsel = omap_twl_uv_to_vsel(v_step);
+	} else {
+		l3_opps[opp_no].sr_adjust_vsel = vsel;
+		l3_opps[opp_no].sr_vsr_step_vsel = vsel;
+	}
+	if (l) {
+		l->learned_at = jiffies;
+		l->temp = sr_temp;
+	}
+}
+
+/**
+ * sr_class1p5_forget - drop the class 1.5 calibration of an OPP
+ * @srid: SR1 or SR2
+ * @opp_no: OPP whose calibration goes
+ *
+ * The next switch to @opp_no uses the nominal voltage and recalibrates.
+ */
+void sr_class1p5_forget(int srid, u32 opp_no)
+{
+	struct omap_opp *opp = (srid == SR1) ? mpu_opps : l3_opps;
+
+	opp[opp_no].sr_adjust_vsel = 0;
+	opp[opp_no].sr_vsr_step_vsel = 0;
+}
+
+/**
+ * sr_class1p5_check - drop a stale class 1.5 calibration
+ * @srid: SR1 or SR2
+ * @opp_no: OPP about to be switched to
+ *
+ * Called before switching to @opp_no. If its calibration has aged out or
+ * was made at a different temperature, sr_adjust_vsel is cleared so that
+ * the switch uses the nominal voltage and recalibrates.
+ */
+void sr_class1p5_check(int srid, u32 opp_no)
+{
+	struct sr_learn *l = sr_learn_get(srid, opp_no);
+	struct omap_opp *opp = (srid == SR1) ? mpu_opps : l3_opps;
+	int temp = sr_temp;
+
+	if (!l || !opp || !opp[opp_no].sr_adjust_vsel)
+		return;
+
+	/* learned before the first temperature reading: adopt it */
+	if (l->temp == SR_TEMP_UNKNOWN)
+		l->temp = temp;
+
+	if (learn_max_age &&
+	    time_after(jiffies, l->learned_at + learn_max_age * HZ)) {
+		l->aged++;
+	} else if (learn_temp_delta && temp != SR_TEMP_UNKNOWN &&
+		   abs(temp - l->temp) > learn_temp_delta) {
+		l->heated++;
+	} else {
+		l->reuses++;
+		return;
+	}
+	pr_debug("SR%d OPP%d: dropping calibration 0x%02x\n", srid, opp_no,
+		 opp[opp_no].sr_adjust_vsel);
+	sr_class1p5_forget(srid, opp_no);
+}
+
+/* lowest calibration an OPP may be given: what the VP is limited to, and
+ * no more than SR_RESTORE_MAX_DROP percent below the nominal voltage
+ */
+static u8 sr_vsel_floor(int srid, u8 nominal)
+{
+	u8 vddmin = (srid == SR1) ? PRM_VP1_VLIMITTO_VDDMIN >> 16 :
+				    PRM_VP2_VLIMITTO_VDDMIN >> 16;
+	unsigned long uv = omap_twl_vsel_to_uv(nominal);
+
+	uv -= uv * SR_RESTORE_MAX_DROP / 100;
+	return max_t(u8, vddmin, omap_twl_uv_to_vsel(uv));
+}
+
+/**
+ * sr_class1p5_restore - reinstate a saved class 1.5 calibration
+ * @srid: SR1 or SR2
+ * @opp_no: OPP the calibration belongs to
+ * @vsel: converged voltage, as shown in /sys/power/sr_adjust_vsel
+ *
+ * Lets a calibration saved from a previous boot be used right away. It
+ * ages and is dropped on temperature changes like a fresh one. The voltage
+ * must lie between the OPP's floor, see sr_vsel_floor(), and its nominal
+ * voltage.
+ */
+int sr_class1p5_restore(int srid, u32 opp_no, u8 vsel)
+{
+	struct omap_opp *opp = (srid == SR1) ? mpu_opps : l3_opps;
+
+	if (!sr_learn_get(srid, opp_no) || !opp || !opp[opp_no].rate)
+		return -EINVAL;
+	if (vsel < sr_vsel_floor(srid, opp[opp_no].vsel) ||
+	    vsel > opp[opp_no].vsel)
+		return -EINVAL;
+	sr_learn_set(srid, opp_no, vsel);
+	return 0;
+}
+
+/**
+ * sr_class1p5_temp_update - report the current temperature
+ * @temp_c: temperature in degrees C
+ */
+void sr_class1p5_temp_update(int temp_c)
+{
+	sr_temp = temp_c;
+}
+EXPORT_SYMBOL(sr_class1p5_temp_update);
+
 #define SR_CLASS1P5_LOOP_US	100
 #define MAX_STABILIZATION_COUNT 100
 #define MAX_LOOP_COUNT		(MAX_STABILIZATION_COUNT * 20)
@@ -877,10 +1041,9 @@ int sr_recalibrate(int srid, u32 t_opp, u32 c_opp)
 	u32 max_loop_count = MAX_LOOP_COUNT;
 	u32 exit_loop_on = 0;
 	u32 target_opp_no;
-	unsigned long v_step;
 	u8 new_v = 0;
 	u8 high_v = 0;
-	u8 vsel_step = 0;
+	struct sr_learn *l;
 	struct omap_sr *sr;
 
 	if (srid == SR1)
@@ -937,16 +1100,10 @@ int sr_recalibrate(int srid, u32 t_opp, u32 c_opp)
 	/* Stop Smart reflex */
 	disable_smartreflex(srid);
 
-	if (srid == SR1) {
-		mpu_opps[target_opp_no].sr_adjust_vsel = high_v;
-		v_step = omap_twl_vsel_to_uv(high_v);
-		v_step += sr1_opp_margin[target_opp_no];
-		vsel_step = omap_twl_uv_to_vsel(v_step);
-		mpu_opps[target_opp_no].sr_vsr_step_vsel = vsel_step;
-	} else if (srid == SR2) {
-		l3_opps[target_opp_no].sr_adjust_vsel = high_v;
-		l3_opps[target_opp_no].sr_vsr_step_vsel = high_v;
-	}
+	sr_learn_set(srid, target_opp_no, high_v);
+	l = sr_learn_get(srid, target_opp_no);
+	if (l)
+		l->calibrations++;
 
 	pr_debug("Calibrate:Exit %s [vdd%d: opp%d] %02x loops=[%d,%d]\n",
 		__func__, srid, target_opp_no, high_v,
@@ -1642,6 +1799,53 @@ static irqreturn_t sr_omap_irq(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
+static int sr_learn_show(struct seq_file *s, void *unused)
+{
+	int srid, opp_no, max_opp;
+	struct omap_opp *opp;
+	struct sr_learn *l;
+
+	if (sr_temp == SR_TEMP_UNKNOWN)
+		seq_printf(s, "temperature unknown\n");
+	else
+		seq_printf(s, "temperature %d C\n", sr_temp);
+	for (srid = SR1; srid <= SR2; srid++) {
+		opp = (srid == SR1) ? mpu_opps : l3_opps;
+		max_opp = (srid == SR1) ? omap_pm_get_max_vdd1_opp() :
+			omap_pm_get_max_vdd2_opp();
+		for (opp_no = 1; opp_no <= max_opp; opp_no++) {
+			l = sr_learn_get(srid, opp_no);
+			if (!l || !opp[opp_no].rate)
+				continue;
+			seq_printf(s, "vdd%d opp%d: nominal 0x%02x calib 0x%02x",
+				   srid, opp_no, opp[opp_no].vsel,
+				   opp[opp_no].sr_adjust_vsel);
+			if (opp[opp_no].sr_adjust_vsel)
+				seq_printf(s, " age %u s temp %d C",
+					   jiffies_to_msecs(jiffies -
+							    l->learned_at) / 1000,
+					   l->temp == SR_TEMP_UNKNOWN ? 0 :
+					   l->temp);
+			seq_printf(s, " calibrations %u reuses %u aged %u "
+				   "heated %u\n", l->calibrations, l->reuses,
+				   l->aged, l->heated);
+		}
+	}
+	return 0;
+}
+
+static int sr_learn_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sr_learn_show, NULL);
+}
+
+static const struct file_operations sr_learn_fops = {
+	.open		= sr_learn_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init omap3_sr_init(void)
 {
 	int ret = 0;
@@ -1732,6 +1936,10 @@ static int __init omap3_sr_init(void)
 	if (ret)
 		pr_err("sysfs_create_file failed: %d\n", ret);
 
+	if (sr_class1p5)
+		debugfs_create_file("sr_learn", S_IRUGO, NULL, NULL,
+				    &sr_learn_fops);
+
 	/* Enable SR only for 3430 for now */
 	if (!cpu_is_omap3630()) {
 		if (sr1.opp3_nvalue) {
@@ -267,6 +267,9 @@ typedef int (*omap3_voltagescale_vcbypass_t)(u32 t_opp, u32 c_opp,
 						u8 t_vsel, u8 c_vsel);
 void omap3_voltagescale_vcbypass_setup(omap3_voltagescale_vcbypass_t fun);
 int sr_recalibrate(int srid, u32 target_opp, u32 current_opp);
+void sr_class1p5_forget(int srid, u32 opp_no);
+void sr_class1p5_check(int srid, u32 opp_no);
+int sr_class1p5_restore(int srid, u32 opp_no, u8 vsel);
 
 #else
 static inline void enable_smartreflex(int srid) {}
@@ -275,6 +278,12 @@ int sr_recalibrate(int srid, u32 target_opp, u32 current_opp)
 {
 	return -EINVAL;
 }
+static inline void sr_class1p5_forget(int srid, u32 opp_no) {}
+static inline void sr_class1p5_check(int srid, u32 opp_no) {}
+static inline int sr_class1p5_restore(int srid, u32 opp_no, u8 vsel)
+{
+	return -EINVAL;
+}
 #define omap3_voltagescale_vcbypass_setup(fun) do {} while (0);
 #endif
 
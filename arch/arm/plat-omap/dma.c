@@ -1685,7 +1685,14 @@ int omap_start_dma_chain_transfers(int chain_id)
 			omap_enable_channel_irq(channels[i]);
 		}
 	} else {
-		omap_enable_channel_irq(channels[0]);
+		/*
+		 * The channels queued behind the first one need their
+		 * interrupts enabled too, they are lost with the channel
+		 * context in off mode.
+		 */
+		for (i = 0; i < dma_linked_lch[chain_id].no_of_lchs_linked;
+									i++)
+			omap_enable_channel_irq(channels[i]);
 	}
 
 	l = dma_read(CCR(channels[0]));
@@ -39,6 +39,34 @@ extern struct omap_opp *mpu_opps;
 extern struct omap_opp *dsp_opps;
 extern struct omap_opp *l3_opps;
 
+/*
+ * Temperature, in degrees C, for SmartReflex class 1.5: calibrations made
+ * at a different temperature are redone.
+ */
+#ifdef CONFIG_OMAP_SMARTREFLEX
+void sr_class1p5_temp_update(int temp_c);
+#else
+static inline void sr_class1p5_temp_update(int temp_c) {}
+#endif
+
+/*
+ * Battery watched by the MPU power budget: get_current reads the average
+ * battery current in mA, negative while discharging, and get_temp the
+ * battery temperature in degrees C. Both return 0, or a negative error
+ * if the value could not be read.
+ */
+struct omap_pm_battery {
+	int (*get_current)(void *data, int *ma);
+	int (*get_temp)(void *data, int *temp_c);
+	void *data;
+};
+
+#ifdef CONFIG_OMAP3_MPU_BUDGET
+void omap_pm_register_battery(struct omap_pm_battery *bat);
+#else
+static inline void omap_pm_register_battery(struct omap_pm_battery *bat) {}
+#endif
+
 extern unsigned short get_opp_id(struct omap_opp *opp_freq_table,
 				unsigned long freq);
 /*
@@ -87,5 +87,6 @@ int resource_request(const char *name, struct device *dev,
 						 unsigned long level);
 int resource_release(const char *name, struct device *dev);
 int resource_get_level(const char *name);
+long resource_sum_levels(const char *name, struct device **exclude);
 
 #endif /* __ARCH_ARM_OMAP_RESOURCE_H */
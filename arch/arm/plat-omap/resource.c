@@ -481,3 +481,37 @@ int resource_get_level(const char *name)
 	return ret;
 }
 EXPORT_SYMBOL(resource_get_level);
+
+/**
+ * resource_sum_levels - Returns the sum of the levels requested by all users
+ * @name: Name of the resource
+ * @exclude: NULL terminated list of users to leave out of the sum, or NULL
+ *
+ * For a performance resource whose levels are throughputs, this is the total
+ * demand of its users, of which the resource itself only honours the largest.
+ * Returns -EINVAL if the resource name is invalid.
+ */
+long resource_sum_levels(const char *name, struct device **exclude)
+{
+	struct shared_resource *resp;
+	struct users_list *user;
+	struct device **ex;
+	long sum = 0;
+
+	resp = resource_lookup(name);
+	if (!resp) {
+		printk(KERN_ERR "resource_sum_levels: Invalid resource name\n");
+		return -EINVAL;
+	}
+	mutex_lock(&resp->resource_mutex);
+	list_for_each_entry(user, &resp->users_list, node) {
+		for (ex = exclude; ex && *ex; ex++)
+			if (user->dev == *ex)
+				break;
+		if (!ex || !*ex)
+			sum += user->level;
+	}
+	mutex_unlock(&resp->resource_mutex);
+	return sum;
+}
+EXPORT_SYMBOL(resource_sum_levels);
@@ -302,6 +302,22 @@ void blk_queue_hardsect_size(struct request_queue *q, unsigned short size)
 }
 EXPORT_SYMBOL(blk_queue_hardsect_size);
 
+/**
+ * blk_queue_erase_sectors - set the erase unit of flash based devices
+ * @q:  the request queue for the device
+ * @sectors:  the erase unit, in 512 byte sectors, 0 if unknown
+ *
+ * Description:
+ *   Flash devices rewrite a whole erase unit internally for writes that
+ *   only cover part of one. Flash aware I/O schedulers use this to keep
+ *   write requests from straddling erase units.
+ **/
+void blk_queue_erase_sectors(struct request_queue *q, unsigned int sectors)
+{
+	q->erase_sectors = sectors;
+}
+EXPORT_SYMBOL(blk_queue_erase_sectors);
+
 /*
  * Returns the minimum that is _not_ zero, unless both are zero.
  */
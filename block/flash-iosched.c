@@ -0,0 +1,503 @@
+/*
+ *  Flash i/o scheduler, for eMMC and SD cards.
+ *
+ *  Based on the deadline i/o scheduler,
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+/*
+ * See Documentation/block/flash-iosched.txt
+ */
+static const int write_expire = 5 * HZ; /* max time before a write is submitted */
+static const int writes_starved = 16;   /* max reads dispatched while writes wait */
+static const int write_batch = 1024;	/* max KiB of writes while reads wait */
+static const int default_erase = 1024;	/* erase unit if unknown, in sectors */
+
+struct flash_data {
+	struct request_queue *q;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * the write batch: next write in sort order, the erase unit it is
+	 * in and how much it has written so far
+	 */
+	struct request *next_write;
+	sector_t batch_unit;
+	unsigned int batch_sectors;
+	unsigned int starved;		/* reads dispatched while writes wait */
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int write_expire;
+	int writes_starved;
+	int write_batch;
+	int erase_kb;
+	int align_merges;
+	int front_merges;
+};
+
+static void flash_move_request(struct flash_data *, struct request *);
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+/*
+ * the erase unit size in sectors: the tunable if set, what the driver
+ * reported otherwise
+ */
+static unsigned int flash_erase_sectors(struct flash_data *fd)
+{
+	if (fd->erase_kb)
+		return fd->erase_kb * 2;
+	if (fd->q->erase_sectors)
+		return fd->q->erase_sectors;
+	return default_erase;
+}
+
+static inline sector_t flash_unit(struct flash_data *fd, sector_t sector)
+{
+	sector_div(sector, flash_erase_sectors(fd));
+	return sector;
+}
+
+static void
+flash_add_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	struct rb_root *root = flash_rb_root(fd, rq);
+	struct request *__alias;
+
+	while (unlikely(__alias = elv_rb_add(root, rq)))
+		flash_move_request(fd, __alias);
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int data_dir = rq_data_dir(rq);
+
+	flash_add_rq_rb(fd, rq);
+
+	/*
+	 * reads are served in arrival order, only writes have an expire
+	 * time; a read's fifo time is when it arrived
+	 */
+	if (data_dir == WRITE)
+		rq_set_fifo_time(rq, jiffies + fd->write_expire);
+	else
+		rq_set_fifo_time(rq, jiffies);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[data_dir]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != __rq->sector);
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+/*
+ * Keep writes within one erase unit, a write straddling two makes the
+ * card rewrite both.
+ */
+static int flash_allow_merge(struct request_queue *q, struct request *rq,
+			     struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	sector_t start, end;
+
+	if (!fd->align_merges || bio_data_dir(bio) != WRITE)
+		return 1;
+
+	start = min(rq->sector, bio->bi_sector);
+	end = max(rq->sector + rq->nr_sectors,
+		  bio->bi_sector + bio_sectors(bio));
+
+	return flash_unit(fd, start) == flash_unit(fd, end - 1);
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		flash_add_rq_rb(fd, req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * if next was queued first, req takes its place in the fifo and
+	 * its fifo time
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(req))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+		}
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move an entry to dispatch queue
+ */
+static void
+flash_move_request(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/*
+ * returns 1 if the oldest write has expired. Requires
+ * !list_empty(&fd->fifo_list[WRITE])
+ */
+static inline int flash_write_expired(struct flash_data *fd)
+{
+	struct request *rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/*
+ * Pick the erase unit the next write batch programs and return its first
+ * write in sector order. That is the unit of the oldest write if it has
+ * expired, else the one with the most data queued: the fuller the unit
+ * the card gets in one go, the less it has to copy around later.
+ */
+static struct request *flash_choose_unit(struct flash_data *fd)
+{
+	struct request *rq, *best = NULL, *first = NULL;
+	unsigned int sectors = 0, best_sectors = 0;
+	struct rb_node *node;
+	sector_t unit = 0;
+
+	if (flash_write_expired(fd)) {
+		rq = rq_entry_fifo(fd->fifo_list[WRITE].next);
+		unit = flash_unit(fd, rq->sector);
+
+		while ((node = rb_prev(&rq->rb_node))) {
+			if (flash_unit(fd, rb_entry_rq(node)->sector) != unit)
+				break;
+			rq = rb_entry_rq(node);
+		}
+		return rq;
+	}
+
+	for (node = rb_first(&fd->sort_list[WRITE]); node;
+	     node = rb_next(node)) {
+		rq = rb_entry_rq(node);
+
+		if (!first || flash_unit(fd, rq->sector) != unit) {
+			first = rq;
+			unit = flash_unit(fd, rq->sector);
+			sectors = 0;
+		}
+		sectors += rq->nr_sectors;
+
+		if (!best || sectors > best_sectors) {
+			best = first;
+			best_sectors = sectors;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * flash_dispatch_requests selects the best request: reads first in arrival
+ * order, writes in batches that go through an erase unit in sector order.
+ * There is no anticipation, flash has no head to keep in place.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int reads = !list_empty(&fd->fifo_list[READ]);
+	const int writes = !list_empty(&fd->fifo_list[WRITE]);
+	struct request *rq;
+
+	/*
+	 * A running write batch finishes the erase unit it is in, unless
+	 * reads are waiting and it has written its share already.
+	 */
+	rq = fd->next_write;
+	if (rq && flash_unit(fd, rq->sector) == fd->batch_unit &&
+	    (!reads || fd->batch_sectors < fd->write_batch * 2))
+		goto dispatch_write;
+
+	fd->next_write = NULL;
+
+	if (reads) {
+		if (writes && (fd->starved++ >= fd->writes_starved ||
+			       flash_write_expired(fd)))
+			goto dispatch_writes;
+
+		rq = rq_entry_fifo(fd->fifo_list[READ].next);
+		flash_move_request(fd, rq);
+		return 1;
+	}
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&fd->sort_list[WRITE]));
+
+		fd->starved = 0;
+		rq = flash_choose_unit(fd);
+		fd->batch_unit = flash_unit(fd, rq->sector);
+		fd->batch_sectors = 0;
+		goto dispatch_write;
+	}
+
+	return 0;
+
+dispatch_write:
+	fd->batch_sectors += rq->nr_sectors;
+	fd->next_write = flash_latter_request(rq);
+	flash_move_request(fd, rq);
+
+	return 1;
+}
+
+static int flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	return list_empty(&fd->fifo_list[WRITE])
+		&& list_empty(&fd->fifo_list[READ]);
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	BUG_ON(!list_empty(&fd->fifo_list[READ]));
+	BUG_ON(!list_empty(&fd->fifo_list[WRITE]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->q = q;
+	INIT_LIST_HEAD(&fd->fifo_list[READ]);
+	INIT_LIST_HEAD(&fd->fifo_list[WRITE]);
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->write_expire = write_expire;
+	fd->writes_starved = writes_starved;
+	fd->write_batch = write_batch;
+	fd->align_merges = 1;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_write_expire_show, fd->write_expire, 1);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_write_batch_kb_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_erase_kb_show, fd->erase_kb, 0);
+SHOW_FUNCTION(flash_align_merges_show, fd->align_merges, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_write_expire_store, &fd->write_expire, 0, INT_MAX, 1);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_kb_store, &fd->write_batch, 0, INT_MAX / 2, 0);
+STORE_FUNCTION(flash_erase_kb_store, &fd->erase_kb, 0, INT_MAX / 2, 0);
+STORE_FUNCTION(flash_align_merges_store, &fd->align_merges, 0, 1, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(write_expire),
+	FD_ATTR(writes_starved),
+	FD_ATTR(write_batch_kb),
+	FD_ATTR(erase_kb),
+	FD_ATTR(align_merges),
+	FD_ATTR(front_merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_allow_merge_fn =	flash_allow_merge,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_queue_empty_fn =	flash_queue_empty,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("flash IO scheduler");
@@ -0,0 +1,722 @@
+/*
+ *  drivers/cpufreq/cpufreq_interactive.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * A latency oriented governor for interactive devices. Unlike ondemand,
+ * which needs one or more full sampling periods before it leaves the
+ * lowest OPP, this governor jumps straight to a "hispeed" frequency on the
+ * first busy sample and on user input (touchscreen, keys), then scales
+ * down again only after the frequency has been held for min_sample_time.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpu.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/ktime.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#define DEFAULT_TIMER_RATE			(20 * USEC_PER_MSEC)
+#define DEFAULT_TIMER_SLACK			(4 * DEFAULT_TIMER_RATE)
+#define DEFAULT_MIN_SAMPLE_TIME			(80 * USEC_PER_MSEC)
+#define DEFAULT_GO_HISPEED_LOAD			(85)
+#define DEFAULT_INPUT_BOOST_DURATION		(80 * USEC_PER_MSEC)
+#define MIN_TIMER_RATE				(10 * USEC_PER_MSEC)
+#define MAX_TIMER_RATE				(1000 * USEC_PER_MSEC)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+struct cpufreq_interactive_cpuinfo {
+	/*
+	 * The sampling timer is deferrable, so an idle CPU sitting at the
+	 * lowest OPP is never woken just to be told to stay there.  While
+	 * the CPU is above policy->min the slack timer (a normal timer) is
+	 * armed as well, bounding how long an idle CPU can be left at a
+	 * high OPP before the sampling timer gets a chance to run.
+	 */
+	struct timer_list cpu_timer;
+	struct timer_list cpu_slack_timer;
+	spinlock_t lock;
+	u64 prev_cpu_idle;
+	u64 prev_cpu_wall;
+	u64 floor_validate_time;
+	unsigned int target_freq;
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	int cpu;
+	unsigned int enable:1;
+};
+static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, interactive_cpuinfo);
+
+static unsigned int interactive_enable;	/* number of CPUs using this policy */
+
+/* Serializes governor start/stop and tunable updates */
+static DEFINE_MUTEX(interactive_mutex);
+
+/* CPUs whose target_freq changed and need __cpufreq_driver_target() */
+static cpumask_t speedchange_cpumask;
+static DEFINE_SPINLOCK(speedchange_cpumask_lock);
+static struct workqueue_struct *kinteractive_wq;
+static struct work_struct speedchange_work;
+
+static struct interactive_tuners {
+	unsigned int hispeed_freq;
+	unsigned int go_hispeed_load;
+	unsigned int min_sample_time;
+	unsigned int timer_rate;
+	int timer_slack;
+	unsigned int input_boost;
+	unsigned int input_boost_duration;
+} interactive_tuners_ins = {
+	.go_hispeed_load = DEFAULT_GO_HISPEED_LOAD,
+	.min_sample_time = DEFAULT_MIN_SAMPLE_TIME,
+	.timer_rate = DEFAULT_TIMER_RATE,
+	.timer_slack = DEFAULT_TIMER_SLACK,
+	.input_boost = 1,
+	.input_boost_duration = DEFAULT_INPUT_BOOST_DURATION,
+};
+
+/* ktime (in uS) until which the last input event keeps us at hispeed */
+static u64 input_boost_until;
+
+static inline u64 interactive_now(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+static inline u64 get_cpu_idle_time_jiffy(unsigned int cpu, u64 *wall)
+{
+	cputime64_t idle_time;
+	cputime64_t cur_wall_time;
+	cputime64_t busy_time;
+
+	cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
+	busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
+			kstat_cpu(cpu).cpustat.system);
+
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
+
+	idle_time = cputime64_sub(cur_wall_time, busy_time);
+	if (wall)
+		*wall = jiffies_to_usecs(cur_wall_time);
+
+	return jiffies_to_usecs(idle_time);
+}
+
+static inline u64 get_cpu_idle_time(unsigned int cpu, u64 *wall)
+{
+	u64 idle_time = get_cpu_idle_time_us(cpu, wall);
+
+	if (idle_time == -1ULL)
+		return get_cpu_idle_time_jiffy(cpu, wall);
+
+	return idle_time;
+}
+
+static void cpufreq_interactive_timer_resched(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned long expires = jiffies +
+		usecs_to_jiffies(interactive_tuners_ins.timer_rate);
+
+	mod_timer(&pcpu->cpu_timer, expires);
+
+	if (interactive_tuners_ins.timer_slack >= 0 &&
+	    pcpu->target_freq > pcpu->policy->min) {
+		expires += usecs_to_jiffies(interactive_tuners_ins.timer_slack);
+		mod_timer(&pcpu->cpu_slack_timer, expires);
+	} else {
+		del_timer(&pcpu->cpu_slack_timer);
+	}
+}
+
+static void cpufreq_interactive_queue_speedchange(int cpu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	cpu_set(cpu, speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+	queue_work(kinteractive_wq, &speedchange_work);
+}
+
+/*
+ * Pick the next target frequency from the load seen since the previous
+ * sample.  Runs in timer (softirq) context, so the actual frequency change
+ * is handed off to speedchange_work.
+ */
+static void cpufreq_interactive_timer(unsigned long data)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		&per_cpu(interactive_cpuinfo, data);
+	struct cpufreq_policy *policy;
+	u64 cur_idle, cur_wall, now;
+	unsigned int idle_time, wall_time;
+	unsigned int load, new_freq, index;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pcpu->lock, flags);
+	if (!pcpu->enable)
+		goto out_unlock;
+
+	policy = pcpu->policy;
+	cur_idle = get_cpu_idle_time(data, &cur_wall);
+	wall_time = (unsigned int)(cur_wall - pcpu->prev_cpu_wall);
+	idle_time = (unsigned int)(cur_idle - pcpu->prev_cpu_idle);
+	pcpu->prev_cpu_wall = cur_wall;
+	pcpu->prev_cpu_idle = cur_idle;
+
+	if (unlikely(!wall_time || wall_time < idle_time))
+		goto rearm;
+
+	load = 100 * (wall_time - idle_time) / wall_time;
+	now = interactive_now();
+
+	/*
+	 * Aim for the frequency at which this load would sit at
+	 * go_hispeed_load, but never climb more slowly than straight to
+	 * hispeed_freq once the CPU is saturated.
+	 */
+	new_freq = policy->cur * load / interactive_tuners_ins.go_hispeed_load;
+	if (load >= interactive_tuners_ins.go_hispeed_load &&
+	    new_freq < interactive_tuners_ins.hispeed_freq)
+		new_freq = interactive_tuners_ins.hispeed_freq;
+
+	if (now < input_boost_until &&
+	    new_freq < interactive_tuners_ins.hispeed_freq)
+		new_freq = interactive_tuners_ins.hispeed_freq;
+
+	if (cpufreq_frequency_table_target(policy, pcpu->freq_table, new_freq,
+					   CPUFREQ_RELATION_L, &index))
+		goto rearm;
+	new_freq = pcpu->freq_table[index].frequency;
+
+	/*
+	 * Do not scale below the current target until it has been held
+	 * for min_sample_time, so a short idle gap in the middle of a
+	 * scroll does not bounce us back down to the lowest OPP.
+	 */
+	if (new_freq < pcpu->target_freq &&
+	    now - pcpu->floor_validate_time <
+			interactive_tuners_ins.min_sample_time)
+		goto rearm;
+
+	if (new_freq > pcpu->target_freq)
+		pcpu->floor_validate_time = now;
+
+	if (new_freq != pcpu->target_freq) {
+		pcpu->target_freq = new_freq;
+		cpufreq_interactive_queue_speedchange(pcpu->cpu);
+	}
+
+rearm:
+	cpufreq_interactive_timer_resched(pcpu);
+out_unlock:
+	spin_unlock_irqrestore(&pcpu->lock, flags);
+}
+
+static void cpufreq_interactive_slack_timer(unsigned long data)
+{
+	/*
+	 * Nothing to do here: waking the CPU is enough for the (deferrable)
+	 * sampling timer, which expired earlier, to run on this tick.
+	 */
+}
+
+static void cpufreq_interactive_speedchange(struct work_struct *work)
+{
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	unsigned int cpu;
+
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	tmp_mask = speedchange_cpumask;
+	cpus_clear(speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+	for_each_cpu_mask_nr(cpu, tmp_mask) {
+		struct cpufreq_interactive_cpuinfo *pcpu =
+			&per_cpu(interactive_cpuinfo, cpu);
+
+		if (lock_policy_rwsem_write(cpu) < 0)
+			continue;
+
+		if (pcpu->enable && pcpu->target_freq != pcpu->policy->cur)
+			__cpufreq_driver_target(pcpu->policy,
+						pcpu->target_freq,
+						CPUFREQ_RELATION_H);
+
+		unlock_policy_rwsem_write(cpu);
+	}
+}
+
+/*
+ * Input boost: raise every CPU running this governor to hispeed_freq as
+ * soon as the user touches the screen or presses a key, instead of waiting
+ * for the next sample to notice the load.
+ */
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	unsigned int cpu;
+	u64 now;
+
+	if (!interactive_tuners_ins.input_boost)
+		return;
+
+	now = interactive_now();
+	input_boost_until = now + interactive_tuners_ins.input_boost_duration;
+
+	for_each_online_cpu(cpu) {
+		struct cpufreq_interactive_cpuinfo *pcpu =
+			&per_cpu(interactive_cpuinfo, cpu);
+		unsigned long flags;
+
+		spin_lock_irqsave(&pcpu->lock, flags);
+		if (pcpu->enable &&
+		    pcpu->target_freq < interactive_tuners_ins.hispeed_freq) {
+			pcpu->target_freq = interactive_tuners_ins.hispeed_freq;
+			pcpu->floor_validate_time = now;
+			cpufreq_interactive_queue_speedchange(cpu);
+		}
+		spin_unlock_irqrestore(&pcpu->lock, flags);
+	}
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{	/* touchscreens, e.g. cyttsp */
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_X)] = BIT_MASK(ABS_X) },
+	},
+	{	/* multitouch panels reporting only ABS_MT_* */
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+				BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	{	/* page turn and other keys */
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
+/************************** sysfs interface ************************/
+
+/* cpufreq_interactive Governor Tunables */
+#define show_one(file_name, object, fmt)				\
+static ssize_t show_##file_name						\
+(struct cpufreq_policy *unused, char *buf)				\
+{									\
+	return sprintf(buf, fmt "\n", interactive_tuners_ins.object);	\
+}
+show_one(hispeed_freq, hispeed_freq, "%u");
+show_one(go_hispeed_load, go_hispeed_load, "%u");
+show_one(min_sample_time, min_sample_time, "%u");
+show_one(timer_rate, timer_rate, "%u");
+show_one(timer_slack, timer_slack, "%d");
+show_one(input_boost, input_boost, "%u");
+show_one(input_boost_duration, input_boost_duration, "%u");
+
+static ssize_t store_hispeed_freq(struct cpufreq_policy *policy,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1 || input < policy->cpuinfo.min_freq ||
+			input > policy->cpuinfo.max_freq)
+		return -EINVAL;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.hispeed_freq = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_go_hispeed_load(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1 || !input || input > 100)
+		return -EINVAL;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.go_hispeed_load = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_min_sample_time(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.min_sample_time = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_timer_rate(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1 || input < MIN_TIMER_RATE || input > MAX_TIMER_RATE)
+		return -EINVAL;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.timer_rate = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_timer_slack(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	int input;
+	int ret;
+	ret = sscanf(buf, "%d", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	if (input < 0)
+		input = -1;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.timer_slack = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_input_boost(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	if (input > 1)
+		input = 1;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.input_boost = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+static ssize_t store_input_boost_duration(struct cpufreq_policy *unused,
+		const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+	ret = sscanf(buf, "%u", &input);
+
+	if (ret != 1)
+		return -EINVAL;
+
+	mutex_lock(&interactive_mutex);
+	interactive_tuners_ins.input_boost_duration = input;
+	mutex_unlock(&interactive_mutex);
+
+	return count;
+}
+
+#define define_one_rw(_name) \
+static struct freq_attr _name = \
+__ATTR(_name, 0644, show_##_name, store_##_name)
+
+define_one_rw(hispeed_freq);
+define_one_rw(go_hispeed_load);
+define_one_rw(min_sample_time);
+define_one_rw(timer_rate);
+define_one_rw(timer_slack);
+define_one_rw(input_boost);
+define_one_rw(input_boost_duration);
+
+static struct attribute *interactive_attributes[] = {
+	&hispeed_freq.attr,
+	&go_hispeed_load.attr,
+	&min_sample_time.attr,
+	&timer_rate.attr,
+	&timer_slack.attr,
+	&input_boost.attr,
+	&input_boost_duration.attr,
+	NULL
+};
+
+static struct attribute_group interactive_attr_group = {
+	.attrs = interactive_attributes,
+	.name = "interactive",
+};
+
+/************************** sysfs end ************************/
+
+static void cpufreq_interactive_timer_init(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pcpu->lock, flags);
+	pcpu->target_freq = pcpu->policy->cur;
+	pcpu->floor_validate_time = interactive_now();
+	pcpu->prev_cpu_idle = get_cpu_idle_time(pcpu->cpu,
+						&pcpu->prev_cpu_wall);
+	pcpu->enable = 1;
+	spin_unlock_irqrestore(&pcpu->lock, flags);
+
+	pcpu->cpu_timer.expires = jiffies +
+		usecs_to_jiffies(interactive_tuners_ins.timer_rate);
+	add_timer_on(&pcpu->cpu_timer, pcpu->cpu);
+}
+
+static void cpufreq_interactive_timer_exit(
+	struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pcpu->lock, flags);
+	pcpu->enable = 0;
+	spin_unlock_irqrestore(&pcpu->lock, flags);
+
+	del_timer_sync(&pcpu->cpu_timer);
+	del_timer_sync(&pcpu->cpu_slack_timer);
+}
+
+static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
+					unsigned int event)
+{
+	unsigned int cpu = policy->cpu;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned int j;
+	int rc;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if ((!cpu_online(cpu)) || (!policy->cur))
+			return -EINVAL;
+
+		mutex_lock(&interactive_mutex);
+		interactive_enable++;
+
+		if (interactive_enable == 1) {
+			rc = sysfs_create_group(&policy->kobj,
+						&interactive_attr_group);
+			if (rc) {
+				interactive_enable--;
+				mutex_unlock(&interactive_mutex);
+				return rc;
+			}
+
+			if (!interactive_tuners_ins.hispeed_freq)
+				interactive_tuners_ins.hispeed_freq =
+					policy->max;
+
+			/* Input boost is best effort, run without it */
+			rc = input_register_handler(
+					&cpufreq_interactive_input_handler);
+			if (rc)
+				printk(KERN_WARNING "cpufreq_interactive: "
+				       "input handler registration failed "
+				       "(%d)\n", rc);
+		}
+
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(interactive_cpuinfo, j);
+			pcpu->policy = policy;
+			pcpu->cpu = j;
+			pcpu->freq_table = cpufreq_frequency_get_table(j);
+			cpufreq_interactive_timer_init(pcpu);
+		}
+
+		mutex_unlock(&interactive_mutex);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		mutex_lock(&interactive_mutex);
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(interactive_cpuinfo, j);
+			cpufreq_interactive_timer_exit(pcpu);
+		}
+
+		interactive_enable--;
+		if (!interactive_enable) {
+			input_unregister_handler(
+					&cpufreq_interactive_input_handler);
+			sysfs_remove_group(&policy->kobj,
+					   &interactive_attr_group);
+		}
+		mutex_unlock(&interactive_mutex);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&interactive_mutex);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy, policy->max,
+						CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy, policy->min,
+						CPUFREQ_RELATION_L);
+
+		for_each_cpu(j, policy->cpus) {
+			unsigned long flags;
+
+			pcpu = &per_cpu(interactive_cpuinfo, j);
+			spin_lock_irqsave(&pcpu->lock, flags);
+			pcpu->target_freq = policy->cur;
+			spin_unlock_irqrestore(&pcpu->lock, flags);
+		}
+		mutex_unlock(&interactive_mutex);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
+static
+#endif
+struct cpufreq_governor cpufreq_gov_interactive = {
+	.name			= "interactive",
+	.governor		= cpufreq_governor_interactive,
+	.max_transition_latency = TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+static int __init cpufreq_interactive_init(void)
+{
+	unsigned int i;
+	int err;
+
+	for_each_possible_cpu(i) {
+		struct cpufreq_interactive_cpuinfo *pcpu =
+			&per_cpu(interactive_cpuinfo, i);
+
+		spin_lock_init(&pcpu->lock);
+		init_timer_deferrable(&pcpu->cpu_timer);
+		pcpu->cpu_timer.function = cpufreq_interactive_timer;
+		pcpu->cpu_timer.data = i;
+		setup_timer(&pcpu->cpu_slack_timer,
+			    cpufreq_interactive_slack_timer, i);
+	}
+
+	/* Ramp ups sit on the input path, do not queue them behind SCHED_OTHER */
+	kinteractive_wq = create_rt_workqueue("kinteractive");
+	if (!kinteractive_wq) {
+		printk(KERN_ERR "Creation of kinteractive failed\n");
+		return -EFAULT;
+	}
+	INIT_WORK(&speedchange_work, cpufreq_interactive_speedchange);
+
+	err = cpufreq_register_governor(&cpufreq_gov_interactive);
+	if (err)
+		destroy_workqueue(kinteractive_wq);
+
+	return err;
+}
+
+static void __exit cpufreq_interactive_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	destroy_workqueue(kinteractive_wq);
+}
+
+
+MODULE_DESCRIPTION("'cpufreq_interactive' - A cpufreq governor for "
+                   "latency sensitive interactive workloads");
+MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
+fs_initcall(cpufreq_interactive_init);
+#else
+module_init(cpufreq_interactive_init);
+#endif
+module_exit(cpufreq_interactive_exit);
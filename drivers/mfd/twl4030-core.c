@@ -29,6 +29,10 @@
 
 #include <linux/init.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/platform_device.h>
 #include <linux/clk.h>
 #include <linux/err.h>
@@ -382,6 +386,227 @@ EXPORT_SYMBOL(twl4030_i2c_read_u8);
 
 /*----------------------------------------------------------------------*/
 
+/*
+ * Queued transfers, drained in order by a realtime workqueue. A batch is
+ * the head of the queue plus the writes right behind it that continue
+ * where it stops, sent as a single message since the chip auto-increments
+ * the register address.
+ */
+static struct workqueue_struct *twl4030_xfer_wq;
+static LIST_HEAD(twl4030_xfer_queue);
+static DEFINE_SPINLOCK(twl4030_xfer_lock);
+static DEFINE_MUTEX(twl4030_xfer_run_lock);
+/* woken when a group's last queued write completes */
+static DECLARE_WAIT_QUEUE_HEAD(twl4030_xfer_idle);
+
+static void twl4030_xfer_batch(struct list_head *batch)
+{
+	struct twl4030_xfer *xfer, *next, *prev = NULL;
+	unsigned len = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	list_for_each_entry_safe(xfer, next, &twl4030_xfer_queue, node) {
+		if (prev && (xfer->read || xfer->mod_no != prev->mod_no ||
+			     xfer->reg != prev->reg + prev->num_bytes ||
+			     len + xfer->num_bytes > TWL4030_XFER_MAX))
+			break;
+		list_move_tail(&xfer->node, batch);
+		len += xfer->num_bytes;
+		prev = xfer;
+		if (xfer->read)
+			break;
+	}
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+}
+
+static int twl4030_xfer_do(struct list_head *batch)
+{
+	struct twl4030_xfer *first, *xfer;
+	struct twl4030_client *twl;
+	struct i2c_msg msg[2];
+	u8 buf[TWL4030_XFER_MAX + 1];
+	unsigned len = 1;
+	int ret;
+
+	first = list_first_entry(batch, struct twl4030_xfer, node);
+	twl = &twl4030_modules[twl4030_map[first->mod_no].sid];
+	buf[0] = twl4030_map[first->mod_no].base + first->reg;
+
+	msg[0].addr = twl->address;
+	msg[0].flags = 0;
+	msg[0].buf = buf;
+	if (first->read) {
+		msg[0].len = 1;
+		msg[1].addr = twl->address;
+		msg[1].flags = I2C_M_RD;
+		msg[1].len = first->num_bytes;
+		msg[1].buf = first->value;
+		ret = i2c_transfer(twl->client->adapter, msg, 2);
+	} else {
+		list_for_each_entry(xfer, batch, node) {
+			memcpy(buf + len, xfer->value, xfer->num_bytes);
+			len += xfer->num_bytes;
+		}
+		msg[0].len = len;
+		ret = i2c_transfer(twl->client->adapter, msg, 1);
+	}
+
+	/* i2cTransfer returns num messages.translate it pls.. */
+	if (ret >= 0)
+		ret = 0;
+	return ret;
+}
+
+static void twl4030_xfer_work(struct work_struct *work)
+{
+	struct twl4030_xfer *xfer, *next;
+	LIST_HEAD(batch);
+	int status;
+
+	mutex_lock(&twl4030_xfer_run_lock);
+	for (;;) {
+		twl4030_xfer_batch(&batch);
+		if (list_empty(&batch))
+			break;
+
+		status = twl4030_xfer_do(&batch);
+		list_for_each_entry_safe(xfer, next, &batch, node) {
+			list_del(&xfer->node);
+			xfer->status = status;
+			/* may free xfer */
+			if (xfer->complete)
+				xfer->complete(xfer);
+		}
+	}
+	mutex_unlock(&twl4030_xfer_run_lock);
+}
+static DECLARE_WORK(twl4030_xfer_run, twl4030_xfer_work);
+
+/**
+ * twl4030_i2c_queue - Queues a transfer to or from the TWL4030
+ * @xfer: the transfer, which must stay valid until its completion runs
+ *
+ * Returns 0 if the transfer was queued. May be called in atomic context.
+ */
+int twl4030_i2c_queue(struct twl4030_xfer *xfer)
+{
+	unsigned long flags;
+
+	if (unlikely(xfer->mod_no > TWL4030_MODULE_LAST)) {
+		pr_err("%s: invalid module number %d\n", DRIVER_NAME,
+		       xfer->mod_no);
+		return -EPERM;
+	}
+	if (unlikely(!xfer->num_bytes ||
+		     (!xfer->read && xfer->num_bytes > TWL4030_XFER_MAX)))
+		return -EINVAL;
+	if (unlikely(!inuse)) {
+		pr_err("%s: not initialized\n", DRIVER_NAME);
+		return -EPERM;
+	}
+	if (unlikely(!twl4030_xfer_wq))
+		return -ENODEV;
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	list_add_tail(&xfer->node, &twl4030_xfer_queue);
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+
+	queue_work(twl4030_xfer_wq, &twl4030_xfer_run);
+	return 0;
+}
+EXPORT_SYMBOL(twl4030_i2c_queue);
+
+struct twl4030_xfer_u8 {
+	struct twl4030_xfer	xfer;
+	u8			value;
+};
+
+static void twl4030_xfer_u8_done(struct twl4030_xfer *xfer)
+{
+	struct twl4030_xfer_group *group = xfer->context;
+	unsigned long flags;
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	if (xfer->status && !group->error)
+		group->error = xfer->status;
+	if (!--group->pending)
+		wake_up_all(&twl4030_xfer_idle);
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+	kfree(container_of(xfer, struct twl4030_xfer_u8, xfer));
+}
+
+/**
+ * twl4030_i2c_write_u8_queued - Queues a 8 bit register write
+ * @group: the caller's queued writes, zeroed before the first one
+ * @mod_no: module number
+ * @value: the value to be written 8 bit
+ * @reg: register address (just offset will do)
+ *
+ * Does not wait for the write; a failure is reported by the next
+ * twl4030_i2c_flush() of @group. Falls back to a synchronous write, after
+ * the writes already queued in @group, if the queue can't be used.
+ * Returns 0 or the error of that synchronous write.
+ */
+int twl4030_i2c_write_u8_queued(struct twl4030_xfer_group *group,
+				u8 mod_no, u8 value, u8 reg)
+{
+	struct twl4030_xfer_u8 *x;
+	unsigned long flags;
+
+	x = kzalloc(sizeof(*x), GFP_KERNEL);
+	if (!x)
+		goto sync;
+
+	x->value = value;
+	x->xfer.mod_no = mod_no;
+	x->xfer.reg = reg;
+	x->xfer.num_bytes = 1;
+	x->xfer.value = &x->value;
+	x->xfer.complete = twl4030_xfer_u8_done;
+	x->xfer.context = group;
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	group->pending++;
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+	if (!twl4030_i2c_queue(&x->xfer))
+		return 0;
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	group->pending--;
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+	kfree(x);
+sync:
+	/* must not overtake the group's queued writes */
+	wait_event(twl4030_xfer_idle, !group->pending);
+	return twl4030_i2c_write_u8(mod_no, value, reg);
+}
+EXPORT_SYMBOL(twl4030_i2c_write_u8_queued);
+
+/**
+ * twl4030_i2c_flush - Waits for a group's queued writes to complete
+ * @group: as passed to twl4030_i2c_write_u8_queued()
+ *
+ * Must not be called from a completion. Returns the first error of the
+ * writes queued in @group since its last flush, 0 if none.
+ */
+int twl4030_i2c_flush(struct twl4030_xfer_group *group)
+{
+	unsigned long flags;
+	int ret;
+
+	wait_event(twl4030_xfer_idle, !group->pending);
+
+	spin_lock_irqsave(&twl4030_xfer_lock, flags);
+	ret = group->error;
+	group->error = 0;
+	spin_unlock_irqrestore(&twl4030_xfer_lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL(twl4030_i2c_flush);
+
+/*----------------------------------------------------------------------*/
+
 static struct device *
 add_numbered_child(unsigned chip, const char *name, int num,
 		void *pdata, unsigned pdata_len,
@@ -745,6 +970,12 @@ static int twl4030_remove(struct i2c_client *client)
 	if (status < 0)
 		return status;
 
+	if (twl4030_xfer_wq) {
+		/* runs whatever is still queued */
+		destroy_workqueue(twl4030_xfer_wq);
+		twl4030_xfer_wq = NULL;
+	}
+
 	for (i = 0; i < TWL4030_NUM_SLAVES; i++) {
 		struct twl4030_client	*twl = &twl4030_modules[i];
 
@@ -802,6 +1033,11 @@ twl4030_probe(struct i2c_client *client, const struct i2c_device_id *id)
 	}
 	inuse = true;
 
+	twl4030_xfer_wq = create_rt_workqueue("twl4030_i2c");
+	if (!twl4030_xfer_wq)
+		dev_warn(&client->dev, "no workqueue, queued transfers "
+			 "disabled\n");
+
 	/* setup clock framework */
 	clocks_init(&client->dev);
 
@@ -122,13 +122,19 @@ static u8 res_config_addrs[] = {
 	[RES_Main_Ref]	= 0x94,
 };
 
+/* the script writes queued since the last load_triton_script() flush */
+static struct twl4030_xfer_group script_xfers __initdata;
+
 static int __init twl4030_write_script_byte(u8 address, u8 byte)
 {
 	int err;
 
-	err = twl4030_i2c_write_u8(TWL4030_MODULE_PM_MASTER, address,
+	/* queued, the address and data writes go out as one message */
+	err = twl4030_i2c_write_u8_queued(&script_xfers,
+					TWL4030_MODULE_PM_MASTER, address,
 					R_MEMORY_ADDRESS);
-	err |= twl4030_i2c_write_u8(TWL4030_MODULE_PM_MASTER, byte,
+	err |= twl4030_i2c_write_u8_queued(&script_xfers,
+					TWL4030_MODULE_PM_MASTER, byte,
 					R_MEMORY_DATA);
 
 	return err;
@@ -330,6 +336,7 @@ static int __init load_triton_script(struct twl4030_script *tscript)
 	int err;
 
 	err = twl4030_write_script(address, tscript->script, tscript->size);
+	err |= twl4030_i2c_flush(&script_xfers);
 	if (err)
 		return err;
 
@@ -15,6 +15,8 @@
 #include <linux/mmc/mmc.h>
 
 #include <linux/scatterlist.h>
+#include <linux/completion.h>
+#include <linux/time.h>
 
 #define RESULT_OK		0
 #define RESULT_FAIL		1
@@ -24,6 +26,15 @@
 #define BUFFER_ORDER		2
 #define BUFFER_SIZE		(PAGE_SIZE << BUFFER_ORDER)
 
+/*
+ * The performance tests move PERF_TOTAL_SIZE bytes in requests of up to
+ * PERF_REQ_SIZE, in the middle of the card and, for the random tests,
+ * spread over PERF_RANDOM_SPAN.
+ */
+#define PERF_REQ_SIZE		(64 * 1024)
+#define PERF_TOTAL_SIZE		(8 * 1024 * 1024)
+#define PERF_RANDOM_SPAN	(64 * 1024 * 1024)
+
 struct mmc_test_card {
 	struct mmc_card	*card;
 
@@ -453,6 +464,203 @@ static int mmc_test_transfer(struct mmc_test_card *test,
 	return 0;
 }
 
+/*
+ * One of the two requests kept in flight by the performance tests
+ */
+struct mmc_test_perf_req {
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+	struct scatterlist	sg;
+	struct completion	complete;
+	u8			*buf;
+};
+
+/*
+ * Card capacity in sectors
+ */
+static unsigned int mmc_test_capacity(struct mmc_card *card)
+{
+	if (!mmc_card_sd(card) && mmc_card_blockaddr(card))
+		return card->ext_csd.sectors;
+	else
+		return card->csd.capacity << (card->csd.read_blkbits - 9);
+}
+
+static void mmc_test_perf_prepare(struct mmc_test_card *test,
+	struct mmc_test_perf_req *r, unsigned sector, unsigned size, int write)
+{
+	unsigned dev_addr = sector;
+
+	memset(&r->mrq, 0, sizeof(struct mmc_request));
+	memset(&r->cmd, 0, sizeof(struct mmc_command));
+	memset(&r->data, 0, sizeof(struct mmc_data));
+	memset(&r->stop, 0, sizeof(struct mmc_command));
+
+	r->mrq.cmd = &r->cmd;
+	r->mrq.data = &r->data;
+	r->mrq.stop = &r->stop;
+
+	if (!mmc_card_blockaddr(test->card))
+		dev_addr <<= 9;
+
+	sg_init_one(&r->sg, r->buf, size);
+
+	mmc_test_prepare_mrq(test, &r->mrq, &r->sg, 1, dev_addr,
+		size / 512, 512, write);
+}
+
+/*
+ * Does count transfers of size bytes back to back. When pipelined, the
+ * next request is prepared with mmc_pre_req() while the current one is
+ * on the bus, as the block driver does.
+ */
+static int mmc_test_perf_run(struct mmc_test_card *test,
+	struct mmc_test_perf_req *r, unsigned size, unsigned count,
+	int write, int random, int pipelined, struct timespec *ts)
+{
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_perf_req *cur, *next;
+	unsigned int base, slots, sector, i;
+	struct timespec start, end;
+	u32 seed = 0x12345678;
+	int ret = 0;
+
+	base = mmc_test_capacity(test->card) / 2;
+	slots = min_t(unsigned int, base, PERF_RANDOM_SPAN / 512) /
+		(size / 512);
+
+	getnstimeofday(&start);
+
+	sector = base;
+	if (random) {
+		seed = seed * 1664525 + 1013904223;
+		sector = base + (seed % slots) * (size / 512);
+	}
+	mmc_test_perf_prepare(test, &r[0], sector, size, write);
+	if (pipelined)
+		mmc_pre_req(host, &r[0].mrq);
+	mmc_start_req(host, &r[0].mrq, &r[0].complete);
+
+	for (i = 0;i < count;i++) {
+		cur = &r[i & 1];
+		next = &r[(i + 1) & 1];
+
+		if (i + 1 < count) {
+			sector = base + (i + 1) * (size / 512);
+			if (random) {
+				seed = seed * 1664525 + 1013904223;
+				sector = base + (seed % slots) * (size / 512);
+			}
+			if (pipelined) {
+				mmc_test_perf_prepare(test, next, sector,
+					size, write);
+				mmc_pre_req(host, &next->mrq);
+			}
+		}
+
+		wait_for_completion(&cur->complete);
+		if (pipelined)
+			mmc_post_req(host, &cur->mrq, 0);
+
+		ret = mmc_test_check_result(test, &cur->mrq);
+		if (!ret && write)
+			ret = mmc_test_wait_busy(test);
+		if (ret) {
+			if (pipelined && i + 1 < count)
+				mmc_post_req(host, &next->mrq, ret);
+			break;
+		}
+
+		if (i + 1 < count) {
+			if (!pipelined)
+				mmc_test_perf_prepare(test, next, sector,
+					size, write);
+			mmc_start_req(host, &next->mrq, &next->complete);
+		}
+	}
+
+	getnstimeofday(&end);
+	*ts = timespec_sub(end, start);
+
+	return ret;
+}
+
+static void mmc_test_perf_report(struct mmc_test_card *test,
+	const char *what, unsigned bytes, struct timespec *ts)
+{
+	u64 us = timespec_to_ns(ts);
+	u64 rate = (u64)bytes * 1000000 / 1024;
+
+	do_div(us, 1000);
+	if (us)
+		do_div(rate, (u32)us);
+	else
+		rate = 0;
+
+	printk(KERN_INFO "%s: %s: %u bytes in %lu.%09lu seconds "
+		"(%u kB/s)\n", mmc_hostname(test->card->host), what, bytes,
+		(unsigned long)ts->tv_sec, (unsigned long)ts->tv_nsec,
+		(unsigned int)rate);
+}
+
+/*
+ * Measures throughput with and without the next request prepared ahead.
+ * This overwrites PERF_TOTAL_SIZE or more bytes in the middle of the card.
+ */
+static int mmc_test_perf(struct mmc_test_card *test, int write, int random)
+{
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_perf_req *r;
+	struct timespec ts;
+	unsigned size, count;
+	int ret, pipelined;
+
+	size = PERF_REQ_SIZE;
+	size = min(size, host->max_req_size);
+	size = min(size, host->max_seg_size);
+	size = min(size, host->max_blk_count * 512);
+	size &= ~511;
+	if (!size)
+		return RESULT_UNSUP_HOST;
+
+	if (mmc_test_capacity(test->card) <
+	    2 * (PERF_TOTAL_SIZE / 512 + PERF_RANDOM_SPAN / 512))
+		return RESULT_UNSUP_CARD;
+
+	count = PERF_TOTAL_SIZE / size;
+
+	r = kzalloc(2 * sizeof(struct mmc_test_perf_req), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+	r[0].buf = kzalloc(size, GFP_KERNEL);
+	r[1].buf = kzalloc(size, GFP_KERNEL);
+	if (!r[0].buf || !r[1].buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		goto out;
+
+	for (pipelined = 0;pipelined < 2;pipelined++) {
+		ret = mmc_test_perf_run(test, r, size, count, write, random,
+			pipelined, &ts);
+		if (ret)
+			goto out;
+		mmc_test_perf_report(test, pipelined ? "pipelined" : "serial",
+			size * count, &ts);
+	}
+
+out:
+	kfree(r[0].buf);
+	kfree(r[1].buf);
+	kfree(r);
+	return ret;
+}
+
 /*******************************************************************/
 /*  Tests                                                          */
 /*******************************************************************/
@@ -891,6 +1099,26 @@ static int mmc_test_multi_read_high(struct mmc_test_card *test)
 
 #endif /* CONFIG_HIGHMEM */
 
+static int mmc_test_seq_read_perf(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 0, 0);
+}
+
+static int mmc_test_seq_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 1, 0);
+}
+
+static int mmc_test_random_read_perf(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 0, 1);
+}
+
+static int mmc_test_random_write_perf(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 1, 1);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -1038,6 +1266,26 @@ static const struct mmc_test_case mmc_test_cases[] = {
 
 #endif /* CONFIG_HIGHMEM */
 
+	{
+		.name = "Sequential read performance",
+		.run = mmc_test_seq_read_perf,
+	},
+
+	{
+		.name = "Sequential write performance",
+		.run = mmc_test_seq_write_perf,
+	},
+
+	{
+		.name = "Random read performance",
+		.run = mmc_test_random_read_perf,
+	},
+
+	{
+		.name = "Random write performance",
+		.run = mmc_test_random_write_perf,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
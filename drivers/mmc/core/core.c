@@ -184,6 +184,60 @@ static void mmc_wait_done(struct mmc_request *mrq)
 	complete(mrq->done_data);
 }
 
+/**
+ *	mmc_pre_req - prepare a request ahead of starting it
+ *	@host: MMC host to prepare the request for
+ *	@mrq: MMC request to prepare
+ *
+ *	Let the host driver do the part of the request setup that doesn't
+ *	need the controller, such as mapping the data for DMA, possibly
+ *	while another request is in progress. Every prepared request must
+ *	be finished with mmc_post_req().
+ */
+void mmc_pre_req(struct mmc_host *host, struct mmc_request *mrq)
+{
+	if (host->ops->pre_req && mrq->data)
+		host->ops->pre_req(host, mrq);
+}
+
+EXPORT_SYMBOL(mmc_pre_req);
+
+/**
+ *	mmc_post_req - clean up after a prepared request
+ *	@host: MMC host the request was prepared for
+ *	@mrq: MMC request prepared with mmc_pre_req()
+ *	@err: non-zero if the request failed or was never started
+ */
+void mmc_post_req(struct mmc_host *host, struct mmc_request *mrq, int err)
+{
+	if (host->ops->post_req && mrq->data)
+		host->ops->post_req(host, mrq, err);
+}
+
+EXPORT_SYMBOL(mmc_post_req);
+
+/**
+ *	mmc_start_req - start a request without waiting for it
+ *	@host: MMC host to start command
+ *	@mrq: MMC request to start
+ *	@complete: completion signalled when the request is done
+ *
+ *	Like mmc_wait_for_req(), but returns as soon as the request has
+ *	been handed to the host so that the caller can prepare the next
+ *	one before waiting on @complete.
+ */
+void mmc_start_req(struct mmc_host *host, struct mmc_request *mrq,
+	struct completion *complete)
+{
+	init_completion(complete);
+	mrq->done_data = complete;
+	mrq->done = mmc_wait_done;
+
+	mmc_start_request(host, mrq);
+}
+
+EXPORT_SYMBOL(mmc_start_req);
+
 /**
  *	mmc_wait_for_req - start a request and wait for completion
  *	@host: MMC host to start command
@@ -197,10 +251,7 @@ void mmc_wait_for_req(struct mmc_host *host, struct mmc_request *mrq)
 {
 	DECLARE_COMPLETION_ONSTACK(complete);
 
-	mrq->done_data = &complete;
-	mrq->done = mmc_wait_done;
-
-	mmc_start_request(host, mrq);
+	mmc_start_req(host, mrq, &complete);
 
 	wait_for_completion(&complete);
 }
@@ -112,6 +112,10 @@
 #define OMAP_MMC_MASTER_CLOCK	96000000
 #define DRIVER_NAME		"mmci-omap-hs"
 
+/* Scatterlist segments per request, and channels in each DMA chain */
+#define OMAP_MMC_MAX_SEGS	128
+#define OMAP_MMC_DMA_CHAIN_LEN	4
+
 /*
  * One controller can have multiple slots, like on some omap boards using
  * omap.c controller driver. Luckily this is not currently done on any known
@@ -153,6 +157,12 @@ struct mmc_omap_host {
 	int			irq;
 	int			carddetect;
 	int			use_dma, dma_ch;
+	int			dma_chain[2];	/* rx, tx; kept until remove */
+	struct scatterlist	*dma_sg;	/* next segment to queue */
+	unsigned int		dma_sg_len;
+	unsigned int		dma_sg_queued;
+	unsigned int		dma_sg_done;
+	unsigned int		dma_blksz;
 	int			initstr;
 	int			slot_id;
 	int			dbclk_enabled;
@@ -436,9 +446,10 @@ mmc_omap_xfer_done(struct mmc_omap_host *host, struct mmc_data *data)
 {
 	host->data = NULL;
 
-	if (host->use_dma && host->dma_ch != -1)
-		dma_unmap_sg(mmc_dev(host->mmc), data->sg, host->dma_len,
+	if (host->use_dma && host->dma_len && !data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
 			host->dma_dir);
+	host->dma_len = 0;
 
 	host->datadir = OMAP_MMC_DATADIR_NONE;
 
@@ -499,10 +510,12 @@ static void mmc_dma_cleanup(struct mmc_omap_host *host, int errno)
 {
 	host->data->error = errno;
 
+	if (host->use_dma && host->dma_len && !host->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg,
+			host->data->sg_len, host->dma_dir);
+	host->dma_len = 0;
 	if (host->use_dma && host->dma_ch != -1) {
-		dma_unmap_sg(mmc_dev(host->mmc), host->data->sg, host->dma_len,
-			host->dma_dir);
-		omap_free_dma(host->dma_ch);
+		omap_stop_dma_chain_transfers(host->dma_ch);
 		host->dma_ch = -1;
 		up(&host->sem);
 	}
@@ -758,7 +771,34 @@ static irqreturn_t omap_mmc_cd_handler(int irq, void *dev_id)
 }
 
 /*
- * DMA call back function
+ * Queue the next segment of the transfer on the DMA chain. It starts as
+ * soon as the segment queued before it is done.
+ */
+static int mmc_omap_dma_queue_sg(struct mmc_omap_host *host)
+{
+	struct scatterlist *sg = host->dma_sg;
+	int src = 0, dst = 0, ret;
+
+	if (host->dma_dir == DMA_FROM_DEVICE)
+		dst = sg_dma_address(sg);
+	else
+		src = sg_dma_address(sg);
+
+	/* one frame per block, the source or destination left at 0 is the
+	 * data register set up in the chain parameters */
+	ret = omap_dma_chain_a_transfer(host->dma_ch, src, dst,
+			host->dma_blksz / 4, sg_dma_len(sg) / host->dma_blksz,
+			host);
+	if (ret)
+		return ret;
+
+	host->dma_sg = sg_next(sg);
+	host->dma_sg_queued++;
+	return 0;
+}
+
+/*
+ * DMA call back function, called once for every segment
  */
 static void mmc_omap_dma_cb(int lch, u16 ch_status, void *data)
 {
@@ -773,7 +813,29 @@ static void mmc_omap_dma_cb(int lch, u16 ch_status, void *data)
 	if (host->dma_ch < 0)
 		return;
 
-	omap_free_dma(host->dma_ch);
+	host->dma_sg_done++;
+	if (host->dma_sg_queued < host->dma_sg_len) {
+		struct mmc_data *mmc_data = host->data;
+
+		/* a channel just freed up in the chain */
+		if (!mmc_omap_dma_queue_sg(host))
+			return;
+
+		/* the rest of the transfer would never come */
+		dev_err(mmc_dev(host->mmc), "could not queue dma segment %d\n",
+			host->dma_sg_queued);
+		if (mmc_data) {
+			mmc_dma_cleanup(host, -EIO);
+			mmc_omap_reset_controller_fsm(host, SRD);
+			mmc_omap_xfer_done(host, mmc_data);
+		}
+		return;
+	}
+	if (host->dma_sg_done < host->dma_sg_len)
+		return;
+
+	/* resets the chain for the next transfer */
+	omap_stop_dma_chain_transfers(host->dma_ch);
 	host->dma_ch = -1;
 	/*
 	 * DMA Callback: run in interrupt context.
@@ -785,45 +847,100 @@ static void mmc_omap_dma_cb(int lch, u16 ch_status, void *data)
 /*
  * Configure dma src and destination parameters
  */
-static int mmc_omap_config_dma_param(int sync_dir, struct mmc_omap_host *host,
-				struct mmc_data *data)
+static void mmc_omap_config_dma_param(int sync_dir, struct mmc_omap_host *host,
+				struct mmc_data *data, int sync_dev,
+				struct omap_dma_channel_params *params)
 {
+	memset(params, 0, sizeof(*params));
+
+	params->data_type = OMAP_DMA_DATA_TYPE_S32;
+	params->elem_count = data->blksz / 4;
+	params->frame_count = 1;
+	params->sync_mode = OMAP_DMA_SYNC_FRAME;
+	params->trigger = sync_dev;
+	params->src_or_dst_synch = 0;
+
 	if (sync_dir == 0) {
-		omap_set_dma_dest_params(host->dma_ch, 0,
-			OMAP_DMA_AMODE_CONSTANT,
-			(host->mapbase + OMAP_HSMMC_DATA), 0, 0);
-		omap_set_dma_src_params(host->dma_ch, 0,
-			OMAP_DMA_AMODE_POST_INC,
-			sg_dma_address(&data->sg[0]), 0, 0);
+		params->dst_amode = OMAP_DMA_AMODE_CONSTANT;
+		params->dst_start = host->mapbase + OMAP_HSMMC_DATA;
+		params->src_amode = OMAP_DMA_AMODE_POST_INC;
 	} else {
-		omap_set_dma_src_params(host->dma_ch, 0,
-			OMAP_DMA_AMODE_CONSTANT,
-			(host->mapbase + OMAP_HSMMC_DATA), 0, 0);
-		omap_set_dma_dest_params(host->dma_ch, 0,
-			OMAP_DMA_AMODE_POST_INC,
-			sg_dma_address(&data->sg[0]), 0, 0);
+		params->src_amode = OMAP_DMA_AMODE_CONSTANT;
+		params->src_start = host->mapbase + OMAP_HSMMC_DATA;
+		params->dst_amode = OMAP_DMA_AMODE_POST_INC;
+	}
+}
+
+static int mmc_omap_dma_sync_dev(struct mmc_omap_host *host, int write)
+{
+	if (!write) {
+		if (host->id == OMAP_MMC1_DEVID)
+			return OMAP24XX_DMA_MMC1_RX;
+		else if (host->id == OMAP_MMC2_DEVID)
+			return OMAP24XX_DMA_MMC2_RX;
+		else
+#ifdef CONFIG_OMAP_HS_MMC3
+			return OMAP34XX_DMA_MMC3_RX;
+#else
+			return OMAP24XX_DMA_MMC2_RX;
+#endif
+	} else {
+		if (host->id == OMAP_MMC1_DEVID)
+			return OMAP24XX_DMA_MMC1_TX;
+		else if(host->id == OMAP_MMC2_DEVID)
+			return OMAP24XX_DMA_MMC2_TX;
+		else
+#ifdef CONFIG_OMAP_HS_MMC3
+			return OMAP34XX_DMA_MMC3_TX;
+#else
+			return OMAP24XX_DMA_MMC2_TX;
+#endif
 	}
-	return 0;
 }
+
+static inline enum dma_data_direction mmc_omap_dma_dir(struct mmc_data *data)
+{
+	return (data->flags & MMC_DATA_WRITE) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+}
+
 /*
  * Routine to configure and start DMA for the MMC card
+ *
+ * The scatterlist is transferred with a dynamic chain of linked channels,
+ * OMAP_MMC_DMA_CHAIN_LEN segments queued at a time and the rest queued
+ * from the DMA callback as segments complete, so multi-segment requests
+ * go straight to and from their pages.
  */
 static int
 mmc_omap_start_dma_transfer(struct mmc_omap_host *host, struct mmc_request *req)
 {
-	int sync_dev, sync_dir = 0;
-	int dma_ch = 0, ret = 0, err = 1;
+	struct omap_dma_channel_params params;
+	int sync_dev, chain, ret = 0, err = 1;
 	struct mmc_data *data = req->data;
+	int write = !!(data->flags & MMC_DATA_WRITE);
+	struct scatterlist *sg;
+	int i;
+
+	/* REVISIT: The MMC buffer increments only when MSB is written.
+	 * Return error for blksz which is non multiple of four.
+	 */
+	if ((data->blksz % 4) != 0)
+		return -EINVAL;
+
+	/* each segment has to be a whole number of blocks (DMA frames) */
+	for_each_sg(data->sg, sg, data->sg_len, i)
+		if (sg->length % data->blksz)
+			return -EINVAL;
 
 	/*
 	 * If for some reason the DMA transfer is still active,
-	 * we wait for timeout period and free the dma
+	 * we wait for timeout period and stop the dma
 	 */
 	if (host->dma_ch != -1) {
 		set_current_state(TASK_UNINTERRUPTIBLE);
 		schedule_timeout(100);
 		if (down_trylock(&host->sem)) {
-			omap_free_dma(host->dma_ch);
+			omap_stop_dma_chain_transfers(host->dma_ch);
 			host->dma_ch = -1;
 			up(&host->sem);
 			return err;
@@ -833,62 +950,83 @@ mmc_omap_start_dma_transfer(struct mmc_omap_host *host, struct mmc_request *req)
 			return err;
 	}
 
-	if (!(data->flags & MMC_DATA_WRITE)) {
-		host->dma_dir = DMA_FROM_DEVICE;
-		if (host->id == OMAP_MMC1_DEVID)
-			sync_dev = OMAP24XX_DMA_MMC1_RX;
-		else if (host->id == OMAP_MMC2_DEVID)
-			sync_dev = OMAP24XX_DMA_MMC2_RX;
-		else
-#ifdef CONFIG_OMAP_HS_MMC3
-			sync_dev = OMAP34XX_DMA_MMC3_RX;
-#else
-			sync_dev = OMAP24XX_DMA_MMC2_RX;
-#endif
+	host->dma_dir = mmc_omap_dma_dir(data);
+	sync_dev = mmc_omap_dma_sync_dev(host, write);
+	mmc_omap_config_dma_param(write ? 0 : 1, host, data, sync_dev,
+			&params);
+
+	/*
+	 * The chains are requested on first use and kept, rather than
+	 * requested and freed around every transfer.
+	 */
+	if (host->dma_chain[write] == -1) {
+		ret = omap_request_dma_chain(sync_dev, "MMC/SD",
+				mmc_omap_dma_cb, &chain,
+				OMAP_MMC_DMA_CHAIN_LEN,
+				OMAP_DMA_DYNAMIC_CHAIN, params);
+		if (ret != 0) {
+			dev_dbg(mmc_dev(host->mmc),
+				"%s: omap_request_dma_chain() failed with %d\n",
+				mmc_hostname(host->mmc), ret);
+			up(&host->sem);
+			return ret;
+		}
+		host->dma_chain[write] = chain;
 	} else {
-		host->dma_dir = DMA_TO_DEVICE;
-		if (host->id == OMAP_MMC1_DEVID)
-			sync_dev = OMAP24XX_DMA_MMC1_TX;
-		else if(host->id == OMAP_MMC2_DEVID)
-			sync_dev = OMAP24XX_DMA_MMC2_TX;
-		else
-#ifdef CONFIG_OMAP_HS_MMC3
-			sync_dev = OMAP34XX_DMA_MMC3_TX;
-#else
-			sync_dev = OMAP24XX_DMA_MMC2_TX;
-#endif
+		/* the channel context may have been lost in off mode */
+		chain = host->dma_chain[write];
+		omap_modify_dma_chain_params(chain, params);
 	}
 
-	ret = omap_request_dma(sync_dev, "MMC/SD", mmc_omap_dma_cb,
-			host, &dma_ch);
-	if (ret != 0) {
-		dev_dbg(mmc_dev(host->mmc),
-			"%s: omap_request_dma() failed with %d\n",
-			mmc_hostname(host->mmc), ret);
-		return ret;
-	}
+	/* already mapped by mmc_omap_pre_req unless host_cookie is 0 */
+	if (data->host_cookie)
+		host->dma_len = data->host_cookie;
+	else
+		host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
+				data->sg_len, host->dma_dir);
+	host->dma_ch = chain;
+	host->dma_sg = data->sg;
+	host->dma_sg_len = host->dma_len;
+	host->dma_sg_queued = 0;
+	host->dma_sg_done = 0;
+	host->dma_blksz = data->blksz;
+
+	while (host->dma_sg_queued < host->dma_sg_len &&
+	       !mmc_omap_dma_queue_sg(host))
+		;
+
+	omap_start_dma_chain_transfers(chain);
+	return 0;
+}
 
-	host->dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg,
-			data->sg_len, host->dma_dir);
-	host->dma_ch = dma_ch;
+/*
+ * Map the data of a request ahead of time, while the controller may still
+ * be busy with the previous one. On the Cortex-A8 the cache maintenance
+ * done by dma_map_sg is a good part of the cost of starting a transfer.
+ */
+static void omap_mmc_pre_req(struct mmc_host *mmc, struct mmc_request *req)
+{
+	struct mmc_omap_host *host = mmc_priv(mmc);
+	struct mmc_data *data = req->data;
 
-	if (!(data->flags & MMC_DATA_WRITE))
-		mmc_omap_config_dma_param(1, host, data);
-	else
-		mmc_omap_config_dma_param(0, host, data);
+	if (!host->use_dma || data->host_cookie)
+		return;
 
-	if ((data->blksz % 4) == 0)
-		omap_set_dma_transfer_params(dma_ch, OMAP_DMA_DATA_TYPE_S32,
-			(data->blksz / 4), data->blocks, OMAP_DMA_SYNC_FRAME,
-			sync_dev, sync_dir);
-	else
-		/* REVISIT: The MMC buffer increments only when MSB is written.
-		 * Return error for blksz which is non multiple of four.
-		 */
-		return -EINVAL;
+	data->host_cookie = dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len,
+				       mmc_omap_dma_dir(data));
+}
 
-	omap_start_dma(dma_ch);
-	return 0;
+static void omap_mmc_post_req(struct mmc_host *mmc, struct mmc_request *req,
+			      int err)
+{
+	struct mmc_data *data = req->data;
+
+	if (!data->host_cookie)
+		return;
+
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len,
+		     mmc_omap_dma_dir(data));
+	data->host_cookie = 0;
 }
 
 static void set_data_timeout(struct mmc_omap_host *host,
@@ -1141,6 +1279,8 @@ static int omap_hsmmc_get_ro(struct mmc_host *mmc)
 }
 
 static struct mmc_host_ops mmc_omap_ops = {
+	.pre_req = omap_mmc_pre_req,
+	.post_req = omap_mmc_post_req,
 	.request = omap_mmc_request,
 	.set_ios = omap_mmc_set_ios,
 	.get_cd = omap_hsmmc_get_cd,
@@ -1190,6 +1330,8 @@ static int __init omap_mmc_probe(struct platform_device *pdev)
 	host->use_dma	= 1;
 	host->dev->dma_mask = &pdata->dma_mask;
 	host->dma_ch	= -1;
+	host->dma_chain[0] = -1;
+	host->dma_chain[1] = -1;
 	host->irq	= irq;
 	host->id	= pdev->id;
 	host->slot_id	= 0;
@@ -1267,10 +1409,8 @@ static int __init omap_mmc_probe(struct platform_device *pdev)
 		goto err1;
 	}
 
-#ifdef CONFIG_MMC_BLOCK_BOUNCE
-	mmc->max_phys_segs = 1;
-	mmc->max_hw_segs = 1;
-#endif
+	mmc->max_phys_segs = OMAP_MMC_MAX_SEGS;
+	mmc->max_hw_segs = OMAP_MMC_MAX_SEGS;
 	mmc->max_blk_size = 512;       /* Block Length at max can be 1024 */
 	mmc->max_blk_count = 0xFFFF;    /* No. of Blocks is 16 bits */
 	mmc->max_req_size = mmc->max_blk_size * mmc->max_blk_count;
@@ -1402,6 +1542,11 @@ static int omap_mmc_remove(struct platform_device *pdev)
 			free_irq(mmc_slot(host).card_detect_irq, host);
 		flush_scheduled_work();
 
+		if (host->dma_chain[0] != -1)
+			omap_free_dma_chain(host->dma_chain[0]);
+		if (host->dma_chain[1] != -1)
+			omap_free_dma_chain(host->dma_chain[1]);
+
 		omap_hsmmc_disable_clks(host);
 		clk_put(host->fclk);
 		clk_put(host->iclk);
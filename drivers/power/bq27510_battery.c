@@ -26,6 +26,10 @@
 #include <linux/i2c.h>
 #include <asm/unaligned.h>
 
+#ifdef CONFIG_ARCH_OMAP3
+#include <mach/omap-pm.h>
+#endif
+
 #define DRIVER_VERSION			"1.0.0"
 
 #define BQ27510_REG_TEMP		0x06
@@ -68,6 +72,9 @@ struct bq27510_device_info {
 	int                     	time_to_full;
 	struct bq27510_access_methods	*bus;
 	struct power_supply		bat;
+#ifdef CONFIG_ARCH_OMAP3
+	struct omap_pm_battery		pm;
+#endif
 
 	struct i2c_client		*client;
 };
@@ -115,19 +122,33 @@ static int bq27x10_read(u8 reg, int *rt_value, int b_single,
  * Return the battery temperature in Celcius degrees
  * Or < 0 if something fails.
  */
-static int bq27510_battery_temperature(struct bq27510_device_info *di)
+static int bq27510_read_temperature(struct bq27510_device_info *di,
+				    int *temp)
 {
 	int ret;
-	int temp = 0;
 
-	ret = bq27x10_read(BQ27510_REG_TEMP, &temp, 0, di);
+	*temp = 0;
+	ret = bq27x10_read(BQ27510_REG_TEMP, temp, 0, di);
 	if (ret) {
 		dev_err(di->dev, "error reading temperature\n");
 		return ret;
 	}
 
 	/* Battery temperature is returned in multiple of 0.1 K */
-	return ((temp/KELVIN_SCALE_RANGE) - OFFSET_KELVIN_CELSIUS);
+	*temp = (*temp/KELVIN_SCALE_RANGE) - OFFSET_KELVIN_CELSIUS;
+#ifdef CONFIG_ARCH_OMAP3
+	/* closest sensor to the SoC SmartReflex calibrations can follow */
+	sr_class1p5_temp_update(*temp);
+#endif
+	return 0;
+}
+
+static int bq27510_battery_temperature(struct bq27510_device_info *di)
+{
+	int temp;
+	int ret = bq27510_read_temperature(di, &temp);
+
+	return ret ? ret : temp;
 }
 
 /*
@@ -152,20 +173,28 @@ static int bq27510_battery_voltage(struct bq27510_device_info *di)
  * Note that current can be negative signed as well
  * Or 0 if something fails.
  */
-static int bq27510_battery_current(struct bq27510_device_info *di)
+static int bq27510_read_current(struct bq27510_device_info *di, int *curr)
 {
 	int ret;
-	int curr = 0;
-	/*int flags = 0;*/
 
-	ret = bq27x10_read(BQ27510_REG_AI, &curr, 0, di);
+	*curr = 0;
+	ret = bq27x10_read(BQ27510_REG_AI, curr, 0, di);
 	if (ret) {
 		dev_err(di->dev, "error reading current\n");
-		return 0;
+		return ret;
 	}
 
 	/* In the BQ27510 convention, charging current is positive while discharging current is negative */
-	return ((curr > CURRENT_OVF_THRESHOLD) ? (curr-((1 << 16) -1)):curr);
+	if (*curr > CURRENT_OVF_THRESHOLD)
+		*curr -= (1 << 16) - 1;
+	return 0;
+}
+
+static int bq27510_battery_current(struct bq27510_device_info *di)
+{
+	int curr;
+
+	return bq27510_read_current(di, &curr) ? 0 : curr;
 }
 
 /*
@@ -304,6 +333,18 @@ static void bq27510_powersupply_init(struct bq27510_device_info *di)
 	di->bat.external_power_changed = NULL;
 }
 
+#ifdef CONFIG_ARCH_OMAP3
+static int bq27510_pm_current(void *data, int *ma)
+{
+	return bq27510_read_current(data, ma);
+}
+
+static int bq27510_pm_temp(void *data, int *temp_c)
+{
+	return bq27510_read_temperature(data, temp_c);
+}
+#endif
+
 /*
  * Read by I2C.
  */
@@ -402,6 +443,14 @@ static int bq27510_battery_probe(struct i2c_client *client,
 		goto batt_failed_4;
 	}
 
+#ifdef CONFIG_ARCH_OMAP3
+	/* let the MPU power budget watch the battery */
+	di->pm.get_current = bq27510_pm_current;
+	di->pm.get_temp = bq27510_pm_temp;
+	di->pm.data = di;
+	omap_pm_register_battery(&di->pm);
+#endif
+
 	dev_info(&client->dev, "support ver. %s enabled\n", DRIVER_VERSION);
 	return 0;
 
@@ -426,6 +475,9 @@ static int bq27510_battery_remove(struct i2c_client *client)
 {
 	struct bq27510_device_info *di = i2c_get_clientdata(client);
 
+#ifdef CONFIG_ARCH_OMAP3
+	omap_pm_register_battery(NULL);
+#endif
 	power_supply_unregister(&di->bat);
 
 	kfree(di->bat.name);
@@ -19,9 +19,11 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
+#include <linux/mman.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
@@ -97,6 +99,19 @@ static int binder_set_stop_on_user_error(
 module_param_call(stop_on_user_error, binder_set_stop_on_user_error,
 	param_get_int, &binder_stop_on_user_error, S_IWUSR | S_IRUGO);
 
+/*
+ * Small buffers are rounded up to one of these sizes. When freed they are
+ * parked on a per-proc list for their class, still mapped, instead of
+ * being merged back into the free tree.
+ */
+static const size_t binder_buffer_class_size[] = { 128, 256, 512, 1024, 2048 };
+#define BINDER_BUFFER_CLASSES ARRAY_SIZE(binder_buffer_class_size)
+static int binder_buffer_class_max = 4;
+module_param_named(buffer_class_max, binder_buffer_class_max, int, S_IWUSR | S_IRUGO);
+/* idle pages a proc may keep mapped once its buffers are freed */
+static int binder_page_cache_max = 8;
+module_param_named(page_cache_max, binder_page_cache_max, int, S_IWUSR | S_IRUGO);
+
 #define binder_user_error(x...) \
 	do { \
 		if (binder_debug_mask & BINDER_DEBUG_USER_ERROR) \
@@ -125,6 +140,16 @@ struct binder_stats {
 
 static struct binder_stats binder_stats;
 
+struct binder_alloc_stats {
+	int class_hit;
+	int class_miss;
+	int page_hit;
+	int page_miss;
+};
+
+/* totals of released procs, live procs keep their own */
+static struct binder_alloc_stats binder_alloc_stats;
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -171,6 +196,16 @@ struct binder_work {
 	} type;
 };
 
+/* log2 buckets: < 32us, < 64us, ..., >= 8ms */
+#define BINDER_LATENCY_BUCKETS 10
+
+struct binder_latency {
+	int count;
+	unsigned int max_us;
+	u64 total_us;
+	int hist[BINDER_LATENCY_BUCKETS];
+};
+
 struct binder_node {
 	int debug_id;
 	struct binder_work work;
@@ -193,6 +228,8 @@ struct binder_node {
 	unsigned accept_fds : 1;
 	int min_priority : 8;
 	struct list_head async_todo;
+	struct binder_latency dispatch_lat; /* enqueue to BR_TRANSACTION */
+	struct binder_latency service_lat; /* BR_TRANSACTION to BC_REPLY */
 };
 
 struct binder_ref_death {
@@ -219,12 +256,16 @@ struct binder_ref {
 
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by addesss */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head class_entry; /* parked small buffer */
+	};
 	unsigned free : 1;
 	unsigned allow_user_free : 1;
 	unsigned async_transaction : 1;
-	unsigned debug_id : 29;
+	unsigned has_fd_regions : 1;
+	unsigned debug_id : 28;
 
 	struct binder_transaction *transaction;
 
@@ -252,15 +293,22 @@ struct binder_proc {
 	struct files_struct *files;
 	struct hlist_node deferred_work_node;
 	int deferred_work;
+	int tmp_ref;
+	int release_pending;
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	struct mutex buffer_lock; /* protects buffers, pages and async space */
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
+	struct list_head buffer_classes[BINDER_BUFFER_CLASSES];
+	int buffer_class_count[BINDER_BUFFER_CLASSES];
 	size_t free_async_space;
 
 	struct page **pages;
+	int pages_cached;
+	struct binder_alloc_stats alloc_stats;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -272,6 +320,8 @@ struct binder_proc {
 	int requested_threads_started;
 	int ready_threads;
 	long default_priority;
+	struct binder_latency dispatch_lat;
+	struct binder_latency service_lat;
 };
 
 enum {
@@ -315,9 +365,12 @@ struct binder_transaction {
 	long	priority;
 	long	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	enqueue_time;
+	ktime_t	wakeup_time;
 };
 
 static void binder_defer_work(struct binder_proc *proc, int defer);
+static void binder_deferred_release(struct binder_proc *proc);
 
 /*
  * copied from get_unused_fd_flags
@@ -545,13 +598,15 @@ static void binder_insert_allocated_buffer(
 static struct binder_buffer *binder_buffer_lookup(
 	struct binder_proc *proc, void __user *user_ptr)
 {
-	struct rb_node *n = proc->allocated_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	struct binder_buffer *kern_ptr;
 
 	kern_ptr = user_ptr - proc->user_buffer_offset
 		- offsetof(struct binder_buffer, data);
 
+	mutex_lock(&proc->buffer_lock);
+	n = proc->allocated_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(buffer->free);
@@ -560,9 +615,12 @@ static struct binder_buffer *binder_buffer_lookup(
 			n = n->rb_left;
 		else if (kern_ptr > buffer)
 			n = n->rb_right;
-		else
+		else {
+			mutex_unlock(&proc->buffer_lock);
 			return buffer;
+		}
 	}
+	mutex_unlock(&proc->buffer_lock);
 	return NULL;
 }
 
@@ -582,6 +640,30 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate) {
+		for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE)
+			if (!proc->pages[(page_addr - proc->buffer) / PAGE_SIZE])
+				break;
+		if (page_addr >= end) {
+			/* every page is still mapped from a previous buffer */
+			for (page_addr = start; page_addr < end;
+			     page_addr += PAGE_SIZE) {
+				proc->pages_cached--;
+				proc->alloc_stats.page_hit++;
+			}
+			return 0;
+		}
+	} else {
+		/* keep pages mapped for reuse, up to the high-water mark */
+		while (start < end &&
+		       proc->pages_cached < binder_page_cache_max) {
+			proc->pages_cached++;
+			start += PAGE_SIZE;
+		}
+		if (end <= start)
+			return 0;
+	}
+
 	if (vma)
 		mm = NULL;
 	else
@@ -606,7 +688,12 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
+		if (*page) {
+			proc->pages_cached--;
+			proc->alloc_stats.page_hit++;
+			continue;
+		}
+		proc->alloc_stats.page_miss++;
 		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
 		if (*page == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
@@ -663,16 +750,48 @@ err_no_vma:
 	return -ENOMEM;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+static int binder_buffer_class(size_t size)
+{
+	int i;
+
+	for (i = 0; i < BINDER_BUFFER_CLASSES; i++)
+		if (size <= binder_buffer_class_size[i])
+			return i;
+	return -1;
+}
+
+static void binder_merge_free_buffer(struct binder_proc *proc,
+	struct binder_buffer *buffer);
+
+static int binder_flush_buffer_classes(struct binder_proc *proc)
+{
+	struct binder_buffer *buffer;
+	int i, count = 0;
+
+	for (i = 0; i < BINDER_BUFFER_CLASSES; i++) {
+		while (!list_empty(&proc->buffer_classes[i])) {
+			buffer = list_first_entry(&proc->buffer_classes[i],
+					struct binder_buffer, class_entry);
+			list_del(&buffer->class_entry);
+			binder_merge_free_buffer(proc, buffer);
+			count++;
+		}
+		proc->buffer_class_count[i] = 0;
+	}
+	return count;
+}
+
+static struct binder_buffer *__binder_alloc_buf(struct binder_proc *proc,
 	size_t data_size, size_t offsets_size, int is_async)
 {
-	struct rb_node *n = proc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
+	struct rb_node *best_fit;
 	void *has_page_addr;
 	void *end_page_addr;
-	size_t size;
+	size_t size, alloc_size;
+	int class;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -697,15 +816,39 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		return NULL;
 	}
 
+	class = binder_buffer_class(size);
+	if (class >= 0) {
+		if (!list_empty(&proc->buffer_classes[class])) {
+			buffer = list_first_entry(&proc->buffer_classes[class],
+					struct binder_buffer, class_entry);
+			list_del(&buffer->class_entry);
+			proc->buffer_class_count[class]--;
+			proc->alloc_stats.class_hit++;
+			binder_insert_allocated_buffer(proc, buffer);
+			if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC)
+				printk(KERN_INFO "binder: %d: binder_alloc_buf "
+				       "size %zd reused %p from class %zd\n",
+				       proc->pid, size, buffer,
+				       binder_buffer_class_size[class]);
+			goto got_buffer;
+		}
+		proc->alloc_stats.class_miss++;
+		alloc_size = binder_buffer_class_size[class];
+	} else
+		alloc_size = size;
+
+retry:
+	n = proc->free_buffers.rb_node;
+	best_fit = NULL;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
+		if (alloc_size < buffer_size) {
 			best_fit = n;
 			n = n->rb_left;
-		} else if (size > buffer_size)
+		} else if (alloc_size > buffer_size)
 			n = n->rb_right;
 		else {
 			best_fit = n;
@@ -713,6 +856,9 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		}
 	}
 	if (best_fit == NULL) {
+		/* parked buffers may be hiding the space we need */
+		if (binder_flush_buffer_classes(proc))
+			goto retry;
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
 		return NULL;
@@ -728,10 +874,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
 	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
+		if (alloc_size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+			buffer_size = alloc_size; /* no room for other buffers */
 		else
-			buffer_size = size + sizeof(struct binder_buffer);
+			buffer_size = alloc_size + sizeof(struct binder_buffer);
 	}
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
@@ -744,8 +890,8 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	rb_erase(best_fit, &proc->free_buffers);
 	buffer->free = 0;
 	binder_insert_allocated_buffer(proc, buffer);
-	if (buffer_size != size) {
-		struct binder_buffer *new_buffer = (void *)buffer->data + size;
+	if (buffer_size != alloc_size) {
+		struct binder_buffer *new_buffer = (void *)buffer->data + alloc_size;
 		list_add(&new_buffer->entry, &buffer->entry);
 		new_buffer->free = 1;
 		binder_insert_free_buffer(proc, new_buffer);
@@ -753,9 +899,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC)
 		printk(KERN_INFO "binder: %d: binder_alloc_buf size %zd got "
 		       "%p\n", proc->pid, size, buffer);
+got_buffer:
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
+	buffer->allow_user_free = 0;
+	buffer->has_fd_regions = 0;
+	buffer->transaction = NULL;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		if (binder_debug_mask & BINDER_DEBUG_BUFFER_ALLOC_ASYNC)
@@ -767,6 +917,21 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+/*
+ * The allocator only needs the target's buffer_lock, so callers may drop
+ * binder_lock around it (and around the copy into the new buffer).
+ */
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+	size_t data_size, size_t offsets_size, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	mutex_lock(&proc->buffer_lock);
+	buffer = __binder_alloc_buf(proc, data_size, offsets_size, is_async);
+	mutex_unlock(&proc->buffer_lock);
+	return buffer;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -824,10 +989,41 @@ static void binder_delete_free_buffer(
 	}
 }
 
-static void binder_free_buf(
+static void binder_merge_free_buffer(struct binder_proc *proc,
+	struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_buffer_size(proc, buffer);
+
+	binder_update_page_range(proc, 0,
+		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
+		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
+		NULL);
+	buffer->free = 1;
+	if (!list_is_last(&buffer->entry, &proc->buffers)) {
+		struct binder_buffer *next = list_entry(buffer->entry.next,
+						struct binder_buffer, entry);
+		if (next->free) {
+			rb_erase(&next->rb_node, &proc->free_buffers);
+			binder_delete_free_buffer(proc, next);
+		}
+	}
+	if (proc->buffers.next != &buffer->entry) {
+		struct binder_buffer *prev = list_entry(buffer->entry.prev,
+						struct binder_buffer, entry);
+		if (prev->free) {
+			binder_delete_free_buffer(proc, buffer);
+			rb_erase(&prev->rb_node, &proc->free_buffers);
+			buffer = prev;
+		}
+	}
+	binder_insert_free_buffer(proc, buffer);
+}
+
+static void __binder_free_buf(
 	struct binder_proc *proc, struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
+	int class;
 
 	buffer_size = binder_buffer_size(proc, buffer);
 
@@ -851,30 +1047,28 @@ static void binder_free_buf(
 			       proc->free_async_space);
 	}
 
-	binder_update_page_range(proc, 0,
-		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
-		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
-		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
-	buffer->free = 1;
-	if (!list_is_last(&buffer->entry, &proc->buffers)) {
-		struct binder_buffer *next = list_entry(buffer->entry.next,
-						struct binder_buffer, entry);
-		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
-			binder_delete_free_buffer(proc, next);
-		}
-	}
-	if (proc->buffers.next != &buffer->entry) {
-		struct binder_buffer *prev = list_entry(buffer->entry.prev,
-						struct binder_buffer, entry);
-		if (prev->free) {
-			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
-			buffer = prev;
-		}
+
+	/*
+	 * Small buffers were rounded up to their class at allocation, so
+	 * any parked buffer fits any later request of the same class.
+	 */
+	class = binder_buffer_class(size);
+	if (class >= 0 &&
+	    proc->buffer_class_count[class] < binder_buffer_class_max) {
+		list_add(&buffer->class_entry, &proc->buffer_classes[class]);
+		proc->buffer_class_count[class]++;
+		return;
 	}
-	binder_insert_free_buffer(proc, buffer);
+	binder_merge_free_buffer(proc, buffer);
+}
+
+static void binder_free_buf(
+	struct binder_proc *proc, struct binder_buffer *buffer)
+{
+	mutex_lock(&proc->buffer_lock);
+	__binder_free_buf(proc, buffer);
+	mutex_unlock(&proc->buffer_lock);
 }
 
 static struct binder_node *
@@ -1257,6 +1451,80 @@ static void
 binder_transaction_buffer_release(struct binder_proc *proc,
 			struct binder_buffer *buffer, size_t *failed_at);
 
+/*
+ * A transaction holds a tmp_ref on its target while it fills the target
+ * buffer without binder_lock. A release that comes in meanwhile is left
+ * pending and is completed here by the last such transaction.
+ */
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	BUG_ON(proc->tmp_ref <= 0);
+	proc->tmp_ref--;
+	if (proc->tmp_ref == 0 && proc->release_pending)
+		binder_deferred_release(proc); /* frees proc */
+}
+
+static void binder_latency_add(struct binder_latency *lat, s64 us)
+{
+	int bucket;
+
+	if (us < 0)
+		us = 0;
+	if (us > UINT_MAX)
+		us = UINT_MAX;
+	bucket = us < 32 ? 0 : fls((unsigned int)us >> 5);
+	if (bucket >= BINDER_LATENCY_BUCKETS)
+		bucket = BINDER_LATENCY_BUCKETS - 1;
+	lat->hist[bucket]++;
+	lat->count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+}
+
+/* Called when a target thread picks up an incoming transaction */
+static void binder_record_dispatch(struct binder_proc *proc,
+	struct binder_transaction *t, struct binder_node *node)
+{
+	s64 us;
+
+	t->wakeup_time = ktime_get();
+	us = ktime_us_delta(t->wakeup_time, t->enqueue_time);
+	binder_latency_add(&proc->dispatch_lat, us);
+	binder_latency_add(&node->dispatch_lat, us);
+}
+
+/* Called when proc sends the reply to in_reply_to */
+static void binder_record_service(struct binder_proc *proc,
+	struct binder_transaction *in_reply_to)
+{
+	s64 us = ktime_us_delta(ktime_get(), in_reply_to->wakeup_time);
+
+	binder_latency_add(&proc->service_lat, us);
+	/* the buffer, and with it the node, may already have been freed */
+	if (in_reply_to->buffer && in_reply_to->buffer->target_node)
+		binder_latency_add(&in_reply_to->buffer->target_node->service_lat,
+				   us);
+}
+
+/*
+ * A synchronous transaction to a process that is already waiting further
+ * up this thread's call stack goes to the waiting thread.
+ */
+static struct binder_thread *
+binder_stack_target(struct binder_thread *thread,
+		    struct binder_proc *target_proc)
+{
+	struct binder_transaction *tmp;
+	struct binder_thread *target_thread = NULL;
+
+	for (tmp = thread->transaction_stack; tmp; tmp = tmp->from_parent) {
+		if (tmp->from && tmp->from->proc == target_proc)
+			target_thread = tmp->from;
+	}
+	return target_thread;
+}
+
 static void
 binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 	struct binder_transaction_data *tr, int reply)
@@ -1270,7 +1538,7 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 	struct list_head *target_list;
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
-	struct binder_transaction_log_entry *e;
+	struct binder_transaction_log_entry *e, log_entry;
 	uint32_t return_error;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
@@ -1363,21 +1631,8 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
 		}
 	}
-	if (target_thread) {
-		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
@@ -1421,37 +1676,92 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 		t->from = NULL;
 	t->sender_euid = proc->tsk->cred->euid;
 	t->to_proc = target_proc;
-	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
 	t->priority = task_nice(current);
+
+	if (!reply && !(tr->flags & TF_ONE_WAY))
+		target_thread = binder_stack_target(thread, target_proc);
+	if (target_thread)
+		e->to_thread = target_thread->pid;
+	/*
+	 * The log slot may be reused once binder_lock is dropped, so a
+	 * failure from here on is logged from a copy.
+	 */
+	log_entry = *e;
+	e = &log_entry;
+
+	/*
+	 * Allocating the target buffer and copying the payload into it only
+	 * needs the target's buffer_lock, so do it without binder_lock held.
+	 * The node reference and tmp_ref keep target_node and target_proc
+	 * alive meanwhile; anything else looked up above is revalidated
+	 * once binder_lock has been retaken.
+	 */
+	if (target_node)
+		binder_inc_node(target_node, 1, 0, NULL);
+	target_proc->tmp_ref++;
+	mutex_unlock(&binder_lock);
+
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
 		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
+		mutex_lock(&binder_lock);
+		if (target_node)
+			binder_dec_node(target_node, 1, 0);
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
 	}
-	t->buffer->allow_user_free = 0;
 	t->buffer->debug_id = t->debug_id;
-	t->buffer->transaction = t;
 	t->buffer->target_node = target_node;
-	if (target_node)
-		binder_inc_node(target_node, 1, 0, NULL);
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
 	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
+		mutex_lock(&binder_lock);
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"data ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
 	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+		mutex_lock(&binder_lock);
 		binder_user_error("binder: %d:%d got transaction with invalid "
 			"offsets ptr\n", proc->pid, thread->pid);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
+	mutex_lock(&binder_lock);
+	t->buffer->transaction = t;
+
+	if (target_proc->release_pending) {
+		return_error = BR_DEAD_REPLY;
+		goto err_dead_proc;
+	}
+	if (reply) {
+		if (in_reply_to->from != target_thread) {
+			return_error = BR_DEAD_REPLY;
+			target_thread = NULL;
+			goto err_dead_proc;
+		}
+		if (target_thread->transaction_stack != in_reply_to) {
+			return_error = BR_FAILED_REPLY;
+			in_reply_to = NULL;
+			target_thread = NULL;
+			goto err_dead_proc;
+		}
+	} else if (!(tr->flags & TF_ONE_WAY)) {
+		/* a thread on our stack may have gone meanwhile */
+		target_thread = binder_stack_target(thread, target_proc);
+	}
+	if (target_thread) {
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
+	}
+	t->to_thread = target_thread;
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1492,6 +1802,7 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 					proc->pid, thread->pid,
 					fp->binder, node->debug_id,
 					fp->cookie, node->cookie);
+				return_error = BR_FAILED_REPLY;
 				goto err_binder_get_ref_for_node_failed;
 			}
 			ref = binder_get_ref_for_node(target_proc, node);
@@ -1584,6 +1895,63 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 			fp->handle = target_fd;
 		} break;
 
+		case BINDER_TYPE_FD_REGION: {
+			struct binder_fd_region_object *rp = (void *)fp;
+			int target_fd;
+			struct file *file;
+
+			if (*offp > t->buffer->data_size - sizeof(*rp) ||
+			    t->buffer->data_size < sizeof(*rp)) {
+				binder_user_error("binder: %d:%d got transaction with "
+					"truncated fd region at %zd\n",
+					proc->pid, thread->pid, *offp);
+				return_error = BR_FAILED_REPLY;
+				goto err_bad_offset;
+			}
+			if (reply ? !(in_reply_to->flags & TF_ACCEPT_FDS) :
+			    !target_node->accept_fds) {
+				binder_user_error("binder: %d:%d got transaction with fd region, %ld, but target does not allow fds\n",
+					proc->pid, thread->pid, rp->fd);
+				return_error = BR_FAILED_REPLY;
+				goto err_fd_not_allowed;
+			}
+			if (!rp->length || (rp->offset & ~PAGE_MASK) ||
+			    rp->offset + rp->length < rp->offset) {
+				binder_user_error("binder: %d:%d got transaction with bad fd region %zd+%zd\n",
+					proc->pid, thread->pid, rp->offset, rp->length);
+				return_error = BR_FAILED_REPLY;
+				goto err_fd_not_allowed;
+			}
+
+			file = fget(rp->fd);
+			if (file == NULL) {
+				binder_user_error("binder: %d:%d got transaction with invalid fd, %ld\n",
+					proc->pid, thread->pid, rp->fd);
+				return_error = BR_FAILED_REPLY;
+				goto err_fget_failed;
+			}
+			if (!file->f_op || !file->f_op->mmap) {
+				fput(file);
+				binder_user_error("binder: %d:%d got fd region, %ld, that cannot be mapped\n",
+					proc->pid, thread->pid, rp->fd);
+				return_error = BR_FAILED_REPLY;
+				goto err_fd_not_allowed;
+			}
+			target_fd = task_get_unused_fd_flags(target_proc, O_CLOEXEC);
+			if (target_fd < 0) {
+				fput(file);
+				return_error = BR_FAILED_REPLY;
+				goto err_get_unused_fd_failed;
+			}
+			task_fd_install(target_proc, target_fd, file);
+			if (binder_debug_mask & BINDER_DEBUG_TRANSACTION)
+				printk(KERN_INFO "        fd region %ld -> %d, %zd+%zd\n",
+				       rp->fd, target_fd, rp->offset, rp->length);
+			rp->fd = target_fd;
+			rp->addr = NULL; /* filled in by the receiver */
+			t->buffer->has_fd_regions = 1;
+		} break;
+
 		default:
 			binder_user_error("binder: %d:%d got transactio"
 				"n with invalid object type, %lx\n",
@@ -1594,6 +1962,7 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 	}
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_record_service(proc, in_reply_to);
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -1609,12 +1978,14 @@ binder_transaction(struct binder_proc *proc, struct binder_thread *thread,
 		} else
 			target_node->has_async_transaction = 1;
 	}
+	t->enqueue_time = ktime_get();
 	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
 	if (target_wait)
 		wake_up_interruptible(target_wait);
+	binder_proc_dec_tmpref(target_proc);
 	return;
 
 err_get_unused_fd_failed:
@@ -1625,11 +1996,13 @@ err_binder_get_ref_failed:
 err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
+err_dead_proc:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
 err_binder_alloc_buf_failed:
+	binder_proc_dec_tmpref(target_proc);
 	kfree(tcomplete);
 	binder_stats.obj_deleted[BINDER_STAT_TRANSACTION_COMPLETE]++;
 err_alloc_tcomplete_failed:
@@ -1722,6 +2095,19 @@ binder_transaction_buffer_release(struct binder_proc *proc, struct binder_buffer
 			if (failed_at)
 				task_close_fd(proc, fp->handle);
 			break;
+		case BINDER_TYPE_FD_REGION: {
+			struct binder_fd_region_object *rp = (void *)fp;
+
+			if (*offp > buffer->data_size - sizeof(*rp) ||
+			    buffer->data_size < sizeof(*rp))
+				break;
+			if (binder_debug_mask & BINDER_DEBUG_TRANSACTION)
+				printk(KERN_INFO "        fd region %ld at %p\n",
+				       rp->fd, rp->addr);
+			/* the mapping, if any, is the receiver's to unmap */
+			if (failed_at)
+				task_close_fd(proc, rp->fd);
+		} break;
 
 		default:
 			printk(KERN_ERR "binder: transaction release %d bad object type %lx\n", debug_id, fp->type);
@@ -1909,7 +2295,15 @@ binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
+			/*
+			 * Unmapping the pages is the slow part and only
+			 * needs buffer_lock; allow_user_free keeps a second
+			 * BC_FREE_BUFFER from racing with us meanwhile.
+			 */
+			buffer->allow_user_free = 0;
+			mutex_unlock(&binder_lock);
 			binder_free_buf(proc, buffer);
+			mutex_lock(&binder_lock);
 			break;
 		}
 
@@ -2122,6 +2516,46 @@ binder_stat_br(struct binder_proc *proc, struct binder_thread *thread, uint32_t
 	}
 }
 
+/*
+ * Runs in the receiving thread as a transaction is handed to userspace, so
+ * fd regions can be mapped into current->mm. Called without binder_lock:
+ * the transaction is off the todo lists and allow_user_free is still clear,
+ * so nothing else can get at the buffer meanwhile.
+ */
+static void binder_map_fd_regions(struct binder_proc *proc,
+	struct binder_buffer *buffer)
+{
+	size_t *offp, *off_end;
+
+	offp = (size_t *)(buffer->data + ALIGN(buffer->data_size, sizeof(void *)));
+	off_end = (void *)offp + buffer->offsets_size;
+	for (; offp < off_end; offp++) {
+		struct binder_fd_region_object *rp;
+		struct file *file;
+		unsigned long addr;
+
+		rp = (struct binder_fd_region_object *)(buffer->data + *offp);
+		if (rp->type != BINDER_TYPE_FD_REGION || rp->addr)
+			continue;
+		file = fget(rp->fd);
+		if (file == NULL)
+			continue;
+		down_write(&current->mm->mmap_sem);
+		addr = do_mmap(file, 0, rp->length, PROT_READ, MAP_SHARED,
+			       rp->offset);
+		up_write(&current->mm->mmap_sem);
+		fput(file);
+		if (IS_ERR_VALUE(addr)) {
+			if (binder_debug_mask & BINDER_DEBUG_TRANSACTION)
+				printk(KERN_INFO "binder: %d: fd region %ld "
+				       "map failed %ld\n", proc->pid, rp->fd,
+				       (long)addr);
+			continue;
+		}
+		rp->addr = (void *)addr;
+	}
+}
+
 static int
 binder_has_proc_work(struct binder_proc *proc, struct binder_thread *thread)
 {
@@ -2141,6 +2575,7 @@ binder_thread_read(struct binder_proc *proc, struct binder_thread *thread,
 {
 	void __user *ptr = buffer + *consumed;
 	void __user *end = buffer + size;
+	struct binder_buffer *map_buffer = NULL;
 
 	int ret = 0;
 	int wait_for_proc_work;
@@ -2391,7 +2826,12 @@ retry:
 			       tr.data.ptr.buffer, tr.data.ptr.offsets);
 
 		list_del(&t->work.entry);
-		t->buffer->allow_user_free = 1;
+		if (t->buffer->has_fd_regions)
+			map_buffer = t->buffer;
+		else
+			t->buffer->allow_user_free = 1;
+		if (cmd == BR_TRANSACTION)
+			binder_record_dispatch(proc, t, t->buffer->target_node);
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
 			t->to_thread = thread;
@@ -2406,6 +2846,13 @@ retry:
 
 done:
 
+	if (map_buffer) {
+		mutex_unlock(&binder_lock);
+		binder_map_fd_regions(proc, map_buffer);
+		mutex_lock(&binder_lock);
+		map_buffer->allow_user_free = 1;
+	}
+
 	*consumed = ptr - buffer;
 	if (proc->requested_threads + proc->ready_threads == 0 &&
 	    proc->requested_threads_started < proc->max_threads &&
@@ -2797,6 +3244,7 @@ err_bad_arg:
 static int binder_open(struct inode *nodp, struct file *filp)
 {
 	struct binder_proc *proc;
+	int i;
 
 	if (binder_debug_mask & BINDER_DEBUG_OPEN_CLOSE)
 		printk(KERN_INFO "binder_open: %d:%d\n", current->group_leader->pid, current->pid);
@@ -2808,6 +3256,9 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
+	mutex_init(&proc->buffer_lock);
+	for (i = 0; i < BINDER_BUFFER_CLASSES; i++)
+		INIT_LIST_HEAD(&proc->buffer_classes[i]);
 	proc->default_priority = task_nice(current);
 	mutex_lock(&binder_lock);
 	binder_stats.obj_created[BINDER_STAT_PROC]++;
@@ -2878,6 +3329,14 @@ static void binder_deferred_release(struct binder_proc *proc)
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	if (proc->tmp_ref) {
+		if (binder_debug_mask & BINDER_DEBUG_OPEN_CLOSE)
+			printk(KERN_INFO "binder_release: %d has %d transactions "
+			       "in flight, postponed\n", proc->pid, proc->tmp_ref);
+		proc->release_pending = 1;
+		return;
+	}
+
 	hlist_del(&proc->proc_node);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		if (binder_debug_mask & BINDER_DEBUG_DEAD_BINDER)
@@ -2969,6 +3428,11 @@ static void binder_deferred_release(struct binder_proc *proc)
 
 	put_task_struct(proc->tsk);
 
+	binder_alloc_stats.class_hit += proc->alloc_stats.class_hit;
+	binder_alloc_stats.class_miss += proc->alloc_stats.class_miss;
+	binder_alloc_stats.page_hit += proc->alloc_stats.page_hit;
+	binder_alloc_stats.page_miss += proc->alloc_stats.page_miss;
+
 	if (binder_debug_mask & BINDER_DEBUG_OPEN_CLOSE)
 		printk(KERN_INFO "binder_release: %d threads %d, nodes %d (ref %d), refs %d, active transactions %d, buffers %d, pages %d\n",
 		       proc->pid, threads, nodes, incoming_refs, outgoing_refs, active_transactions, buffers, page_count);
@@ -3202,8 +3666,10 @@ static char *print_binder_proc(char *buf, char *end, struct binder_proc *proc, i
 		for (n = rb_first(&proc->refs_by_desc); n != NULL && buf < end; n = rb_next(n))
 			buf = print_binder_ref(buf, end, rb_entry(n, struct binder_ref, rb_node_desc));
 	}
+	mutex_lock(&proc->buffer_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL && buf < end; n = rb_next(n))
 		buf = print_binder_buffer(buf, end, "  buffer", rb_entry(n, struct binder_buffer, rb_node));
+	mutex_unlock(&proc->buffer_lock);
 	list_for_each_entry(w, &proc->todo, entry) {
 		if (buf >= end)
 			break;
@@ -3308,6 +3774,42 @@ static char *print_binder_stats(char *buf, char *end, const char *prefix, struct
 	return buf;
 }
 
+static char *print_binder_latency(char *buf, char *end, const char *prefix,
+	const char *name, struct binder_latency *lat)
+{
+	int i;
+
+	if (!lat->count)
+		return buf;
+	buf += snprintf(buf, end - buf, "%s%s: count %d avg %lluus max %uus "
+			"hist", prefix, name, lat->count,
+			div_u64(lat->total_us, lat->count), lat->max_us);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS && buf < end; i++)
+		buf += snprintf(buf, end - buf, " %d", lat->hist[i]);
+	if (buf < end)
+		buf += snprintf(buf, end - buf, "\n");
+	return buf;
+}
+
+static int binder_hit_rate(int hit, int miss)
+{
+	return hit + miss ? (int)((hit * 100LL) / (hit + miss)) : 0;
+}
+
+static char *print_binder_alloc_stats(char *buf, char *end, const char *prefix,
+	struct binder_alloc_stats *stats)
+{
+	buf += snprintf(buf, end - buf, "%sbuffer classes: hit %d miss %d "
+			"(%d%%)\n", prefix, stats->class_hit, stats->class_miss,
+			binder_hit_rate(stats->class_hit, stats->class_miss));
+	if (buf >= end)
+		return buf;
+	buf += snprintf(buf, end - buf, "%spage cache: hit %d miss %d "
+			"(%d%%)\n", prefix, stats->page_hit, stats->page_miss,
+			binder_hit_rate(stats->page_hit, stats->page_miss));
+	return buf;
+}
+
 static char *print_binder_proc_stats(char *buf, char *end, struct binder_proc *proc)
 {
 	struct binder_work *w;
@@ -3350,11 +3852,28 @@ static char *print_binder_proc_stats(char *buf, char *end, struct binder_proc *p
 		return buf;
 
 	count = 0;
+	mutex_lock(&proc->buffer_lock);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	mutex_unlock(&proc->buffer_lock);
 	buf += snprintf(buf, end - buf, "  buffers: %d\n", count);
 	if (buf >= end)
 		return buf;
+	buf += snprintf(buf, end - buf, "  cached pages: %d\n",
+			proc->pages_cached);
+	if (buf >= end)
+		return buf;
+	buf = print_binder_alloc_stats(buf, end, "  ", &proc->alloc_stats);
+	if (buf >= end)
+		return buf;
+	buf = print_binder_latency(buf, end, "  ", "dispatch latency",
+				   &proc->dispatch_lat);
+	if (buf >= end)
+		return buf;
+	buf = print_binder_latency(buf, end, "  ", "service latency",
+				   &proc->service_lat);
+	if (buf >= end)
+		return buf;
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3427,6 +3946,7 @@ static int binder_read_proc_state(
 static int binder_read_proc_stats(
 	char *page, char **start, off_t off, int count, int *eof, void *data)
 {
+	struct binder_alloc_stats alloc_stats;
 	struct binder_proc *proc;
 	struct hlist_node *pos;
 	int len = 0;
@@ -3443,6 +3963,15 @@ static int binder_read_proc_stats(
 
 	p = print_binder_stats(p, page + PAGE_SIZE, "", &binder_stats);
 
+	alloc_stats = binder_alloc_stats;
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		alloc_stats.class_hit += proc->alloc_stats.class_hit;
+		alloc_stats.class_miss += proc->alloc_stats.class_miss;
+		alloc_stats.page_hit += proc->alloc_stats.page_hit;
+		alloc_stats.page_miss += proc->alloc_stats.page_miss;
+	}
+	p = print_binder_alloc_stats(p, page + PAGE_SIZE, "", &alloc_stats);
+
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
 		if (p >= page + PAGE_SIZE)
 			break;
@@ -3502,6 +4031,73 @@ static int binder_read_proc_transactions(
 	return len < count ? len  : count;
 }
 
+static int binder_read_proc_latency(
+	char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	struct rb_node *n;
+	int len = 0;
+	char *buf = page;
+	char *end = page + PAGE_SIZE;
+	int do_lock = !binder_debug_no_lock;
+
+	if (off)
+		return 0;
+
+	if (do_lock)
+		mutex_lock(&binder_lock);
+
+	buf += snprintf(buf, end - buf, "binder latency (hist <32us <64us ... "
+			">=8ms):\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (buf >= end)
+			break;
+		if (!proc->dispatch_lat.count)
+			continue;
+		buf += snprintf(buf, end - buf, "proc %d\n", proc->pid);
+		if (buf >= end)
+			break;
+		buf = print_binder_latency(buf, end, "  ", "dispatch",
+					   &proc->dispatch_lat);
+		if (buf >= end)
+			break;
+		buf = print_binder_latency(buf, end, "  ", "service",
+					   &proc->service_lat);
+		for (n = rb_first(&proc->nodes); n != NULL && buf < end;
+		     n = rb_next(n)) {
+			struct binder_node *node = rb_entry(n,
+					struct binder_node, rb_node);
+			if (!node->dispatch_lat.count)
+				continue;
+			buf += snprintf(buf, end - buf, "  node %d: u%p c%p\n",
+					node->debug_id, node->ptr, node->cookie);
+			if (buf >= end)
+				break;
+			buf = print_binder_latency(buf, end, "    ",
+					"dispatch", &node->dispatch_lat);
+			if (buf >= end)
+				break;
+			buf = print_binder_latency(buf, end, "    ",
+					"service", &node->service_lat);
+		}
+	}
+	if (do_lock)
+		mutex_unlock(&binder_lock);
+	if (buf > page + PAGE_SIZE)
+		buf = page + PAGE_SIZE;
+
+	*start = page + off;
+
+	len = buf - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
+}
+
 static int binder_read_proc_proc(
 	char *page, char **start, off_t off, int count, int *eof, void *data)
 {
@@ -3607,6 +4203,7 @@ static int __init binder_init(void)
 		create_proc_read_entry("state", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_state, NULL);
 		create_proc_read_entry("stats", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_stats, NULL);
 		create_proc_read_entry("transactions", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_transactions, NULL);
+		create_proc_read_entry("latency", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_latency, NULL);
 		create_proc_read_entry("transaction_log", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_transaction_log, &binder_transaction_log);
 		create_proc_read_entry("failed_transaction_log", S_IRUGO, binder_proc_dir_entry_root, binder_read_proc_transaction_log, &binder_transaction_log_failed);
 	}
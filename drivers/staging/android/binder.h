@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_FD_REGION	= B_PACK_CHARS('f', 'r', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,24 @@ struct flat_binder_object {
 	void			*cookie;
 };
 
+/*
+ * A page-aligned region of an ashmem or pmem backed file, passed by
+ * reference instead of being copied into the transaction. The driver
+ * installs the fd in the receiver as for BINDER_TYPE_FD and, when the
+ * transaction is delivered, maps offset..offset+length read-only into the
+ * receiver at 'addr' (NULL if that failed, in which case the receiver can
+ * still mmap the fd itself). The mapping belongs to the receiver, which
+ * unmaps it when done with it; BC_FREE_BUFFER leaves it alone.
+ */
+struct binder_fd_region_object {
+	unsigned long		type;
+	unsigned long		flags;
+	signed long		fd;
+	void			*addr;
+	size_t			offset;
+	size_t			length;
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
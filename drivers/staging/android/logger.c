@@ -23,8 +23,11 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
 #include "logger.h"
 
+#include <asm/io.h>
 #include <asm/ioctls.h>
 
 /*
@@ -32,14 +35,16 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock'. Nothing that can sleep or fault is done under it: writers
+ * gather their payload first and readers copy out through a bounce buffer.
  */
 struct logger_log {
 	unsigned char *		buffer;	/* the ring buffer itself */
+	struct logger_mmap_header * hdr; /* page mapped ahead of the ring */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
@@ -49,12 +54,16 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. r_off is protected by log->lock, the bounce buffer
+ * by 'mutex', which serializes read() calls on the same file.
  */
 struct logger_reader {
 	struct logger_log *	log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes reads */
+	int			batch;	/* read as many entries as fit */
+	unsigned char *		bounce;	/* LOGGER_ENTRY_MAX_LEN bytes */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
@@ -87,7 +96,7 @@ static inline struct logger_log * file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -106,15 +115,13 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies exactly 'count' bytes at the reader's read head into
+ * 'buf' and advances the read head.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, struct logger_reader *reader,
+			unsigned char *buf, size_t count)
 {
 	size_t len;
 
@@ -124,20 +131,43 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the log, whichever comes first.
 	 */
 	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	memcpy(buf, log->buffer + reader->r_off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(buf + len, log->buffer, count - len);
 
 	reader->r_off = logger_offset(reader->r_off + count);
+}
+
+/*
+ * fill_bounce - moves whole entries into the reader's bounce buffer, at most
+ * 'count' bytes and just one entry unless the reader asked for batches.
+ * Returns the number of bytes moved.
+ *
+ * Caller must hold log->lock.
+ */
+static size_t fill_bounce(struct logger_log *log, struct logger_reader *reader,
+			  size_t count)
+{
+	size_t copied = 0;
+
+	count = min_t(size_t, count, LOGGER_ENTRY_MAX_LEN);
+	while (log->w_off != reader->r_off) {
+		size_t len = get_entry_len(log, reader->r_off);
 
-	return count;
+		if (copied + len > count)
+			break;
+		do_read_log(log, reader, reader->bounce + copied, len);
+		copied += len;
+		if (!reader->batch)
+			break;
+	}
+
+	return copied;
 }
 
 /*
@@ -147,10 +177,11 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or in batch mode
+ * 	  (LOGGER_SET_BATCH_READ) as many complete entries as fit in 'count'
  *
- * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
- * buffer is insufficient to hold next entry.
+ * Optimal read size is LOGGER_ENTRY_MAX_LEN, or larger in batch mode. Will
+ * set errno to EINVAL if read buffer is insufficient to hold next entry.
  */
 static ssize_t logger_read(struct file *file, char __user *buf,
 			   size_t count, loff_t *pos)
@@ -158,15 +189,16 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
 	ssize_t ret;
+	size_t copied, len;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -187,35 +219,52 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	mutex_lock(&reader->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
 	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
+		spin_unlock(&log->lock);
+		mutex_unlock(&reader->mutex);
+		return -EINVAL;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	/* the bounce buffer holds one max-sized entry, so loop for batches */
+	copied = 0;
+	for (;;) {
+		len = fill_bounce(log, reader, count - copied);
+		spin_unlock(&log->lock);
+		if (!len)
+			break;
+		if (copy_to_user(buf + copied, reader->bounce, len)) {
+			if (!copied)
+				copied = -EFAULT;
+			break;
+		}
+		copied += len;
+		if (!reader->batch)
+			break;
+		spin_lock(&log->lock);
+	}
 
-out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
-	return ret;
+	return copied;
 }
 
 /*
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -253,7 +302,7 @@ static inline int clock_interval(size_t a, size_t b, size_t c)
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -272,7 +321,7 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -289,44 +338,49 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * The mmap header follows a seqcount protocol: 'seq' is odd while the ring
+ * is being modified, so a mapped reader that sees the same even value before
+ * and after copying out entries knows they were not overwritten meanwhile.
  *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * The caller needs to hold log->lock.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static void logger_begin_update(struct logger_log *log)
 {
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
-
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
-
-	log->w_off = logger_offset(log->w_off + count);
+	log->hdr->seq++;
+	smp_wmb();
+}
 
-	return count;
+static void logger_end_update(struct logger_log *log, size_t written)
+{
+	log->hdr->w_off = log->w_off;
+	log->hdr->head = log->head;
+	log->hdr->written += written;
+	smp_wmb();
+	log->hdr->seq++;
 }
 
+/* payloads up to this size are gathered on the stack */
+#define LOGGER_FAST_PAYLOAD	256
+
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is gathered from userspace before log->lock is taken, so the
+ * lock only covers the copy into the ring and never sleeps. Typical log lines
+ * use a buffer on the stack; only large entries allocate one.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
-	ssize_t ret = 0;
+	char stack_payload[LOGGER_FAST_PAYLOAD];
+	char *payload = stack_payload;
+	size_t copied = 0;
+	ssize_t ret;
 
 	now = current_kernel_time();
 
@@ -340,42 +394,51 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	if (unlikely(header.len > sizeof(stack_payload))) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
+	}
+
+	while (nr_segs-- > 0 && copied < header.len) {
+		/* figure out how much of this vector we can keep */
+		size_t len = min_t(size_t, iov->iov_len, header.len - copied);
+
+		if (unlikely(copy_from_user(payload + copied, iov->iov_base,
+					    len))) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		iov++;
+		copied += len;
+	}
+	header.len = copied;
+
+	spin_lock(&log->lock);
+
+	logger_begin_update(log);
 
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * entry after (what will be) the new write offset.
 	 */
 	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
 
 	do_write_log(log, &header, sizeof(struct logger_entry));
+	do_write_log(log, payload, header.len);
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+	logger_end_update(log, sizeof(struct logger_entry) + header.len);
 
-		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
-
-		iov++;
-		ret += nr;
-	}
-
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
+	ret = header.len;
+out:
+	if (payload != stack_payload)
+		kfree(payload);
 	return ret;
 }
 
@@ -405,14 +468,21 @@ static int logger_open(struct inode *inode, struct file *file)
 		reader = kmalloc(sizeof(struct logger_reader), GFP_KERNEL);
 		if (!reader)
 			return -ENOMEM;
+		reader->bounce = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->bounce) {
+			kfree(reader);
+			return -ENOMEM;
+		}
 
 		reader->log = log;
+		reader->batch = 0;
+		mutex_init(&reader->mutex);
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -430,7 +500,12 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
+		kfree(reader->bounce);
 		kfree(reader);
 	}
 
@@ -460,10 +535,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -474,7 +549,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -507,15 +582,64 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
+		logger_begin_update(log);
 		list_for_each_entry(reader, &log->readers, list)
 			reader->r_off = log->w_off;
 		log->head = log->w_off;
+		logger_end_update(log, 0);
+		ret = 0;
+		break;
+	case LOGGER_SET_BATCH_READ:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->batch = !!arg;
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
+/*
+ * logger_pfn - the page frame of a log page. The logs are static, so when
+ * the driver is a module they are in module space, outside the linear map.
+ */
+static unsigned long logger_pfn(void *addr)
+{
+	if (virt_addr_valid(addr))
+		return virt_to_phys(addr) >> PAGE_SHIFT;
+	return vmalloc_to_pfn(addr);
+}
+
+/*
+ * logger_mmap - maps the log read-only: one page holding the
+ * logger_mmap_header, followed by the ring itself
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(file);
+	unsigned long off;
+	int ret;
 
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE + log->size)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	ret = remap_pfn_range(vma, vma->vm_start, logger_pfn(log->hdr),
+			      PAGE_SIZE, vma->vm_page_prot);
+	for (off = 0; !ret && off < log->size; off += PAGE_SIZE)
+		ret = remap_pfn_range(vma, vma->vm_start + PAGE_SIZE + off,
+				      logger_pfn(log->buffer + off),
+				      PAGE_SIZE, vma->vm_page_prot);
 	return ret;
 }
 
@@ -524,6 +648,7 @@ static struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
@@ -532,13 +657,22 @@ static struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * must be a power of two, at least PAGE_SIZE, greater than
+ * LOGGER_ENTRY_MAX_LEN, and less than LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * The ring and its header are page aligned and padded so that they can be
+ * mapped into userspace without exposing anything else.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
+static union { \
+	struct logger_mmap_header hdr; \
+	unsigned char pad[PAGE_SIZE]; \
+} _hdr_ ## VAR __aligned(PAGE_SIZE) = { \
+	.hdr = { .size = SIZE }, \
+}; \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
+	.hdr = &_hdr_ ## VAR .hdr, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -547,7 +681,7 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
@@ -30,6 +30,20 @@ struct logger_entry {
 	char		msg[0];	/* the entry's payload */
 };
 
+/*
+ * struct logger_mmap_header - first page of a log mapped with mmap(), the ring
+ * follows it. Entries live between 'head' and 'w_off'. 'seq' is odd while the
+ * writer is modifying the ring: sample it (even) before copying entries out
+ * and compare afterwards to detect that they were overwritten meanwhile.
+ */
+struct logger_mmap_header {
+	__u32		seq;	/* update sequence count */
+	__u32		size;	/* size of the ring, a power of two */
+	__u32		w_off;	/* where the next entry will be written */
+	__u32		head;	/* oldest entry still in the ring */
+	__u64		written; /* total bytes ever written */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_MAIN		"log_main"	/* everything else */
@@ -44,5 +58,6 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_BATCH_READ		_IO(__LOGGERIO, 5) /* read() many */
 
 #endif /* _LINUX_LOGGER_H */
@@ -18,6 +18,9 @@
 #include <linux/mm.h>
 #include <linux/oom.h>
 #include <linux/sched.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask);
 
@@ -48,13 +51,78 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size, S_IRUGO | S_IWU
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size, S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
 
+/*
+ * Processes indexed by oom_adj, so that picking a victim only looks at the
+ * buckets at or above min_adj instead of every task in the system. Entries
+ * are removed in __unhash_process() with tasklist_lock write-held, so
+ * holding it for reading keeps indexed tasks alive.
+ */
+#define LOWMEM_BUCKETS (OOM_ADJUST_MAX - OOM_DISABLE + 1)
+static struct hlist_head lowmem_index[LOWMEM_BUCKETS];
+static DEFINE_SPINLOCK(lowmem_index_lock);
+
+/* victim we are waiting on to exit, only compared, never dereferenced */
+static struct task_struct *lowmem_deathpending;
+static unsigned long lowmem_deathpending_timeout;
+
+/* log2 buckets: < 8us, < 16us, ..., >= 4ms */
+#define LOWMEM_LATENCY_BUCKETS 11
+
+static struct {
+	unsigned int kills[LOWMEM_BUCKETS];
+	unsigned int pending_skips;
+	unsigned int selections;
+	unsigned int select_max_us;
+	u64 select_total_us;
+	unsigned int select_hist[LOWMEM_LATENCY_BUCKETS];
+} lowmem_stats;
+
+void lowmem_task_update(struct task_struct *p)
+{
+	spin_lock(&lowmem_index_lock);
+	hlist_del_init(&p->lowmem_node);
+	if (thread_group_leader(p) && !p->exit_state)
+		hlist_add_head(&p->lowmem_node,
+			       &lowmem_index[p->oomkilladj - OOM_DISABLE]);
+	spin_unlock(&lowmem_index_lock);
+}
+
+void lowmem_task_remove(struct task_struct *p)
+{
+	spin_lock(&lowmem_index_lock);
+	hlist_del_init(&p->lowmem_node);
+	if (p == lowmem_deathpending)
+		lowmem_deathpending = NULL;
+	spin_unlock(&lowmem_index_lock);
+}
+
+static void lowmem_account_selection(s64 us)
+{
+	int bucket;
+
+	if (us < 0)
+		us = 0;
+	if (us > UINT_MAX)
+		us = UINT_MAX;
+	bucket = us < 8 ? 0 : fls((unsigned int)us >> 3);
+	if (bucket >= LOWMEM_LATENCY_BUCKETS)
+		bucket = LOWMEM_LATENCY_BUCKETS - 1;
+	lowmem_stats.select_hist[bucket]++;
+	lowmem_stats.selections++;
+	lowmem_stats.select_total_us += us;
+	if (us > lowmem_stats.select_max_us)
+		lowmem_stats.select_max_us = us;
+}
+
 static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 {
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
+	struct hlist_node *pos;
+	ktime_t start;
 	int rem = 0;
 	int tasksize;
-	int i;
+	int i, adj;
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
 	int array_size = ARRAY_SIZE(lowmem_adj);
@@ -83,24 +151,43 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	}
 
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		if (p->oomkilladj < min_adj || !p->mm)
-			continue;
-		tasksize = get_mm_rss(p->mm);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (p->oomkilladj < selected->oomkilladj)
+	spin_lock(&lowmem_index_lock);
+	if (lowmem_deathpending &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		/* the last victim is still on its way out */
+		lowmem_stats.pending_skips++;
+		spin_unlock(&lowmem_index_lock);
+		read_unlock(&tasklist_lock);
+		return rem;
+	}
+	start = ktime_get();
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		hlist_for_each_entry(p, pos, &lowmem_index[adj - OOM_DISABLE],
+				     lowmem_node) {
+			task_lock(p);
+			if (!p->mm) {
+				task_unlock(p);
 				continue;
-			if (p->oomkilladj == selected->oomkilladj &&
-			    tasksize <= selected_tasksize)
+			}
+			tasksize = get_mm_rss(p->mm);
+			task_unlock(p);
+			if (tasksize <= 0)
 				continue;
+			if (selected && tasksize <= selected_tasksize)
+				continue;
+			selected = p;
+			selected_tasksize = tasksize;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+			             p->pid, p->comm, p->oomkilladj, tasksize);
 		}
-		selected = p;
-		selected_tasksize = tasksize;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-		             p->pid, p->comm, p->oomkilladj, tasksize);
 	}
+	lowmem_account_selection(ktime_us_delta(ktime_get(), start));
+	if (selected != NULL) {
+		lowmem_stats.kills[selected->oomkilladj - OOM_DISABLE]++;
+		lowmem_deathpending = selected;
+		lowmem_deathpending_timeout = jiffies + HZ;
+	}
+	spin_unlock(&lowmem_index_lock);
 	if(selected != NULL) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 		             selected->pid, selected->comm,
@@ -113,9 +200,60 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	return rem;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int lowmem_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned int selections;
+	int i;
+
+	spin_lock(&lowmem_index_lock);
+	seq_printf(s, "oom_adj kills\n");
+	for (i = 0; i < LOWMEM_BUCKETS; i++)
+		if (lowmem_stats.kills[i])
+			seq_printf(s, "%7d %u\n", i + OOM_DISABLE,
+				   lowmem_stats.kills[i]);
+	seq_printf(s, "pending kill skips: %u\n", lowmem_stats.pending_skips);
+	selections = lowmem_stats.selections;
+	seq_printf(s, "selections: %u avg %lluus max %uus\n", selections,
+		   selections ?
+		   div_u64(lowmem_stats.select_total_us, selections) : 0ULL,
+		   lowmem_stats.select_max_us);
+	seq_printf(s, "selection latency (<8us <16us ... >=4ms):");
+	for (i = 0; i < LOWMEM_LATENCY_BUCKETS; i++)
+		seq_printf(s, " %u", lowmem_stats.select_hist[i]);
+	seq_printf(s, "\n");
+	spin_unlock(&lowmem_index_lock);
+	return 0;
+}
+
+static int lowmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lowmem_stats_show, NULL);
+}
+
+static const struct file_operations lowmem_stats_fops = {
+	.open		= lowmem_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int __init lowmem_init(void)
 {
+	struct task_struct *p;
+
+	/* index whatever is already running */
+	read_lock(&tasklist_lock);
+	for_each_process(p)
+		lowmem_task_update(p);
+	read_unlock(&tasklist_lock);
+
 	register_shrinker(&lowmem_shrinker);
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("lowmemorykiller", S_IRUGO, NULL, NULL,
+			    &lowmem_stats_fops);
+#endif
 	return 0;
 }
 
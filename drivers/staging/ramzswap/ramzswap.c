@@ -0,0 +1,557 @@
+/*
+ * drivers/staging/ramzswap/ramzswap.c
+ *
+ * Compressed RAM based swap device.
+ *
+ * Pages written to the device are compressed with LZO and kept in memory,
+ * so that anonymous memory of background applications can be squeezed
+ * instead of the application being killed. Compressed pages are kept in a
+ * set of size class caches, one per RZS_CLASS_DELTA bytes, which wastes far
+ * less than rounding every object up to a power of two as kmalloc would.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/init.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/lzo.h>
+#include <linux/hrtimer.h>
+#include <linux/swap.h>
+#include <linux/string.h>
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+
+/*
+ * Compressed sizes are rounded up to RZS_CLASS_DELTA. Pages that do not
+ * compress below RZS_MAX_CLASS are stored as they are, in a page of their
+ * own: decompressing them would cost time and save next to nothing.
+ */
+#define RZS_CLASS_DELTA		128
+#define RZS_MAX_CLASS		(PAGE_SIZE / 4 * 3)
+#define RZS_NR_CLASSES		(RZS_MAX_CLASS / RZS_CLASS_DELTA)
+
+/* table entry flags */
+#define RZS_ZERO		0x01	/* page is all zeroes, nothing stored */
+#define RZS_UNCOMPRESSED	0x02	/* 'data' is a struct page */
+
+struct rzs_entry {
+	void		*data;
+	u16		len;		/* compressed length */
+	u8		flags;
+};
+
+struct rzs_stats {
+	u64		num_reads;
+	u64		num_writes;
+	u64		failed_reads;
+	u64		failed_writes;
+	u64		discards;
+	u64		pages_zero;	/* zero filled pages */
+	u64		pages_stored;	/* compressed pages */
+	u64		pages_expand;	/* pages stored uncompressed */
+	u64		compr_size;	/* sum of compressed lengths */
+	u64		mem_used;	/* including class rounding */
+	u64		compr_count;
+	u64		compr_total_ns;
+	u64		compr_max_ns;
+};
+
+struct ramzswap {
+	struct request_queue	*queue;
+	struct gendisk		*disk;
+
+	/*
+	 * The lock covers the table, the stats and the compression buffers.
+	 * Swap I/O is issued a page at a time from reclaim, and the boxer has
+	 * a single core, so there is little to gain from finer locking.
+	 */
+	struct mutex		lock;
+	struct rzs_entry	*table;
+	size_t			nr_pages;
+	void			*workmem;
+	void			*compress_buf;
+	struct rzs_stats	stats;
+};
+
+static int rzs_major;
+static struct ramzswap *rzs;
+static struct kmem_cache *rzs_class_cache[RZS_NR_CLASSES];
+static char rzs_class_name[RZS_NR_CLASSES][24];
+
+static unsigned long disksize_kb;
+module_param(disksize_kb, ulong, 0444);
+MODULE_PARM_DESC(disksize_kb, "Device size in kB (default: 25% of RAM)");
+
+static int rzs_class(size_t len)
+{
+	return (len - 1) / RZS_CLASS_DELTA;
+}
+
+static void rzs_free_entry(struct ramzswap *rzs, size_t index)
+{
+	struct rzs_entry *e = &rzs->table[index];
+
+	if (e->flags & RZS_ZERO) {
+		rzs->stats.pages_zero--;
+	} else if (e->flags & RZS_UNCOMPRESSED) {
+		__free_page(e->data);
+		rzs->stats.pages_expand--;
+		rzs->stats.mem_used -= PAGE_SIZE;
+	} else if (e->data) {
+		int class = rzs_class(e->len);
+
+		kmem_cache_free(rzs_class_cache[class], e->data);
+		rzs->stats.pages_stored--;
+		rzs->stats.compr_size -= e->len;
+		rzs->stats.mem_used -= (class + 1) * RZS_CLASS_DELTA;
+	}
+
+	e->data = NULL;
+	e->len = 0;
+	e->flags = 0;
+}
+
+static int rzs_page_zero_filled(void *ptr)
+{
+	unsigned long *p = ptr;
+	unsigned int pos;
+
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*p); pos++)
+		if (p[pos])
+			return 0;
+
+	return 1;
+}
+
+static int rzs_read_page(struct ramzswap *rzs, struct page *page, size_t index)
+{
+	struct rzs_entry *e = &rzs->table[index];
+	unsigned char *dst, *src;
+	size_t out_len = PAGE_SIZE;
+	int ret = 0;
+
+	dst = kmap_atomic(page, KM_USER0);
+	if (!e->data) {
+		/* never written or zero filled */
+		memset(dst, 0, PAGE_SIZE);
+	} else if (e->flags & RZS_UNCOMPRESSED) {
+		src = kmap_atomic(e->data, KM_USER1);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER1);
+	} else {
+		ret = lzo1x_decompress_safe(e->data, e->len, dst, &out_len);
+		if (ret != LZO_E_OK || out_len != PAGE_SIZE) {
+			printk(KERN_ERR "ramzswap: decompression of page %zu "
+			       "failed: %d\n", index, ret);
+			ret = -EIO;
+		}
+	}
+	kunmap_atomic(dst, KM_USER0);
+	flush_dcache_page(page);
+
+	return ret;
+}
+
+static int rzs_write_page(struct ramzswap *rzs, struct page *page, size_t index)
+{
+	struct rzs_entry *e = &rzs->table[index];
+	unsigned char *src, *dst;
+	size_t clen = 0;
+	ktime_t start;
+	u64 ns;
+	int class, ret;
+
+	/* the slot is being overwritten, drop what it held */
+	rzs_free_entry(rzs, index);
+
+	src = kmap_atomic(page, KM_USER0);
+	if (rzs_page_zero_filled(src)) {
+		kunmap_atomic(src, KM_USER0);
+		e->flags = RZS_ZERO;
+		rzs->stats.pages_zero++;
+		return 0;
+	}
+
+	start = ktime_get();
+	ret = lzo1x_1_compress(src, PAGE_SIZE, rzs->compress_buf, &clen,
+			       rzs->workmem);
+	kunmap_atomic(src, KM_USER0);
+	if (unlikely(ret != LZO_E_OK)) {
+		printk(KERN_ERR "ramzswap: compression of page %zu failed: %d\n",
+		       index, ret);
+		return -EIO;
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	rzs->stats.compr_count++;
+	rzs->stats.compr_total_ns += ns;
+	if (ns > rzs->stats.compr_max_ns)
+		rzs->stats.compr_max_ns = ns;
+
+	if (clen > RZS_MAX_CLASS) {
+		struct page *copy = alloc_page(GFP_NOIO | __GFP_HIGHMEM |
+					       __GFP_NOWARN);
+
+		if (!copy)
+			return -ENOMEM;
+		src = kmap_atomic(page, KM_USER0);
+		dst = kmap_atomic(copy, KM_USER1);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(dst, KM_USER1);
+		kunmap_atomic(src, KM_USER0);
+
+		e->data = copy;
+		e->flags = RZS_UNCOMPRESSED;
+		rzs->stats.pages_expand++;
+		rzs->stats.mem_used += PAGE_SIZE;
+		return 0;
+	}
+
+	/*
+	 * We are writing out memory to make room, don't recurse into I/O and
+	 * let the caller fail the write if even the reserves are exhausted:
+	 * swap will just try another page.
+	 */
+	class = rzs_class(clen);
+	dst = kmem_cache_alloc(rzs_class_cache[class], GFP_NOIO | __GFP_NOWARN);
+	if (!dst)
+		return -ENOMEM;
+	memcpy(dst, rzs->compress_buf, clen);
+
+	e->data = dst;
+	e->len = clen;
+	rzs->stats.pages_stored++;
+	rzs->stats.compr_size += clen;
+	rzs->stats.mem_used += (class + 1) * RZS_CLASS_DELTA;
+
+	return 0;
+}
+
+static void rzs_discard(struct ramzswap *rzs, struct bio *bio)
+{
+	size_t index = bio->bi_sector >> PAGE_SECTORS_SHIFT;
+	size_t count = bio->bi_size >> PAGE_SHIFT;
+
+	/* only whole pages can be dropped */
+	if (bio->bi_sector & ((1 << PAGE_SECTORS_SHIFT) - 1)) {
+		index++;
+		if (count)
+			count--;
+	}
+
+	mutex_lock(&rzs->lock);
+	while (count--)
+		rzs_free_entry(rzs, index++);
+	rzs->stats.discards++;
+	mutex_unlock(&rzs->lock);
+}
+
+static int rzs_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct ramzswap *rzs = q->queuedata;
+	struct bio_vec *bvec;
+	size_t index;
+	int i, rw, err = 0;
+
+	if (bio->bi_sector + (bio->bi_size >> SECTOR_SHIFT) >
+	    get_capacity(rzs->disk)) {
+		bio_io_error(bio);
+		return 0;
+	}
+
+	if (bio_discard(bio)) {
+		rzs_discard(rzs, bio);
+		bio_endio(bio, 0);
+		return 0;
+	}
+
+	/* swap only ever does page sized, page aligned I/O */
+	if (bio->bi_sector & ((1 << PAGE_SECTORS_SHIFT) - 1)) {
+		bio_io_error(bio);
+		return 0;
+	}
+
+	rw = bio_rw(bio);
+	if (rw == READA)
+		rw = READ;
+	index = bio->bi_sector >> PAGE_SECTORS_SHIFT;
+
+	mutex_lock(&rzs->lock);
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvec->bv_offset || bvec->bv_len != PAGE_SIZE) {
+			err = -EIO;
+			break;
+		}
+		if (rw == READ) {
+			rzs->stats.num_reads++;
+			err = rzs_read_page(rzs, bvec->bv_page, index);
+			if (err)
+				rzs->stats.failed_reads++;
+		} else {
+			rzs->stats.num_writes++;
+			err = rzs_write_page(rzs, bvec->bv_page, index);
+			if (err)
+				rzs->stats.failed_writes++;
+		}
+		if (err)
+			break;
+		index++;
+	}
+	mutex_unlock(&rzs->lock);
+
+	bio_endio(bio, err ? -EIO : 0);
+
+	return 0;
+}
+
+/* discards are handled in rzs_make_request, there are no requests */
+static int rzs_prepare_discard(struct request_queue *q, struct request *req)
+{
+	return 0;
+}
+
+static struct block_device_operations rzs_fops = {
+	.owner		= THIS_MODULE,
+};
+
+/*
+ * sysfs statistics, in /sys/block/ramzswap0/
+ */
+
+static struct ramzswap *dev_to_rzs(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+#define RZS_STAT_ATTR(_name, _expr)					\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct ramzswap *rzs = dev_to_rzs(dev);				\
+	u64 val;							\
+									\
+	mutex_lock(&rzs->lock);						\
+	val = (_expr);							\
+	mutex_unlock(&rzs->lock);					\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static DEVICE_ATTR(_name, S_IRUGO, _name##_show, NULL)
+
+RZS_STAT_ATTR(disksize, (u64)rzs->nr_pages << PAGE_SHIFT);
+RZS_STAT_ATTR(num_reads, rzs->stats.num_reads);
+RZS_STAT_ATTR(num_writes, rzs->stats.num_writes);
+RZS_STAT_ATTR(failed_reads, rzs->stats.failed_reads);
+RZS_STAT_ATTR(failed_writes, rzs->stats.failed_writes);
+RZS_STAT_ATTR(discards, rzs->stats.discards);
+RZS_STAT_ATTR(pages_zero, rzs->stats.pages_zero);
+RZS_STAT_ATTR(pages_stored, rzs->stats.pages_stored);
+RZS_STAT_ATTR(pages_expand, rzs->stats.pages_expand);
+RZS_STAT_ATTR(orig_data_size, (rzs->stats.pages_stored +
+			       rzs->stats.pages_expand) << PAGE_SHIFT);
+RZS_STAT_ATTR(compr_data_size, rzs->stats.compr_size +
+			       (rzs->stats.pages_expand << PAGE_SHIFT));
+RZS_STAT_ATTR(mem_used_total, rzs->stats.mem_used);
+RZS_STAT_ATTR(compr_lat_avg_ns, rzs->stats.compr_count ?
+	      div64_u64(rzs->stats.compr_total_ns, rzs->stats.compr_count) : 0);
+RZS_STAT_ATTR(compr_lat_max_ns, rzs->stats.compr_max_ns);
+
+/* original size over memory used, as a percentage with two decimals */
+static ssize_t compr_ratio_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct ramzswap *rzs = dev_to_rzs(dev);
+	u64 orig, used, ratio = 0;
+
+	mutex_lock(&rzs->lock);
+	orig = (rzs->stats.pages_stored + rzs->stats.pages_expand +
+		rzs->stats.pages_zero) << PAGE_SHIFT;
+	used = rzs->stats.mem_used;
+	mutex_unlock(&rzs->lock);
+
+	if (used)
+		ratio = div64_u64(orig * 10000, used);
+	return sprintf(buf, "%llu.%02llu\n", (unsigned long long)ratio / 100,
+		       (unsigned long long)ratio % 100);
+}
+static DEVICE_ATTR(compr_ratio, S_IRUGO, compr_ratio_show, NULL);
+
+static struct attribute *rzs_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_failed_reads.attr,
+	&dev_attr_failed_writes.attr,
+	&dev_attr_discards.attr,
+	&dev_attr_pages_zero.attr,
+	&dev_attr_pages_stored.attr,
+	&dev_attr_pages_expand.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	&dev_attr_compr_ratio.attr,
+	&dev_attr_compr_lat_avg_ns.attr,
+	&dev_attr_compr_lat_max_ns.attr,
+	NULL,
+};
+
+static struct attribute_group rzs_attr_group = {
+	.attrs = rzs_attrs,
+};
+
+static void rzs_destroy_classes(void)
+{
+	int i;
+
+	for (i = 0; i < RZS_NR_CLASSES; i++) {
+		if (rzs_class_cache[i])
+			kmem_cache_destroy(rzs_class_cache[i]);
+		rzs_class_cache[i] = NULL;
+	}
+}
+
+static int __init rzs_create_classes(void)
+{
+	int i;
+
+	for (i = 0; i < RZS_NR_CLASSES; i++) {
+		size_t size = (i + 1) * RZS_CLASS_DELTA;
+
+		snprintf(rzs_class_name[i], sizeof(rzs_class_name[i]),
+			 "ramzswap-%zu", size);
+		rzs_class_cache[i] = kmem_cache_create(rzs_class_name[i], size,
+						       0, 0, NULL);
+		if (!rzs_class_cache[i]) {
+			rzs_destroy_classes();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void rzs_free_device(struct ramzswap *rzs)
+{
+	size_t index;
+
+	if (rzs->table) {
+		for (index = 0; index < rzs->nr_pages; index++)
+			rzs_free_entry(rzs, index);
+		vfree(rzs->table);
+	}
+	free_pages((unsigned long)rzs->compress_buf, 1);
+	kfree(rzs->workmem);
+	if (rzs->queue)
+		blk_cleanup_queue(rzs->queue);
+	kfree(rzs);
+}
+
+static int __init rzs_init(void)
+{
+	struct gendisk *disk;
+	int ret = -ENOMEM;
+
+	if (!disksize_kb)
+		disksize_kb = (totalram_pages << PAGE_SHIFT) / 4 / 1024;
+	if (disksize_kb < PAGE_SIZE / 1024)
+		return -EINVAL;
+
+	ret = rzs_create_classes();
+	if (ret)
+		return ret;
+
+	ret = -ENOMEM;
+	rzs = kzalloc(sizeof(*rzs), GFP_KERNEL);
+	if (!rzs)
+		goto err_classes;
+	mutex_init(&rzs->lock);
+
+	rzs->nr_pages = disksize_kb / (PAGE_SIZE / 1024);
+	rzs->table = vmalloc(rzs->nr_pages * sizeof(*rzs->table));
+	if (!rzs->table)
+		goto err_dev;
+	memset(rzs->table, 0, rzs->nr_pages * sizeof(*rzs->table));
+
+	/* lzo1x_worst_compress(PAGE_SIZE) does not fit in a single page */
+	rzs->compress_buf = (void *)__get_free_pages(GFP_KERNEL, 1);
+	rzs->workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	if (!rzs->compress_buf || !rzs->workmem)
+		goto err_dev;
+
+	rzs->queue = blk_alloc_queue(GFP_KERNEL);
+	if (!rzs->queue)
+		goto err_dev;
+	rzs->queue->queuedata = rzs;
+	blk_queue_make_request(rzs->queue, rzs_make_request);
+	blk_queue_hardsect_size(rzs->queue, PAGE_SIZE);
+	blk_queue_set_discard(rzs->queue, rzs_prepare_discard);
+	blk_queue_bounce_limit(rzs->queue, BLK_BOUNCE_ANY);
+
+	rzs_major = register_blkdev(0, "ramzswap");
+	if (rzs_major < 0) {
+		ret = rzs_major;
+		goto err_dev;
+	}
+
+	disk = rzs->disk = alloc_disk(1);
+	if (!disk)
+		goto err_blkdev;
+	disk->major		= rzs_major;
+	disk->first_minor	= 0;
+	disk->fops		= &rzs_fops;
+	disk->private_data	= rzs;
+	disk->queue		= rzs->queue;
+	disk->flags |= GENHD_FL_SUPPRESS_PARTITION_INFO;
+	strcpy(disk->disk_name, "ramzswap0");
+	set_capacity(disk, (sector_t)rzs->nr_pages << PAGE_SECTORS_SHIFT);
+	add_disk(disk);
+
+	ret = sysfs_create_group(&disk_to_dev(disk)->kobj, &rzs_attr_group);
+	if (ret)
+		printk(KERN_WARNING "ramzswap: failed to create sysfs "
+		       "attributes: %d\n", ret);
+
+	printk(KERN_INFO "ramzswap: %lu kB device, %d size classes\n",
+	       disksize_kb, RZS_NR_CLASSES);
+
+	return 0;
+
+err_blkdev:
+	unregister_blkdev(rzs_major, "ramzswap");
+err_dev:
+	rzs_free_device(rzs);
+err_classes:
+	rzs_destroy_classes();
+	return ret;
+}
+
+static void __exit rzs_exit(void)
+{
+	sysfs_remove_group(&disk_to_dev(rzs->disk)->kobj, &rzs_attr_group);
+	del_gendisk(rzs->disk);
+	put_disk(rzs->disk);
+	unregister_blkdev(rzs_major, "ramzswap");
+	rzs_free_device(rzs);
+	rzs_destroy_classes();
+}
+
+module_init(rzs_init);
+module_exit(rzs_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed RAM based swap device");
@@ -1061,6 +1061,7 @@ static ssize_t oom_adjust_write(struct file *file, const char __user *buf,
 		return -EACCES;
 	}
 	task->oomkilladj = oom_adjust;
+	lowmem_task_update(task);
 	put_task_struct(task);
 	if (end - buffer == 0)
 		return -EIO;
@@ -46,6 +46,10 @@
 /* Meaning: set the count of blocks to reserve for checkpointing */
 #define CONFIG_YAFFS_CHECKPOINT_RESERVED_BLOCKS 10
 
+/* Default: Selected */
+/* Meaning: Keep a summary of its tags in the last chunk of each block */
+#define CONFIG_YAFFS_BLOCK_SUMMARY
+
 /*
 Older-style on-NAND data format has a "pageStatus" byte to record
 chunk/page state.  This byte is zeroed when the page is discarded.
@@ -1933,6 +1933,8 @@ typedef struct {
 	int no_cache;
 	int empty_lost_and_found_overridden;
 	int empty_lost_and_found;
+	int block_summary_overridden;
+	int block_summary;
 } yaffs_options;
 
 #define MAX_OPT_LEN 20
@@ -1976,6 +1978,12 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-enable")) {
 			options->empty_lost_and_found = 1;
 			options->empty_lost_and_found_overridden = 1;
+		} else if (!strcmp(cur_opt, "summary-disable")) {
+			options->block_summary = 0;
+			options->block_summary_overridden = 1;
+		} else if (!strcmp(cur_opt, "summary-enable")) {
+			options->block_summary = 1;
+			options->block_summary_overridden = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 					cur_opt);
@@ -2082,12 +2090,6 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 #endif
 
 
-#ifdef CONFIG_YAFFS_EMPTY_LOST_AND_FOUND
-	dev->emptyLostAndFound = 1;
-#endif
-	if(options.empty_lost_and_found_overridden)
-		dev->emptyLostAndFound = options.empty_lost_and_found;
-
 #ifdef CONFIG_YAFFS_AUTO_YAFFS2
 
 	if (yaffsVersion == 1 && WRITE_SIZE(mtd) >= 2048) {
@@ -2247,6 +2249,18 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->skipCheckpointRead = options.skip_checkpoint_read;
 	dev->skipCheckpointWrite = options.skip_checkpoint_write;
 
+#ifdef CONFIG_YAFFS_EMPTY_LOST_AND_FOUND
+	dev->emptyLostAndFound = 1;
+#endif
+	if(options.empty_lost_and_found_overridden)
+		dev->emptyLostAndFound = options.empty_lost_and_found;
+
+#ifdef CONFIG_YAFFS_BLOCK_SUMMARY
+	dev->useBlockSummary = 1;
+#endif
+	if (options.block_summary_overridden)
+		dev->useBlockSummary = options.block_summary;
+
 	/* we assume this is protected by lock_kernel() in mount/umount */
 	ylist_add_tail(&dev->devList, &yaffs_dev_list);
 
@@ -2432,6 +2446,8 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "useNANDECC......... %d\n", dev->useNANDECC);
 	buf += sprintf(buf, "isYaffs2........... %d\n", dev->isYaffs2);
 	buf += sprintf(buf, "inbandTags......... %d\n", dev->inbandTags);
+	buf += sprintf(buf, "blockSummary....... %d\n", dev->summaryChunks);
+	buf += sprintf(buf, "nSummaryScans...... %d\n", dev->nSummaryScans);
 
 	return buf;
 }
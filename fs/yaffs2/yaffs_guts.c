@@ -88,6 +88,9 @@ static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
 static int yaffs_AllocateChunk(yaffs_Device *dev, int useReserve,
 				yaffs_BlockInfo **blockUsedPtr);
 
+static void yaffs_SummaryAdd(yaffs_Device *dev, const yaffs_ExtendedTags *tags,
+				int chunkInNAND);
+
 static void yaffs_VerifyFreeChunks(yaffs_Device *dev);
 
 static void yaffs_CheckObjectDetailsLoaded(yaffs_Object *in);
@@ -994,6 +997,8 @@ static int yaffs_WriteNewChunkWithTagsToNAND(struct yaffs_DeviceStruct *dev,
 		/* Copy the data into the robustification buffer */
 		yaffs_HandleWriteChunkOk(dev, chunk, data, tags);
 
+		yaffs_SummaryAdd(dev, tags, chunk);
+
 	} while (writeOk != YAFFS_OK &&
 		(yaffs_wr_attempts <= 0 || attempts <= yaffs_wr_attempts));
 
@@ -1102,6 +1107,220 @@ static void yaffs_HandleWriteChunkError(yaffs_Device *dev, int chunkInNAND,
 	yaffs_DeleteChunk(dev, chunkInNAND, 1, __LINE__);
 }
 
+/*---------------- Block summary functions ------------
+ *
+ * When the summary is on, the last chunk of each block is not allocated.
+ * The tags of the other chunks are gathered as they are written, and once
+ * the last of them is written they go into the last chunk. The summary
+ * chunk belongs to no object but counts as in use, from the time the block
+ * is full whether or not the summary gets written, as that space can only
+ * come back when the block is garbage collected. gc frees it, it is never
+ * copied.
+ *
+ * A scan takes the tags of a full block from its summary if it has a valid
+ * one, and reads the tags of each chunk otherwise, e.g. for blocks written
+ * without the summary or when the summary write did not complete.
+ */
+
+static __u32 yaffs_SummarySum(const __u8 *buffer, int nBytes)
+{
+	const __u32 *p = (const __u32 *)buffer;
+	__u32 sum = 0;
+	int i;
+
+	for (i = 0; i < nBytes / 4; i++)
+		sum = ((sum << 1) | (sum >> 31)) + p[i];
+
+	return sum;
+}
+
+static int yaffs_SummaryBytes(yaffs_Device *dev)
+{
+	return sizeof(yaffs_SummaryHeader) +
+		(dev->nChunksPerBlock - dev->summaryChunks) *
+		sizeof(yaffs_SummaryTags);
+}
+
+static void yaffs_SummaryStore(yaffs_Device *dev, int c,
+				const yaffs_ExtendedTags *tags)
+{
+	yaffs_PackedTags2TagsPart pt;
+
+	yaffs_PackTags2TagsPart(&pt, tags);
+	dev->sumTags[c].objectId = pt.objectId;
+	dev->sumTags[c].chunkId = pt.chunkId;
+	dev->sumTags[c].byteCount = pt.byteCount;
+}
+
+static void yaffs_SummaryWrite(yaffs_Device *dev, int blk)
+{
+	yaffs_BlockInfo *bi = yaffs_GetBlockInfo(dev, blk);
+	int nChunks = dev->nChunksPerBlock - dev->summaryChunks;
+	int nBytes = yaffs_SummaryBytes(dev);
+	int chunk = blk * dev->nChunksPerBlock;
+	yaffs_SummaryHeader *hdr;
+	yaffs_ExtendedTags tags;
+	__u8 *buffer;
+	int c;
+
+	/* Chunks written before we started gathering, e.g. before a
+	 * remount, have their tags read back. If one can't be, the block
+	 * goes without a summary.
+	 */
+	for (c = 0; c < nChunks; c++) {
+		if (dev->sumTags[c].objectId)
+			continue;
+
+		yaffs_ReadChunkWithTagsFromNAND(dev, chunk + c, NULL, &tags);
+		if (!tags.chunkUsed ||
+		    tags.eccResult == YAFFS_ECC_RESULT_UNFIXED ||
+		    tags.sequenceNumber != bi->sequenceNumber ||
+		    !tags.objectId) {
+			T(YAFFS_TRACE_WRITE,
+			  (TSTR("No summary for block %d, chunk %d unknown"
+			  TENDSTR), blk, c));
+			return;
+		}
+		yaffs_SummaryStore(dev, c, &tags);
+	}
+
+	buffer = yaffs_GetTempBuffer(dev, __LINE__);
+	memset(buffer, 0xff, dev->nDataBytesPerChunk);
+
+	hdr = (yaffs_SummaryHeader *)buffer;
+	hdr->magic = YAFFS_SUMMARY_MAGIC;
+	hdr->version = YAFFS_SUMMARY_VERSION;
+	hdr->block = blk;
+	hdr->sequenceNumber = bi->sequenceNumber;
+	hdr->nChunks = nChunks;
+	hdr->sum = 0;
+	memcpy(hdr + 1, dev->sumTags, nChunks * sizeof(yaffs_SummaryTags));
+	hdr->sum = yaffs_SummarySum(buffer, nBytes);
+
+	yaffs_InitialiseTags(&tags);
+	tags.objectId = YAFFS_OBJECTID_SUMMARY;
+	tags.chunkId = 1;
+	tags.byteCount = nBytes;
+
+	if (yaffs_WriteChunkWithTagsToNAND(dev, chunk + nChunks, buffer,
+					&tags) != YAFFS_OK) {
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("**>> yaffs summary write of block %d failed" TENDSTR),
+		  blk));
+		yaffs_HandleChunkError(dev, bi);
+	}
+
+	yaffs_ReleaseTempBuffer(dev, buffer, __LINE__);
+}
+
+/* Called for each chunk written to the allocation block */
+static void yaffs_SummaryAdd(yaffs_Device *dev, const yaffs_ExtendedTags *tags,
+				int chunkInNAND)
+{
+	int blk = chunkInNAND / dev->nChunksPerBlock;
+	int c = chunkInNAND % dev->nChunksPerBlock;
+	int nChunks = dev->nChunksPerBlock - dev->summaryChunks;
+
+	if (!dev->summaryChunks || c >= nChunks)
+		return;
+
+	if (blk != dev->sumBlock) {
+		memset(dev->sumTags, 0, nChunks * sizeof(yaffs_SummaryTags));
+		dev->sumBlock = blk;
+	}
+
+	yaffs_SummaryStore(dev, c, tags);
+
+	if (c == nChunks - 1) {
+		yaffs_SummaryWrite(dev, blk);
+		dev->sumBlock = -1;
+	}
+}
+
+/* Reads the summary of a block into dev->sumTags, using buffer. */
+static int yaffs_SummaryRead(yaffs_Device *dev, int blk, __u8 *buffer)
+{
+	yaffs_BlockInfo *bi = yaffs_GetBlockInfo(dev, blk);
+	yaffs_SummaryHeader *hdr = (yaffs_SummaryHeader *)buffer;
+	int nChunks = dev->nChunksPerBlock - dev->summaryChunks;
+	int nBytes = yaffs_SummaryBytes(dev);
+	yaffs_ExtendedTags tags;
+	__u32 sum;
+	int c;
+
+	yaffs_ReadChunkWithTagsFromNAND(dev, blk * dev->nChunksPerBlock + nChunks,
+					buffer, &tags);
+
+	if (!tags.chunkUsed ||
+	    tags.eccResult == YAFFS_ECC_RESULT_UNFIXED ||
+	    tags.objectId != YAFFS_OBJECTID_SUMMARY ||
+	    tags.sequenceNumber != bi->sequenceNumber ||
+	    tags.byteCount != nBytes)
+		return YAFFS_FAIL;
+
+	if (hdr->magic != YAFFS_SUMMARY_MAGIC ||
+	    hdr->version != YAFFS_SUMMARY_VERSION ||
+	    hdr->block != blk ||
+	    hdr->sequenceNumber != bi->sequenceNumber ||
+	    hdr->nChunks != nChunks)
+		return YAFFS_FAIL;
+
+	sum = hdr->sum;
+	hdr->sum = 0;
+	if (yaffs_SummarySum(buffer, nBytes) != sum) {
+		T(YAFFS_TRACE_SCAN,
+		  (TSTR("Block %d summary has a bad checksum" TENDSTR), blk));
+		return YAFFS_FAIL;
+	}
+
+	memcpy(dev->sumTags, hdr + 1, nChunks * sizeof(yaffs_SummaryTags));
+
+	for (c = 0; c < nChunks; c++)
+		if (!dev->sumTags[c].objectId)
+			return YAFFS_FAIL;
+
+	return YAFFS_OK;
+}
+
+/* Whether unused chunk c of a block being scanned is the summary chunk of a
+ * full block whose summary was not written. It is in use, as it was before
+ * the remount.
+ */
+static int yaffs_SummarySkipped(yaffs_Device *dev, int blk, int c)
+{
+	yaffs_ExtendedTags tags;
+
+	if (!dev->summaryChunks ||
+	    c != dev->nChunksPerBlock - dev->summaryChunks)
+		return 0;
+
+	yaffs_ReadChunkWithTagsFromNAND(dev, blk * dev->nChunksPerBlock + c - 1,
+					NULL, &tags);
+
+	return tags.chunkUsed;
+}
+
+/* Gets the tags of chunk c of a block from the summary read last. */
+static void yaffs_SummaryFetch(yaffs_Device *dev, yaffs_ExtendedTags *tags,
+				int c, unsigned sequenceNumber)
+{
+	yaffs_PackedTags2TagsPart pt;
+
+	pt.sequenceNumber = sequenceNumber;
+	if (c < dev->nChunksPerBlock - dev->summaryChunks) {
+		pt.objectId = dev->sumTags[c].objectId;
+		pt.chunkId = dev->sumTags[c].chunkId;
+		pt.byteCount = dev->sumTags[c].byteCount;
+	} else {
+		pt.objectId = YAFFS_OBJECTID_SUMMARY;
+		pt.chunkId = 1;
+		pt.byteCount = yaffs_SummaryBytes(dev);
+	}
+
+	yaffs_UnpackTags2TagsPart(tags, &pt);
+	tags->eccResult = YAFFS_ECC_RESULT_NO_ERROR;
+}
+
 
 /*---------------- Name handling functions ------------*/
 
@@ -2931,8 +3150,19 @@ static int yaffs_AllocateChunk(yaffs_Device *dev, int useReserve,
 
 		dev->nFreeChunks--;
 
-		/* If the block is full set the state to full */
-		if (dev->allocationPage >= dev->nChunksPerBlock) {
+		/* If the block is full set the state to full. The last
+		 * chunk is kept for the block summary if there is one, and
+		 * is in use from now on.
+		 */
+		if (dev->allocationPage >=
+		    dev->nChunksPerBlock - dev->summaryChunks) {
+			while (dev->allocationPage < dev->nChunksPerBlock) {
+				bi->pagesInUse++;
+				yaffs_SetChunkBit(dev, dev->allocationBlock,
+						dev->allocationPage);
+				dev->allocationPage++;
+				dev->nFreeChunks--;
+			}
 			bi->blockState = YAFFS_BLOCK_STATE_FULL;
 			dev->allocationBlock = -1;
 		}
@@ -3054,6 +3284,17 @@ static int yaffs_GarbageCollectBlock(yaffs_Device *dev, int block,
 				   dev->gcChunk, tags.objectId, tags.chunkId,
 				   tags.byteCount));
 
+				if (tags.objectId == YAFFS_OBJECTID_SUMMARY ||
+				    (!tags.chunkUsed && dev->gcChunk >=
+				     dev->nChunksPerBlock - dev->summaryChunks)) {
+					/* The block summary, or the chunk kept
+					 * for one that was not written. There is
+					 * nothing to copy, just free it.
+					 */
+					yaffs_DeleteChunk(dev, oldChunk, 0, __LINE__);
+					continue;
+				}
+
 				if (object && !yaffs_SkipVerification(dev)) {
 					if (tags.chunkId == 0)
 						matchingChunk = object->hdrChunk;
@@ -6112,6 +6353,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	int fileSize;
 	int isShrink;
 	int foundChunksInBlock;
+	int summaryAvailable;
 	int equivalentObjectId;
 	int alloc_failed = 0;
 
@@ -6147,6 +6389,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	}
 
 	dev->blocksInCheckpoint = 0;
+	dev->nSummaryScans = 0;
 
 	chunkData = yaffs_GetTempBuffer(dev, __LINE__);
 
@@ -6265,6 +6508,15 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 		deleted = 0;
 
+		/* A full block with a summary needs just the one read */
+		summaryAvailable = 0;
+		if (dev->summaryChunks &&
+		    state == YAFFS_BLOCK_STATE_NEEDS_SCANNING &&
+		    yaffs_SummaryRead(dev, blk, chunkData) == YAFFS_OK) {
+			summaryAvailable = 1;
+			dev->nSummaryScans++;
+		}
+
 		/* For each chunk in each block that needs scanning.... */
 		foundChunksInBlock = 0;
 		for (c = dev->nChunksPerBlock - 1;
@@ -6277,12 +6529,22 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 			chunk = blk * dev->nChunksPerBlock + c;
 
-			result = yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL,
-							&tags);
+			if (summaryAvailable)
+				yaffs_SummaryFetch(dev, &tags, c,
+						bi->sequenceNumber);
+			else
+				result = yaffs_ReadChunkWithTagsFromNAND(dev,
+							chunk, NULL, &tags);
 
 			/* Let's have a good look at this chunk... */
 
-			if (!tags.chunkUsed) {
+			if (!tags.chunkUsed && !foundChunksInBlock &&
+			    yaffs_SummarySkipped(dev, blk, c)) {
+				/* The block is full, only its summary is missing */
+				yaffs_SetChunkBit(dev, blk, c);
+				bi->pagesInUse++;
+
+			} else if (!tags.chunkUsed) {
 				/* An unassigned chunk in the block.
 				 * If there are used chunks after this one, then
 				 * it is a chunk that was skipped due to failing the erased
@@ -6338,6 +6600,14 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 				  dev->nFreeChunks++;
 
+			} else if (tags.objectId == YAFFS_OBJECTID_SUMMARY) {
+				/* A block summary is not part of any object,
+				 * it is in use until the block is collected.
+				 */
+				foundChunksInBlock = 1;
+				yaffs_SetChunkBit(dev, blk, c);
+				bi->pagesInUse++;
+
 			} else if (tags.chunkId > 0) {
 				/* chunkId > 0 so it is a data chunk... */
 				unsigned int endpos;
@@ -6745,6 +7015,10 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	if (alloc_failed)
 		return YAFFS_FAIL;
 
+	T(YAFFS_TRACE_SCAN,
+	  (TSTR("%d of %d blocks scanned from their summary" TENDSTR),
+	   dev->nSummaryScans, nBlocksToScan));
+
 	T(YAFFS_TRACE_SCAN, (TSTR("yaffs_ScanBackwards ends" TENDSTR)));
 
 	return YAFFS_OK;
@@ -7497,6 +7771,27 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 			init_failed = 1;
 	}
 
+	dev->summaryChunks = 0;
+	dev->sumTags = NULL;
+	dev->sumBlock = -1;
+	dev->nSummaryScans = 0;
+
+	if (!init_failed && dev->useBlockSummary && dev->isYaffs2) {
+		/* The summary has to fit in the last chunk of a block */
+		dev->summaryChunks = 1;
+		if (yaffs_SummaryBytes(dev) > dev->nDataBytesPerChunk) {
+			T(YAFFS_TRACE_ALWAYS,
+			  (TSTR("yaffs: block summary does not fit in a chunk, not used"
+			  TENDSTR)));
+			dev->summaryChunks = 0;
+		} else {
+			dev->sumTags = YMALLOC(dev->nChunksPerBlock *
+					sizeof(yaffs_SummaryTags));
+			if (!dev->sumTags)
+				init_failed = 1;
+		}
+	}
+
 	if (dev->isYaffs2)
 		dev->useHeaderFileSize = 1;
 
@@ -7611,6 +7906,10 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 
 		YFREE(dev->gcCleanupList);
 
+		if (dev->sumTags)
+			YFREE(dev->sumTags);
+		dev->sumTags = NULL;
+
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			YFREE(dev->tempBuffer[i].buffer);
 
@@ -7684,6 +7983,11 @@ int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev)
 
 	nFree -= (blocksForCheckpoint * dev->nChunksPerBlock);
 
+	/* Each block the free space is written to loses a chunk to its summary */
+	if (nFree > 0 && dev->summaryChunks)
+		nFree -= (nFree * dev->summaryChunks + dev->nChunksPerBlock - 1) /
+			 dev->nChunksPerBlock;
+
 	if (nFree < 0)
 		nFree = 0;
 
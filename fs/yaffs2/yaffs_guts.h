@@ -86,6 +86,9 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
+/* Pseudo object id for block summaries */
+#define YAFFS_OBJECTID_SUMMARY		0x11
+
 /* */
 
 #define YAFFS_MAX_SHORT_OP_CACHES	20
@@ -530,6 +533,32 @@ typedef struct {
 	int maxLine;
 } yaffs_TempBuffer;
 
+/*--------------------- Block summary ----------------
+ *
+ * The last chunk of each yaffs2 block holds the tags of the other chunks
+ * in the block, so that a scan reads one chunk per block rather than the
+ * tags of every chunk. The tags are kept as packed tags, less the sequence
+ * number which is the block's.
+ */
+
+#define YAFFS_SUMMARY_MAGIC	0x5953554d	/* "YSUM" */
+#define YAFFS_SUMMARY_VERSION	1
+
+typedef struct {
+	unsigned objectId;
+	unsigned chunkId;
+	unsigned byteCount;
+} yaffs_SummaryTags;
+
+typedef struct {
+	__u32 magic;
+	__u32 version;
+	__u32 block;
+	__u32 sequenceNumber;
+	__u32 nChunks;		/* Number of yaffs_SummaryTags that follow */
+	__u32 sum;
+} yaffs_SummaryHeader;
+
 /*----------------- Device ---------------------------------*/
 
 struct yaffs_DeviceStruct {
@@ -560,6 +589,8 @@ struct yaffs_DeviceStruct {
 
 	int emptyLostAndFound;  /* Flasg to determine if lst+found should be emptied on init */
 
+	int useBlockSummary;	/* Flag to write block summaries and scan with them (yaffs2) */
+
 	int useNANDECC;		/* Flag to decide whether or not to use NANDECC */
 
 	void *genericDevice;	/* Pointer to device context
@@ -690,6 +721,11 @@ struct yaffs_DeviceStruct {
 	__u32 allocationPage;
 	int allocationBlockFinder;	/* Used to search for next allocation block */
 
+	/* Block summary of the block being allocated from */
+	int summaryChunks;	/* Chunks reserved for the summary at the end of each block, 0 or 1 */
+	yaffs_SummaryTags *sumTags;
+	int sumBlock;		/* Block sumTags is being gathered for, -1 if none */
+
 	/* Runtime state */
 	int nTnodesCreated;
 	yaffs_Tnode *freeTnodes;
@@ -733,6 +769,7 @@ struct yaffs_DeviceStruct {
 	int tagsEccUnfixed;
 	int nDeletions;
 	int nUnmarkedDeletions;
+	int nSummaryScans;	/* Blocks the last scan took from their summary */
 
 	int hasPendingPrioritisedGCs; /* We think this device might have pending prioritised gcs */
 
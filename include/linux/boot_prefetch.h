@@ -0,0 +1,56 @@
+/* include/linux/boot_prefetch.h
+ *
+ * Records the file reads that miss the page cache during boot and replays
+ * them as large, sorted readahead on the following boots. See
+ * Documentation/vm/boot-prefetch.txt.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_BOOT_PREFETCH_H
+#define _LINUX_BOOT_PREFETCH_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+
+struct file;
+struct list_head;
+
+#ifdef CONFIG_BOOT_PREFETCH
+extern int boot_prefetch_recording;
+extern void __boot_prefetch_record(struct file *filp, pgoff_t offset,
+				   unsigned long nr);
+extern void __boot_prefetch_record_pages(struct file *filp,
+					 struct list_head *pages);
+
+/* pages [offset, offset + nr) of filp are being read into the page cache */
+static inline void boot_prefetch_record(struct file *filp, pgoff_t offset,
+					unsigned long nr)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_record(filp, offset, nr);
+}
+
+/* the pages on the list, linked by lru, are being read for filp */
+static inline void boot_prefetch_record_pages(struct file *filp,
+					      struct list_head *pages)
+{
+	if (unlikely(boot_prefetch_recording))
+		__boot_prefetch_record_pages(filp, pages);
+}
+#else
+static inline void boot_prefetch_record(struct file *filp, pgoff_t offset,
+					unsigned long nr) { }
+static inline void boot_prefetch_record_pages(struct file *filp,
+					      struct list_head *pages) { }
+#endif
+
+#endif
@@ -18,6 +18,7 @@
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/list.h>
+#include <linux/ktime.h>
 #endif
 
 /* The early_suspend structure defines suspend and resume hooks to be called
@@ -29,6 +30,8 @@
  * the suspend handlers have already been called without a matching call to the
  * resume handlers, the suspend handler will be called directly from
  * register_early_suspend. This direct call can violate the normal level order.
+ * With the earlysuspend async_threads parameter set, handlers of the same level
+ * may run concurrently with each other, but never with those of another level.
  */
 enum {
 	EARLY_SUSPEND_LEVEL_BLANK_SCREEN = 50,
@@ -41,6 +44,12 @@ struct early_suspend {
 	int level;
 	void (*suspend)(struct early_suspend *h);
 	void (*resume)(struct early_suspend *h);
+	struct {
+		ktime_t suspend_time;
+		ktime_t suspend_max;
+		ktime_t resume_time;
+		ktime_t resume_max;
+	} stat;
 #endif
 };
 
@@ -25,6 +25,8 @@
 #ifndef __TWL4030_H_
 #define __TWL4030_H_
 
+#include <linux/list.h>
+
 /*
  * Using the twl4030 core we address registers using a pair
  *	{ module id, relative register offset }
@@ -81,6 +83,48 @@ int twl4030_i2c_read_u8(u8 mod_no, u8 *val, u8 reg);
 int twl4030_i2c_write(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes);
 int twl4030_i2c_read(u8 mod_no, u8 *value, u8 reg, unsigned num_bytes);
 
+/*
+ * Queued transfers.
+ *
+ * twl4030_i2c_queue() returns at once, from any context; the transfer is
+ * run later by a realtime thread and @complete, if set, is called from that
+ * thread with @status filled in. Transfers run in the order they were
+ * queued. Queued writes to consecutive registers of the same module that
+ * follow each other in the queue are sent as one I2C message.
+ *
+ * Unlike twl4030_i2c_write(), the data of a queued write starts at
+ * value[0]; a queued write is at most TWL4030_XFER_MAX bytes. There is no
+ * ordering against the synchronous calls above: call twl4030_i2c_flush()
+ * before mixing them on the same registers.
+ *
+ * twl4030_i2c_write_u8_queued() writes are counted in a group that the
+ * caller owns, so twl4030_i2c_flush() waits for and reports the errors of
+ * that caller's writes only.
+ */
+#define TWL4030_XFER_MAX	16
+
+struct twl4030_xfer {
+	struct list_head	node;
+	u8			mod_no;
+	u8			reg;
+	u8			num_bytes;
+	u8			read;
+	u8			*value;
+	int			status;
+	void			(*complete)(struct twl4030_xfer *xfer);
+	void			*context;
+};
+
+struct twl4030_xfer_group {
+	unsigned		pending;
+	int			error;
+};
+
+int twl4030_i2c_queue(struct twl4030_xfer *xfer);
+int twl4030_i2c_write_u8_queued(struct twl4030_xfer_group *group,
+				u8 mod_no, u8 val, u8 reg);
+int twl4030_i2c_flush(struct twl4030_xfer_group *group);
+
 /*----------------------------------------------------------------------*/
 
 /*
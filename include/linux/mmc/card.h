@@ -33,6 +33,7 @@ struct mmc_csd {
 	unsigned int		read_blkbits;
 	unsigned int		write_blkbits;
 	unsigned int		capacity;
+	unsigned int		erase_size;	/* in sectors */
 	unsigned int		read_partial:1,
 				read_misalign:1,
 				write_partial:1,
@@ -42,6 +43,7 @@ struct mmc_csd {
 struct mmc_ext_csd {
 	unsigned int		hs_max_dtr;
 	unsigned int		sectors;
+	unsigned int		hc_erase_size;	/* in sectors */
 };
 
 struct sd_scr {
@@ -103,6 +105,7 @@ struct mmc_card {
 	struct mmc_ext_csd	ext_csd;	/* mmc v4 extended card specific */
 	struct sd_scr		scr;		/* extra SD information */
 	struct sd_switch_caps	sw_caps;	/* switch (CMD6) caps */
+	unsigned int		erase_size;	/* erase unit in sectors, 0 if unknown */
 
 	unsigned int		sdio_funcs;	/* number of SDIO functions */
 	struct sdio_cccr	cccr;		/* common card info */
@@ -115,6 +115,7 @@ struct mmc_data {
 
 	unsigned int		sg_len;		/* size of scatter list */
 	struct scatterlist	*sg;		/* I/O scatter list */
+	int			host_cookie;	/* host private, set by pre_req */
 };
 
 struct mmc_request {
@@ -128,7 +129,12 @@ struct mmc_request {
 
 struct mmc_host;
 struct mmc_card;
+struct completion;
 
+extern void mmc_pre_req(struct mmc_host *, struct mmc_request *);
+extern void mmc_post_req(struct mmc_host *, struct mmc_request *, int);
+extern void mmc_start_req(struct mmc_host *, struct mmc_request *,
+	struct completion *);
 extern void mmc_wait_for_req(struct mmc_host *, struct mmc_request *);
 extern int mmc_wait_for_cmd(struct mmc_host *, struct mmc_command *, int);
 extern int mmc_wait_for_app_cmd(struct mmc_host *, struct mmc_card *,
@@ -51,6 +51,17 @@ struct mmc_ios {
 };
 
 struct mmc_host_ops {
+	/*
+	 * pre_req and post_req are optional. pre_req may be called for a
+	 * request before it is started, while the host is still busy with
+	 * another one, to do the work that doesn't touch the controller
+	 * (mapping the buffers for DMA and the cache maintenance that goes
+	 * with it). post_req undoes it once the request has completed, or
+	 * if it is dropped without being started. Both may sleep.
+	 */
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req);
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
@@ -30,5 +30,16 @@ extern void out_of_memory(struct zonelist *zonelist, gfp_t gfp_mask, int order);
 extern int register_oom_notifier(struct notifier_block *nb);
 extern int unregister_oom_notifier(struct notifier_block *nb);
 
+struct task_struct;
+
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/* keep the lowmemorykiller's per-oom_adj index of processes up to date */
+extern void lowmem_task_update(struct task_struct *p);
+extern void lowmem_task_remove(struct task_struct *p);
+#else
+static inline void lowmem_task_update(struct task_struct *p) { }
+static inline void lowmem_task_remove(struct task_struct *p) { }
+#endif
+
 #endif /* __KERNEL__*/
 #endif /* _INCLUDE_LINUX_OOM_H */
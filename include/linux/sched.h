@@ -1147,6 +1147,9 @@ struct task_struct {
 	 */
 	unsigned char fpu_counter;
 	s8 oomkilladj; /* OOM kill score adjustment (bit shift). */
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct hlist_node lowmem_node; /* lowmemorykiller oom_adj bucket */
+#endif
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	unsigned int btrace_seq;
 #endif
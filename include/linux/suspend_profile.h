@@ -0,0 +1,68 @@
+/* include/linux/suspend_profile.h
+ *
+ * Timestamps of the stages of a suspend/resume cycle, from the release of
+ * the last suspend wake lock to the screen being turned back on, reported
+ * in debugfs as "suspend_profile".
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_SUSPEND_PROFILE_H
+#define _LINUX_SUSPEND_PROFILE_H
+
+#include <linux/types.h>
+
+/*
+ * Stages in the order they are reached; reaching a stage at or before the
+ * last one recorded starts a new cycle.
+ */
+enum {
+	SUSPEND_PROFILE_UNLOCK,		/* last suspend wake lock released */
+	SUSPEND_PROFILE_WORK,		/* wakelock suspend work running */
+	SUSPEND_PROFILE_SYNC,		/* wakelock sys_sync done */
+	SUSPEND_PROFILE_PREPARE,	/* enter_state sys_sync done */
+	SUSPEND_PROFILE_FROZEN,		/* processes frozen */
+	SUSPEND_PROFILE_DEVICES_OFF,	/* device suspend callbacks done */
+	SUSPEND_PROFILE_IRQS_OFF,	/* late and sysdev suspend done */
+	SUSPEND_PROFILE_SLEEP,		/* platform about to enter sleep */
+	SUSPEND_PROFILE_WAKEUP,		/* platform back from sleep */
+	SUSPEND_PROFILE_IRQS_ON,	/* sysdev and early resume done */
+	SUSPEND_PROFILE_DEVICES_ON,	/* device resume callbacks done */
+	SUSPEND_PROFILE_THAWED,		/* processes thawed */
+	SUSPEND_PROFILE_SCREEN_ON,	/* late_resume handlers done */
+	SUSPEND_PROFILE_STAGES,
+};
+
+/* device callbacks */
+enum {
+	SUSPEND_PROFILE_DEV_SUSPEND,
+	SUSPEND_PROFILE_DEV_SUSPEND_LATE,
+	SUSPEND_PROFILE_DEV_RESUME_EARLY,
+	SUSPEND_PROFILE_DEV_RESUME,
+};
+
+struct device;
+
+#ifdef CONFIG_SUSPEND_PROFILE
+extern void suspend_profile_stage(int stage);
+extern void suspend_profile_wakeup_irq(int irq);
+extern u64 suspend_profile_clock(void);
+extern void suspend_profile_device(struct device *dev, int callback,
+				   u64 start);
+#else
+static inline void suspend_profile_stage(int stage) { }
+static inline void suspend_profile_wakeup_irq(int irq) { }
+static inline u64 suspend_profile_clock(void) { return 0; }
+static inline void suspend_profile_device(struct device *dev, int callback,
+					  u64 start) { }
+#endif
+
+#endif
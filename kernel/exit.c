@@ -47,6 +47,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/tracehook.h>
 #include <linux/init_task.h>
+#include <linux/oom.h>
 #include <trace/sched.h>
 
 #include <asm/uaccess.h>
@@ -79,6 +80,7 @@ static void __unhash_process(struct task_struct *p)
 	}
 	list_del_rcu(&p->thread_group);
 	list_del_init(&p->sibling);
+	lowmem_task_remove(p);
 }
 
 /*
@@ -60,6 +60,7 @@
 #include <linux/tty.h>
 #include <linux/proc_fs.h>
 #include <linux/blkdev.h>
+#include <linux/oom.h>
 #include <trace/sched.h>
 
 #include <asm/pgtable.h>
@@ -1021,6 +1022,9 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	copy_flags(clone_flags, p);
 	INIT_LIST_HEAD(&p->children);
 	INIT_LIST_HEAD(&p->sibling);
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	INIT_HLIST_NODE(&p->lowmem_node);
+#endif
 #ifdef CONFIG_PREEMPT_RCU
 	p->rcu_read_lock_nesting = 0;
 	p->rcu_flipctr_idx = 0;
@@ -1274,6 +1278,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	write_unlock_irq(&tasklist_lock);
 	proc_fork_connector(p);
 	cgroup_post_fork(p);
+	lowmem_task_update(p);
 	return p;
 
 bad_fork_free_graph:
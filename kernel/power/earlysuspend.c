@@ -13,10 +13,13 @@
  *
  */
 
+#include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/seq_file.h>
+#include <linux/suspend_profile.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
@@ -44,6 +47,139 @@ enum {
 };
 static int state;
 
+/*
+ * With async_threads > 1, handlers of the same level are spread over that
+ * many worker threads and run concurrently, with a barrier between levels.
+ * 0 or 1 calls every handler in turn from the suspend work queue.
+ */
+#define EARLY_SUSPEND_MAX_THREADS 8
+static int async_threads;
+module_param(async_threads, int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+struct early_suspend_worker {
+	struct workqueue_struct *wq;
+	struct work_struct work;
+	int index;
+};
+static struct early_suspend_worker workers[EARLY_SUSPEND_MAX_THREADS];
+static int nr_workers_created;
+
+/*
+ * The level being run by the workers, protected by early_suspend_lock.
+ * Its handlers are walked forward from level_start on suspend and backward
+ * on resume, so that they resume in the reverse of their suspend order.
+ */
+static struct list_head *level_start;
+static int level_count;
+static int level_workers;
+static int level_resume;
+
+static ktime_t early_suspend_time;
+static ktime_t late_resume_time;
+
+static void call_handler(struct early_suspend *h, int resume)
+{
+	void (*fn)(struct early_suspend *h) = resume ? h->resume : h->suspend;
+	ktime_t start, duration;
+
+	if (fn == NULL)
+		return;
+	start = ktime_get();
+	fn(h);
+	duration = ktime_sub(ktime_get(), start);
+	if (resume) {
+		h->stat.resume_time = duration;
+		if (duration.tv64 > h->stat.resume_max.tv64)
+			h->stat.resume_max = duration;
+	} else {
+		h->stat.suspend_time = duration;
+		if (duration.tv64 > h->stat.suspend_max.tv64)
+			h->stat.suspend_max = duration;
+	}
+}
+
+static void run_worker(struct work_struct *work)
+{
+	struct early_suspend_worker *worker =
+		container_of(work, struct early_suspend_worker, work);
+	struct list_head *pos = level_start;
+	int i;
+
+	for (i = 0; i < level_count;
+	     i++, pos = level_resume ? pos->prev : pos->next)
+		if (i % level_workers == worker->index)
+			call_handler(list_entry(pos, struct early_suspend,
+						link), level_resume);
+}
+
+/* returns the number of worker threads to use, creating them on first use */
+static int get_workers(void)
+{
+	int threads = min(async_threads, EARLY_SUSPEND_MAX_THREADS);
+
+	while (nr_workers_created < threads) {
+		struct early_suspend_worker *worker =
+			&workers[nr_workers_created];
+
+		worker->wq = create_singlethread_workqueue("early_suspend");
+		if (worker->wq == NULL)
+			break;
+		INIT_WORK(&worker->work, run_worker);
+		worker->index = nr_workers_created++;
+	}
+	return min(threads, nr_workers_created);
+}
+
+/* Caller must hold early_suspend_lock */
+static void run_level(struct list_head *start, int count, int resume,
+		      int threads)
+{
+	int i;
+
+	if (count == 1 || threads <= 1) {
+		for (i = 0; i < count;
+		     i++, start = resume ? start->prev : start->next)
+			call_handler(list_entry(start, struct early_suspend,
+						link), resume);
+		return;
+	}
+
+	level_start = start;
+	level_count = count;
+	level_workers = min(count, threads);
+	level_resume = resume;
+	for (i = 0; i < level_workers; i++)
+		queue_work(workers[i].wq, &workers[i].work);
+	for (i = 0; i < level_workers; i++)
+		flush_workqueue(workers[i].wq);
+}
+
+/*
+ * Calls the suspend handlers in list order and the resume handlers in
+ * reverse, level by level. Caller must hold early_suspend_lock.
+ */
+static void call_handlers(int resume)
+{
+	struct list_head *head = &early_suspend_handlers;
+	struct list_head *pos, *start;
+	int threads = get_workers();
+	int level, count;
+
+	pos = resume ? head->prev : head->next;
+	while (pos != head) {
+		level = list_entry(pos, struct early_suspend, link)->level;
+		start = pos;
+		count = 0;
+		while (pos != head &&
+		       list_entry(pos, struct early_suspend, link)->level ==
+		       level) {
+			count++;
+			pos = resume ? pos->prev : pos->next;
+		}
+		run_level(start, count, resume, threads);
+	}
+}
+
 void register_early_suspend(struct early_suspend *handler)
 {
 	struct list_head *pos;
@@ -56,8 +192,9 @@ void register_early_suspend(struct early_suspend *handler)
 			break;
 	}
 	list_add_tail(&handler->link, pos);
-	if ((state & SUSPENDED) && handler->suspend)
-		handler->suspend(handler);
+	memset(&handler->stat, 0, sizeof(handler->stat));
+	if (state & SUSPENDED)
+		call_handler(handler, 0);
 	mutex_unlock(&early_suspend_lock);
 }
 EXPORT_SYMBOL(register_early_suspend);
@@ -72,8 +209,8 @@ EXPORT_SYMBOL(unregister_early_suspend);
 
 static void early_suspend(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -93,10 +230,9 @@ static void early_suspend(struct work_struct *work)
 
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("early_suspend: call handlers\n");
-	list_for_each_entry(pos, &early_suspend_handlers, link) {
-		if (pos->suspend != NULL)
-			pos->suspend(pos);
-	}
+	start = ktime_get();
+	call_handlers(0);
+	early_suspend_time = ktime_sub(ktime_get(), start);
 	mutex_unlock(&early_suspend_lock);
 
 	if (debug_mask & DEBUG_SUSPEND)
@@ -112,8 +248,8 @@ abort:
 
 static void late_resume(struct work_struct *work)
 {
-	struct early_suspend *pos;
 	unsigned long irqflags;
+	ktime_t start;
 	int abort = 0;
 
 	mutex_lock(&early_suspend_lock);
@@ -131,11 +267,13 @@ static void late_resume(struct work_struct *work)
 	}
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: call handlers\n");
-	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
-		if (pos->resume != NULL)
-			pos->resume(pos);
+	start = ktime_get();
+	call_handlers(1);
+	late_resume_time = ktime_sub(ktime_get(), start);
+	suspend_profile_stage(SUSPEND_PROFILE_SCREEN_ON);
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("late_resume: done\n");
+		pr_info("late_resume: done in %lld us\n",
+			ktime_to_us(late_resume_time));
 abort:
 	mutex_unlock(&early_suspend_lock);
 }
@@ -176,3 +314,48 @@ suspend_state_t get_suspend_state(void)
 {
 	return requested_suspend_state;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int early_suspend_stats_show(struct seq_file *s, void *unused)
+{
+	struct early_suspend *pos;
+
+	mutex_lock(&early_suspend_lock);
+	seq_printf(s, "early_suspend %lld us, late_resume %lld us\n",
+		   ktime_to_us(early_suspend_time),
+		   ktime_to_us(late_resume_time));
+	seq_printf(s, "level\tsuspend_us\tmax_us\tresume_us\tmax_us"
+		   "\thandler\n");
+	list_for_each_entry(pos, &early_suspend_handlers, link)
+		seq_printf(s, "%d\t%lld\t%lld\t%lld\t%lld\t%pF\n",
+			   pos->level,
+			   ktime_to_us(pos->stat.suspend_time),
+			   ktime_to_us(pos->stat.suspend_max),
+			   ktime_to_us(pos->stat.resume_time),
+			   ktime_to_us(pos->stat.resume_max),
+			   pos->suspend ? (void *)pos->suspend :
+					  (void *)pos->resume);
+	mutex_unlock(&early_suspend_lock);
+	return 0;
+}
+
+static int early_suspend_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, early_suspend_stats_show, NULL);
+}
+
+static const struct file_operations early_suspend_stats_fops = {
+	.open		= early_suspend_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init early_suspend_debug_init(void)
+{
+	debugfs_create_file("early_suspend", S_IRUGO, NULL, NULL,
+			    &early_suspend_stats_fops);
+	return 0;
+}
+late_initcall(early_suspend_debug_init);
+#endif
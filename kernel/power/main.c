@@ -22,6 +22,7 @@
 #include <linux/freezer.h>
 #include <linux/vmstat.h>
 #include <linux/syscalls.h>
+#include <linux/suspend_profile.h>
 
 #include "power.h"
 
@@ -300,12 +301,14 @@ static int suspend_enter(suspend_state_t state)
 
 	error = sysdev_suspend(PMSG_SUSPEND);
 	if (!error) {
+		suspend_profile_stage(SUSPEND_PROFILE_IRQS_OFF);
 		if (!suspend_test(TEST_CORE))
 			error = suspend_ops->enter(state);
 		sysdev_resume();
 	}
 
 	device_power_up(PMSG_RESUME);
+	suspend_profile_stage(SUSPEND_PROFILE_IRQS_ON);
  Done:
 	arch_suspend_enable_irqs();
 	BUG_ON(irqs_disabled());
@@ -338,6 +341,7 @@ int suspend_devices_and_enter(suspend_state_t state)
 		goto Recover_platform;
 	}
 	suspend_test_finish("suspend devices");
+	suspend_profile_stage(SUSPEND_PROFILE_DEVICES_OFF);
 	if (suspend_test(TEST_DEVICES))
 		goto Recover_platform;
 
@@ -361,6 +365,7 @@ int suspend_devices_and_enter(suspend_state_t state)
  Resume_devices:
 	suspend_test_start();
 	device_resume(PMSG_RESUME);
+	suspend_profile_stage(SUSPEND_PROFILE_DEVICES_ON);
 	suspend_test_finish("resume devices");
 	resume_console();
  Close:
@@ -433,11 +438,13 @@ static int enter_state(suspend_state_t state)
 	printk(KERN_INFO "PM: Syncing filesystems ... ");
 	sys_sync();
 	printk("done.\n");
+	suspend_profile_stage(SUSPEND_PROFILE_PREPARE);
 
 	pr_debug("PM: Preparing system for %s sleep\n", pm_states[state]);
 	error = suspend_prepare();
 	if (error)
 		goto Unlock;
+	suspend_profile_stage(SUSPEND_PROFILE_FROZEN);
 
 	if (suspend_test(TEST_FREEZER))
 		goto Finish;
@@ -448,6 +455,7 @@ static int enter_state(suspend_state_t state)
  Finish:
 	pr_debug("PM: Finishing wakeup.\n");
 	suspend_finish();
+	suspend_profile_stage(SUSPEND_PROFILE_THAWED);
  Unlock:
 	mutex_unlock(&pm_mutex);
 	return error;
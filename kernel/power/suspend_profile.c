@@ -0,0 +1,221 @@
+/* kernel/power/suspend_profile.c
+ *
+ * Suspend/resume latency profile.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/suspend_profile.h>
+
+#define SUSPEND_PROFILE_CYCLES		4
+#define SUSPEND_PROFILE_DEVICES		8
+
+struct suspend_profile_dev {
+	char name[20];
+	int callback;
+	u32 us;
+};
+
+struct suspend_profile_cycle {
+	int stages;		/* last stage reached + 1, 0 if unused */
+	int wakeup_irq;
+	u64 stamp[SUSPEND_PROFILE_STAGES];	/* sched_clock, 0 if skipped */
+	struct suspend_profile_dev dev[SUSPEND_PROFILE_DEVICES];
+};
+
+static DEFINE_SPINLOCK(profile_lock);
+static struct suspend_profile_cycle cycles[SUSPEND_PROFILE_CYCLES];
+static int cur;
+
+static const char *stage_names[SUSPEND_PROFILE_STAGES] = {
+	[SUSPEND_PROFILE_UNLOCK]	= "unlock",
+	[SUSPEND_PROFILE_WORK]		= "suspend_work",
+	[SUSPEND_PROFILE_SYNC]		= "sync",
+	[SUSPEND_PROFILE_PREPARE]	= "sync2",
+	[SUSPEND_PROFILE_FROZEN]	= "freeze",
+	[SUSPEND_PROFILE_DEVICES_OFF]	= "devices_off",
+	[SUSPEND_PROFILE_IRQS_OFF]	= "late_off",
+	[SUSPEND_PROFILE_SLEEP]		= "sleep",
+	[SUSPEND_PROFILE_WAKEUP]	= "wakeup",
+	[SUSPEND_PROFILE_IRQS_ON]	= "early_on",
+	[SUSPEND_PROFILE_DEVICES_ON]	= "devices_on",
+	[SUSPEND_PROFILE_THAWED]	= "thaw",
+	[SUSPEND_PROFILE_SCREEN_ON]	= "screen_on",
+};
+
+static const char *callback_names[] = {
+	[SUSPEND_PROFILE_DEV_SUSPEND]		= "suspend",
+	[SUSPEND_PROFILE_DEV_SUSPEND_LATE]	= "suspend_late",
+	[SUSPEND_PROFILE_DEV_RESUME_EARLY]	= "resume_early",
+	[SUSPEND_PROFILE_DEV_RESUME]		= "resume",
+};
+
+/*
+ * sched_clock rather than ktime_get, which must not be used between
+ * sysdev_suspend and sysdev_resume. On OMAP it runs off the 32k sync
+ * counter, which keeps counting in OFF mode.
+ */
+u64 suspend_profile_clock(void)
+{
+	return sched_clock();
+}
+
+void suspend_profile_stage(int stage)
+{
+	struct suspend_profile_cycle *c;
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&profile_lock, irqflags);
+	c = &cycles[cur];
+	/* late_resume runs on every screen on, not just after a suspend */
+	if (stage == SUSPEND_PROFILE_SCREEN_ON &&
+	    c->stages <= SUSPEND_PROFILE_THAWED)
+		goto out;
+	if (stage < c->stages || !c->stages) {
+		/* keep the cycle unless it was just an aborted attempt */
+		if (c->stages > SUSPEND_PROFILE_WORK + 1) {
+			cur = (cur + 1) % SUSPEND_PROFILE_CYCLES;
+			c = &cycles[cur];
+		}
+		memset(c, 0, sizeof(*c));
+		c->wakeup_irq = -1;
+	}
+	c->stamp[stage] = sched_clock();
+	c->stages = stage + 1;
+out:
+	spin_unlock_irqrestore(&profile_lock, irqflags);
+}
+
+void suspend_profile_wakeup_irq(int irq)
+{
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&profile_lock, irqflags);
+	cycles[cur].wakeup_irq = irq;
+	spin_unlock_irqrestore(&profile_lock, irqflags);
+}
+
+/* keeps the slowest device callbacks of the cycle */
+void suspend_profile_device(struct device *dev, int callback, u64 start)
+{
+	struct suspend_profile_dev *slot, *d;
+	unsigned long irqflags;
+	u32 us = div_u64(sched_clock() - start, NSEC_PER_USEC);
+
+	spin_lock_irqsave(&profile_lock, irqflags);
+	slot = cycles[cur].dev;
+	for (d = slot + 1; d < cycles[cur].dev + SUSPEND_PROFILE_DEVICES; d++)
+		if (d->us < slot->us)
+			slot = d;
+	if (us > slot->us) {
+		strlcpy(slot->name, dev_name(dev), sizeof(slot->name));
+		slot->callback = callback;
+		slot->us = us;
+	}
+	spin_unlock_irqrestore(&profile_lock, irqflags);
+}
+
+static int cmp_dev(const void *a, const void *b)
+{
+	const struct suspend_profile_dev *da = a, *db = b;
+
+	return db->us > da->us ? 1 : db->us < da->us ? -1 : 0;
+}
+
+static void show_cycle(struct seq_file *s, struct suspend_profile_cycle *c)
+{
+	struct suspend_profile_dev dev[SUSPEND_PROFILE_DEVICES];
+	u64 first = 0, prev = 0;
+	int i;
+
+	seq_printf(s, "wakeup irq %d\n", c->wakeup_irq);
+	seq_printf(s, "  %-14s %10s %10s\n", "stage", "at_ms", "delta_ms");
+	for (i = 0; i < c->stages; i++) {
+		u64 at, delta;
+		u32 at_rem, delta_rem;
+
+		if (!c->stamp[i])
+			continue;
+		if (!first)
+			first = prev = c->stamp[i];
+		at = div_u64(c->stamp[i] - first, NSEC_PER_USEC);
+		delta = div_u64(c->stamp[i] - prev, NSEC_PER_USEC);
+		prev = c->stamp[i];
+		at = div_u64_rem(at, 1000, &at_rem);
+		delta = div_u64_rem(delta, 1000, &delta_rem);
+		seq_printf(s, "  %-14s %6llu.%03u %6llu.%03u\n",
+			   stage_names[i], at, at_rem, delta, delta_rem);
+	}
+
+	memcpy(dev, c->dev, sizeof(dev));
+	sort(dev, SUSPEND_PROFILE_DEVICES, sizeof(dev[0]), cmp_dev, NULL);
+	seq_printf(s, "  slowest devices:\n");
+	for (i = 0; i < SUSPEND_PROFILE_DEVICES && dev[i].us; i++)
+		seq_printf(s, "  %-20s %-12s %6u.%03u ms\n", dev[i].name,
+			   callback_names[dev[i].callback],
+			   dev[i].us / 1000, dev[i].us % 1000);
+}
+
+static int suspend_profile_show(struct seq_file *s, void *unused)
+{
+	struct suspend_profile_cycle *c;
+	unsigned long irqflags;
+	int i, n;
+
+	c = kmalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+
+	/* most recent first */
+	for (i = 0, n = 0; i < SUSPEND_PROFILE_CYCLES; i++) {
+		spin_lock_irqsave(&profile_lock, irqflags);
+		*c = cycles[(cur + SUSPEND_PROFILE_CYCLES - i) %
+			    SUSPEND_PROFILE_CYCLES];
+		spin_unlock_irqrestore(&profile_lock, irqflags);
+		if (!c->stages)
+			continue;
+		seq_printf(s, "cycle %d%s: ", n, n ? "" : " (last)");
+		n++;
+		show_cycle(s, c);
+	}
+	kfree(c);
+	return 0;
+}
+
+static int suspend_profile_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_profile_show, NULL);
+}
+
+static const struct file_operations suspend_profile_fops = {
+	.open		= suspend_profile_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init suspend_profile_init(void)
+{
+	debugfs_create_file("suspend_profile", S_IRUGO, NULL, NULL,
+			    &suspend_profile_fops);
+	return 0;
+}
+late_initcall(suspend_profile_init);
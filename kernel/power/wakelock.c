@@ -17,7 +17,9 @@
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/suspend.h>
+#include <linux/suspend_profile.h>
 #include <linux/syscalls.h> /* sys_sync */
+#include <linux/vmstat.h>
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
@@ -34,6 +36,14 @@ enum {
 static int debug_mask = DEBUG_EXIT_SUSPEND | DEBUG_WAKEUP;
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/*
+ * Start syncing as soon as the last suspend lock is released rather than
+ * from the suspend work, so that suspend only has to wait for what is
+ * left and can stop waiting when a wake lock is taken.
+ */
+static int early_sync = 1;
+module_param_named(early_sync, early_sync, int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 #define WAKE_LOCK_TYPE_MASK              (0x0f)
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
@@ -45,6 +55,13 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/*
+ * So that has_wake_lock need not walk active_wake_locks with interrupts off,
+ * each type also keeps a count of its active locks without a timeout and
+ * its active locks with a timeout sorted by expiry.
+ */
+static int active_no_timeout[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root expire_tree[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -113,12 +130,12 @@ static int print_lock_stat(char *buf, int len, struct wake_lock *lock)
 	}
 
 	n = snprintf(buf, len,
-		     "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld\n",
+		     "\"%s\"\t%d\t%d\t%d\t%lld\t%lld\t%lld\t%lld\t%lld\t%d\n",
 		     lock->name, lock_count, expire_count,
 		     lock->stat.wakeup_count, ktime_to_ns(active_time),
 		     ktime_to_ns(total_time),
 		     ktime_to_ns(prevent_suspend_time), ktime_to_ns(max_time),
-		     ktime_to_ns(lock->stat.last_time));
+		     ktime_to_ns(lock->stat.last_time), lock->stat.block_count);
 
 	return n > len ? len : n;
 }
@@ -136,7 +153,8 @@ static int wakelocks_read_proc(char *page, char **start, off_t off,
 
 	len += snprintf(page + len, count - len,
 			"name\tcount\texpire_count\twake_count\tactive_since"
-			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
+			"\ttotal_time\tsleep_time\tmax_time\tlast_change"
+			"\tblock_count\n");
 	list_for_each_entry(lock, &inactive_locks, link) {
 		len += print_lock_stat(page + len, count - len, lock);
 	}
@@ -209,12 +227,46 @@ static void update_sleep_wait_stats_locked(int done)
 }
 #endif
 
+/* Caller must acquire the list_lock spinlock */
+static void active_add_locked(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &expire_tree[type].rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+
+	if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
+		active_no_timeout[type]++;
+		return;
+	}
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, expire_node);
+		if (time_before(lock->expires, entry->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->expire_node, parent, p);
+	rb_insert_color(&lock->expire_node, &expire_tree[type]);
+}
+
+/* Caller must acquire the list_lock spinlock */
+static void active_del_locked(struct wake_lock *lock, int type)
+{
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->expire_node, &expire_tree[type]);
+	else
+		active_no_timeout[type]--;
+}
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	active_del_locked(lock, lock->flags & WAKE_LOCK_TYPE_MASK);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -243,21 +295,23 @@ static void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct wake_lock *lock;
+	struct rb_node *node;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	while ((node = rb_first(&expire_tree[type]))) {
+		lock = rb_entry(node, struct wake_lock, expire_node);
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	if (active_no_timeout[type])
+		return -1;
+	node = rb_last(&expire_tree[type]);
+	if (!node)
+		return 0;
+	lock = rb_entry(node, struct wake_lock, expire_node);
+	return lock->expires - jiffies;
 }
 
 long has_wake_lock(int type)
@@ -270,19 +324,113 @@ long has_wake_lock(int type)
 	return ret;
 }
 
+/*
+ * has_wake_lock(WAKE_LOCK_SUSPEND) for the suspend path, which also charges
+ * every lock still held with having blocked this suspend attempt.
+ */
+static long suspend_blocked(void)
+{
+	long ret;
+	unsigned long irqflags;
+#ifdef CONFIG_WAKELOCK_STAT
+	struct wake_lock *lock;
+#endif
+	spin_lock_irqsave(&list_lock, irqflags);
+	ret = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
+#ifdef CONFIG_WAKELOCK_STAT
+	if (ret)
+		list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND],
+				    link)
+			lock->stat.block_count++;
+#endif
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	return ret;
+}
+
+/* early sync generations started and finished, protected by list_lock */
+static unsigned int sync_started;
+static unsigned int sync_done;
+static DECLARE_WAIT_QUEUE_HEAD(sync_wait);
+static struct workqueue_struct *sync_work_queue;
+
+static void early_sync_work(struct work_struct *work)
+{
+	unsigned long irqflags;
+	unsigned int gen;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	gen = ++sync_started;
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("early_sync: start %u\n", gen);
+	sys_sync();
+	if (debug_mask & DEBUG_SUSPEND)
+		pr_info("early_sync: done %u\n", gen);
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	sync_done = gen;
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	wake_up(&sync_wait);
+}
+static DECLARE_WORK(sync_work, early_sync_work);
+
+static int early_sync_idle(void)
+{
+	unsigned long irqflags;
+	int idle;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	idle = !work_pending(&sync_work) && sync_done == sync_started;
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	return idle;
+}
+
+/*
+ * Waits for the early sync, then writes back whatever was dirtied since
+ * it started. Returns nonzero if a suspend wake lock was taken meanwhile.
+ */
+static int suspend_sync(void)
+{
+	if (!early_sync) {
+		sys_sync();
+		return 0;
+	}
+
+	wait_event(sync_wait,
+		   early_sync_idle() || has_wake_lock(WAKE_LOCK_SUSPEND));
+	if (!early_sync_idle())
+		return 1;
+
+	if (global_page_state(NR_FILE_DIRTY) ||
+	    global_page_state(NR_WRITEBACK) ||
+	    global_page_state(NR_UNSTABLE_NFS)) {
+		if (debug_mask & DEBUG_SUSPEND)
+			pr_info("suspend: sync data dirtied since early sync\n");
+		sys_sync();
+	}
+	return 0;
+}
+
 static void suspend(struct work_struct *work)
 {
 	int ret;
 	int entry_event_num;
 
-	if (has_wake_lock(WAKE_LOCK_SUSPEND)) {
+	suspend_profile_stage(SUSPEND_PROFILE_WORK);
+	if (suspend_blocked()) {
 		if (debug_mask & DEBUG_SUSPEND)
 			pr_info("suspend: abort suspend\n");
 		return;
 	}
 
 	entry_event_num = current_event_num;
-	sys_sync();
+	if (suspend_sync()) {
+		if (debug_mask & DEBUG_SUSPEND)
+			pr_info("suspend: abort suspend during sync\n");
+		return;
+	}
+	suspend_profile_stage(SUSPEND_PROFILE_SYNC);
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("suspend: enter suspend\n");
 	ret = pm_suspend(requested_suspend_state);
@@ -304,6 +452,15 @@ static void suspend(struct work_struct *work)
 }
 static DECLARE_WORK(suspend_work, suspend);
 
+/* Caller must acquire the list_lock spinlock */
+static void suspend_unblocked_locked(void)
+{
+	suspend_profile_stage(SUSPEND_PROFILE_UNLOCK);
+	if (early_sync)
+		queue_work(sync_work_queue, &sync_work);
+	queue_work(suspend_work_queue, &suspend_work);
+}
+
 static void expire_wake_locks(unsigned long data)
 {
 	long has_lock;
@@ -317,14 +474,14 @@ static void expire_wake_locks(unsigned long data)
 	if (debug_mask & DEBUG_EXPIRE)
 		pr_info("expire_wake_locks: done, has_lock %ld\n", has_lock);
 	if (has_lock == 0)
-		queue_work(suspend_work_queue, &suspend_work);
+		suspend_unblocked_locked();
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 
 static int power_suspend_late(struct platform_device *pdev, pm_message_t state)
 {
-	int ret = has_wake_lock(WAKE_LOCK_SUSPEND) ? -EAGAIN : 0;
+	int ret = suspend_blocked() ? -EAGAIN : 0;
 #ifdef CONFIG_WAKELOCK_STAT
 	wait_for_wakeup = 1;
 #endif
@@ -355,6 +512,7 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.count = 0;
 	lock->stat.expire_count = 0;
 	lock->stat.wakeup_count = 0;
+	lock->stat.block_count = 0;
 	lock->stat.total_time = ktime_set(0, 0);
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
@@ -380,6 +538,7 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (lock->stat.count) {
 		deleted_wake_locks.stat.count += lock->stat.count;
 		deleted_wake_locks.stat.expire_count += lock->stat.expire_count;
+		deleted_wake_locks.stat.block_count += lock->stat.block_count;
 		deleted_wake_locks.stat.total_time =
 			ktime_add(deleted_wake_locks.stat.total_time,
 				  lock->stat.total_time);
@@ -391,6 +550,7 @@ void wake_lock_destroy(struct wake_lock *lock)
 				  lock->stat.max_time);
 	}
 #endif
+	active_del_locked(lock, lock->flags & WAKE_LOCK_TYPE_MASK);
 	list_del(&lock->link);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -420,6 +580,7 @@ static void wake_lock_internal(
 		lock->stat.last_time = ktime_get();
 	}
 #endif
+	active_del_locked(lock, type);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
@@ -442,8 +603,10 @@ static void wake_lock_internal(
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
 	}
+	active_add_locked(lock, type);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
+		wake_up(&sync_wait);
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
@@ -494,6 +657,7 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	active_del_locked(lock, type);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -510,7 +674,7 @@ void wake_unlock(struct wake_lock *lock)
 					pr_info("wake_unlock: %s, stop expire "
 						"timer\n", lock->name);
 			if (has_lock == 0)
-				queue_work(suspend_work_queue, &suspend_work);
+				suspend_unblocked_locked();
 		}
 		if (lock == &main_wake_lock) {
 			if (debug_mask & DEBUG_SUSPEND)
@@ -535,8 +699,10 @@ static int __init wakelocks_init(void)
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		expire_tree[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -563,6 +729,12 @@ static int __init wakelocks_init(void)
 		goto err_suspend_work_queue;
 	}
 
+	sync_work_queue = create_singlethread_workqueue("suspend_sync");
+	if (sync_work_queue == NULL) {
+		ret = -ENOMEM;
+		goto err_sync_work_queue;
+	}
+
 #ifdef CONFIG_WAKELOCK_STAT
 	create_proc_read_entry("wakelocks", S_IRUGO, NULL,
 				wakelocks_read_proc, NULL);
@@ -570,6 +742,8 @@ static int __init wakelocks_init(void)
 
 	return 0;
 
+err_sync_work_queue:
+	destroy_workqueue(suspend_work_queue);
 err_suspend_work_queue:
 	platform_driver_unregister(&power_driver);
 err_platform_driver_register:
@@ -588,6 +762,7 @@ static void  __exit wakelocks_exit(void)
 #ifdef CONFIG_WAKELOCK_STAT
 	remove_proc_entry("wakelocks", NULL);
 #endif
+	destroy_workqueue(sync_work_queue);
 	destroy_workqueue(suspend_work_queue);
 	platform_driver_unregister(&power_driver);
 	platform_device_unregister(&power_device);
@@ -27,7 +27,12 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
 #include <linux/shmem_fs.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/ashmem.h>
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
@@ -37,7 +42,7 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `lock'; lru_pages by `ashmem_lru_lock'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
@@ -46,12 +51,19 @@ struct ashmem_area {
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
+	struct mutex lock;		/* protects all of the above */
+	struct list_head areas;		/* entry in ashmem_areas */
+	pid_t owner;			/* tgid of the process that created us */
+	char owner_comm[TASK_COMM_LEN];
+	unsigned long lru_pages;	/* our pages on the LRU list */
+	unsigned long purged_pages;	/* pages purged over our lifetime */
 };
 
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `lock'; while the range is on the LRU,
+ * `lru' is also protected by `ashmem_lru_lock'
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
@@ -60,20 +72,39 @@ struct ashmem_range {
 	size_t pgstart;			/* starting page, inclusive */
 	size_t pgend;			/* ending page, inclusive */
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
+	unsigned long unpinned_at;	/* jiffies when unpinned */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/*
+ * LRU list of unpinned pages, ordered by the time the ranges were unpinned,
+ * coldest first. Protected by ashmem_lru_lock.
+ */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
+/* Total of pages purged, protected by ashmem_lru_lock */
+static unsigned long purged_count;
+
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and the page counts
+ *
+ * Lock Ordering: asma->lock -> i_mutex -> i_alloc_sem
+ *                asma->lock -> ashmem_lru_lock
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * The shrinker walks the LRU under ashmem_lru_lock and so can only trylock
+ * an area. That also keeps it from deadlocking when an allocation made with
+ * an area's lock held ends up in reclaim.
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+
+/* all live areas, for the statistics; protected by ashmem_area_lock */
+static LIST_HEAD(ashmem_areas);
+static unsigned int ashmem_area_count;
+static DEFINE_SPINLOCK(ashmem_area_lock);
+
+static struct dentry *ashmem_debugfs;
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -102,16 +133,36 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
 
-static inline void lru_add(struct ashmem_range *range)
+/*
+ * lru_add - puts 'range' on the LRU list right after 'after', if that is on
+ * the list, or else at the tail as the most recently unpinned range
+ */
+static inline void lru_add(struct ashmem_range *range,
+			   struct ashmem_range *after)
 {
-	list_add_tail(&range->lru, &ashmem_lru_list);
+	spin_lock(&ashmem_lru_lock);
+	if (after && range_on_lru(after))
+		list_add(&range->lru, &after->lru);
+	else
+		list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	range->asma->lru_pages += range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
-static inline void lru_del(struct ashmem_range *range)
+/* Caller must hold ashmem_lru_lock. */
+static inline void __lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
+	range->asma->lru_pages -= range_size(range);
+}
+
+static inline void lru_del(struct ashmem_range *range)
+{
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
 /*
@@ -122,12 +173,14 @@ static inline void lru_del(struct ashmem_range *range)
  * 'purged' - initial purge value (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
+ * 'split' - the range this one was split off of, which it takes the age
+ *	and LRU position of, or NULL for a newly unpinned range
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->lock.
  */
 static int range_alloc(struct ashmem_area *asma,
 		       struct ashmem_range *prev_range, unsigned int purged,
-		       size_t start, size_t end)
+		       size_t start, size_t end, struct ashmem_range *split)
 {
 	struct ashmem_range *range;
 
@@ -139,11 +192,12 @@ static int range_alloc(struct ashmem_area *asma,
 	range->pgstart = start;
 	range->pgend = end;
 	range->purged = purged;
+	range->unpinned_at = split ? split->unpinned_at : jiffies;
 
 	list_add_tail(&range->unpinned, &prev_range->unpinned);
 
 	if (range_on_lru(range))
-		lru_add(range);
+		lru_add(range, split);
 
 	return 0;
 }
@@ -159,18 +213,24 @@ static void range_del(struct ashmem_range *range)
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->lock.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
 {
 	size_t pre = range_size(range);
 
-	range->pgstart = start;
-	range->pgend = end;
-
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
+		range->pgstart = start;
+		range->pgend = end;
 		lru_count -= pre - range_size(range);
+		range->asma->lru_pages -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	} else {
+		range->pgstart = start;
+		range->pgend = end;
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -189,8 +249,16 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	INIT_LIST_HEAD(&asma->unpinned_list);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
+	mutex_init(&asma->lock);
+	asma->owner = current->tgid;
+	get_task_comm(asma->owner_comm, current->group_leader);
 	file->private_data = asma;
 
+	spin_lock(&ashmem_area_lock);
+	list_add_tail(&asma->areas, &ashmem_areas);
+	ashmem_area_count++;
+	spin_unlock(&ashmem_area_lock);
+
 	return 0;
 }
 
@@ -199,10 +267,15 @@ static int ashmem_release(struct inode *ignored, struct file *file)
 	struct ashmem_area *asma = file->private_data;
 	struct ashmem_range *range, *next;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
 		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
+
+	spin_lock(&ashmem_area_lock);
+	list_del(&asma->areas);
+	ashmem_area_count--;
+	spin_unlock(&ashmem_area_lock);
 
 	if (asma->file)
 		fput(asma->file);
@@ -216,7 +289,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -257,7 +330,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -273,12 +346,17 @@ out:
  * proceed without risk of deadlock (due to gfp_mask).
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
- * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * chunks of ashmem regions LRU-wise until we hit 'nr_to_scan' pages freed.
+ * Ranges are taken in batches: the coldest range whose area we can lock,
+ * together with the ranges right behind it on the LRU that belong to the
+ * same area, are purged under a single acquisition of the area's lock.
+ * Areas that are busy are skipped over rather than waited for.
  */
 static int ashmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 {
 	struct ashmem_range *range, *next;
+	struct ashmem_area *asma;
+	LIST_HEAD(batch);
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (nr_to_scan && !(gfp_mask & __GFP_FS))
@@ -286,21 +364,54 @@ static int ashmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	if (!nr_to_scan)
 		return lru_count;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+	while (nr_to_scan > 0) {
+		asma = NULL;
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
-
-		nr_to_scan -= range_size(range);
-		if (nr_to_scan <= 0)
+		spin_lock(&ashmem_lru_lock);
+		list_for_each_entry(range, &ashmem_lru_list, lru) {
+			if (mutex_trylock(&range->asma->lock)) {
+				asma = range->asma;
+				break;
+			}
+		}
+		if (!asma) {
+			spin_unlock(&ashmem_lru_lock);
 			break;
+		}
+
+		/*
+		 * With the area locked, its ranges can't go away or change,
+		 * so we can pull them off the LRU and work on them unlocked.
+		 * Purged ranges never return to the LRU, which lets us reuse
+		 * 'lru' to chain up the batch.
+		 */
+		list_for_each_entry_safe_from(range, next, &ashmem_lru_list,
+					      lru) {
+			if (range->asma != asma || nr_to_scan <= 0)
+				break;
+			__lru_del(range);
+			range->purged = ASHMEM_WAS_PURGED;
+			list_add_tail(&range->lru, &batch);
+			nr_to_scan -= range_size(range);
+		}
+		spin_unlock(&ashmem_lru_lock);
+
+		list_for_each_entry_safe(range, next, &batch, lru) {
+			struct inode *inode = asma->file->f_dentry->d_inode;
+			loff_t start = range->pgstart * PAGE_SIZE;
+			loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+
+			vmtruncate_range(inode, start, end);
+			list_del(&range->lru);
+			asma->purged_pages += range_size(range);
+
+			spin_lock(&ashmem_lru_lock);
+			purged_count += range_size(range);
+			spin_unlock(&ashmem_lru_lock);
+		}
+
+		mutex_unlock(&asma->lock);
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -314,7 +425,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -329,7 +440,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 	return ret;
 }
 
@@ -337,7 +448,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -351,7 +462,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 
 	return ret;
 }
@@ -360,7 +471,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -377,7 +488,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 
 	return ret;
 }
@@ -386,7 +497,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->lock.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -440,7 +551,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 			 * second half and adjust the first chunk's endpoint.
 			 */
 			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
+				    pgend + 1, range->pgend, range);
 			range_shrink(range, range->pgstart, pgstart - 1);
 			break;
 		}
@@ -452,7 +563,7 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->lock.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
@@ -480,14 +591,14 @@ restart:
 		}
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, range, purged, pgstart, pgend, NULL);
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->lock.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
@@ -536,7 +647,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->lock);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -550,7 +661,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->lock);
 
 	return ret;
 }
@@ -600,6 +711,86 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+struct ashmem_owner_stats {
+	pid_t pid;
+	char comm[TASK_COMM_LEN];
+	unsigned long purgeable;
+	unsigned long purged;
+};
+
+/*
+ * ashmem_stats_show - purgeable and purged memory per process, in debugfs
+ *
+ * Areas are charged to the process that created them, which for shared
+ * areas is the one that handed them out.
+ */
+static int ashmem_stats_show(struct seq_file *m, void *unused)
+{
+	struct ashmem_owner_stats *stats;
+	struct ashmem_range *oldest;
+	struct ashmem_area *asma;
+	unsigned int n, nr = 0, i;
+	unsigned long age = 0;
+
+	n = ashmem_area_count;
+	stats = kcalloc(n ? n : 1, sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return -ENOMEM;
+
+	spin_lock(&ashmem_area_lock);
+	list_for_each_entry(asma, &ashmem_areas, areas) {
+		for (i = 0; i < nr; i++)
+			if (stats[i].pid == asma->owner)
+				break;
+		if (i == nr) {
+			/* areas created since we sized the table */
+			if (nr == n)
+				continue;
+			stats[i].pid = asma->owner;
+			memcpy(stats[i].comm, asma->owner_comm, TASK_COMM_LEN);
+			nr++;
+		}
+		stats[i].purgeable += asma->lru_pages;
+		stats[i].purged += asma->purged_pages;
+	}
+	spin_unlock(&ashmem_area_lock);
+
+	spin_lock(&ashmem_lru_lock);
+	if (!list_empty(&ashmem_lru_list)) {
+		oldest = list_first_entry(&ashmem_lru_list,
+					  struct ashmem_range, lru);
+		age = jiffies - oldest->unpinned_at;
+	}
+	seq_printf(m, "purgeable: %lu kB, purged: %lu kB, "
+		   "oldest unpinned %u ms ago\n",
+		   lru_count << (PAGE_SHIFT - 10),
+		   purged_count << (PAGE_SHIFT - 10), jiffies_to_msecs(age));
+	spin_unlock(&ashmem_lru_lock);
+
+	seq_printf(m, "%6s %-16s %12s %12s\n",
+		   "pid", "comm", "purgeable_kB", "purged_kB");
+	for (i = 0; i < nr; i++)
+		seq_printf(m, "%6d %-16s %12lu %12lu\n",
+			   stats[i].pid, stats[i].comm,
+			   stats[i].purgeable << (PAGE_SHIFT - 10),
+			   stats[i].purged << (PAGE_SHIFT - 10));
+
+	kfree(stats);
+	return 0;
+}
+
+static int ashmem_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ashmem_stats_show, NULL);
+}
+
+static const struct file_operations ashmem_stats_fops = {
+	.open		= ashmem_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct file_operations ashmem_fops = {
 	.owner = THIS_MODULE,
 	.open = ashmem_open,
@@ -643,6 +834,9 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+	ashmem_debugfs = debugfs_create_file("ashmem", S_IRUGO, NULL, NULL,
+					     &ashmem_stats_fops);
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -652,6 +846,7 @@ static void __exit ashmem_exit(void)
 {
 	int ret;
 
+	debugfs_remove(ashmem_debugfs);
 	unregister_shrinker(&ashmem_shrinker);
 
 	ret = misc_deregister(&ashmem_misc);
@@ -0,0 +1,948 @@
+/* mm/boot_prefetch.c
+ *
+ * Boot time file prefetch.
+ *
+ * While recording, every read into the page cache that readahead, a page
+ * fault or a read() without readahead issues for a file is logged as a (file, first page, pages)
+ * range, in the order of the misses, sequential ranges of a file merging
+ * into one. At the end of the recording window the log is saved, files by
+ * path, together with the device, inode number, size and mtime each file
+ * had then.
+ *
+ * On the next boot the saved trace is loaded, and if its files are still
+ * the same, a kernel thread replays it: the ranges are taken in windows of
+ * window_kb in recorded order, sorted by file and offset within the window
+ * and merged, and each merged range is submitted as one readahead. The
+ * boot then finds most of what it reads in the page cache, read in large
+ * sequential requests instead of one readahead window at a time.
+ *
+ * Files whose size or mtime changed are skipped. If they make up more than
+ * stale_pct of the trace, the trace is dropped and this boot recorded
+ * instead.
+ *
+ * Controlled through /sys/module/boot_prefetch/parameters/control, state
+ * and statistics are in debugfs as "boot_prefetch". See
+ * Documentation/vm/boot-prefetch.txt.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/boot_prefetch.h>
+#include <linux/debugfs.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/namei.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/vmstat.h>
+#include <linux/workqueue.h>
+#include <asm/uaccess.h>
+
+#define BP_VERSION		1
+#define BP_HASH_BITS		8
+#define BP_MAX_TRACE		(8 << 20)
+#define BP_BUF_SIZE		(16 << 10)
+#define BP_LINE_MAX		(PATH_MAX + 80)
+#define BP_MIN_LINE		8	/* "R 0 0 0\n", an "F" line is longer */
+
+
+static char trace_file[PATH_MAX] = "/data/system/boot_prefetch";
+module_param_string(trace_file, trace_file, sizeof(trace_file), 0644);
+static int record_at_boot = 1;
+module_param(record_at_boot, int, 0644);
+static int record_ms = 60000;
+module_param(record_ms, int, 0644);
+static int window_kb = 8192;
+module_param(window_kb, int, 0644);
+static int max_kb = 131072;
+module_param(max_kb, int, 0644);
+static int max_files = 2048;
+module_param(max_files, int, 0644);
+static int max_ranges = 16384;
+module_param(max_ranges, int, 0644);
+static int stale_pct = 10;
+module_param(stale_pct, int, 0644);
+
+enum {
+	BP_OFF,
+	BP_RECORDING,
+	BP_RECORDED,	/* trace full, saved at the end of the window */
+	BP_REPLAYING,
+};
+
+static const char *state_names[] = {
+	[BP_OFF]	= "off",
+	[BP_RECORDING]	= "recording",
+	[BP_RECORDED]	= "recorded",
+	[BP_REPLAYING]	= "replaying",
+};
+
+struct bp_file {
+	struct hlist_node hash;
+	dev_t dev;
+	unsigned long ino;
+	loff_t size;
+	struct timespec mtime;
+	unsigned int index;
+	int last;		/* its latest range, -1 if none */
+	unsigned long pages;
+	struct file *filp;	/* while replaying, NULL if stale */
+	struct path where;	/* while recording, until its path is known */
+	struct list_head unresolved;
+	char *path;		/* NULL if recorded and not known */
+};
+
+struct bp_range {
+	unsigned int file;
+	pgoff_t offset;
+	unsigned long nr;
+};
+
+struct bp_trace {
+	struct bp_file *pool;	/* a recording's files, taken in order */
+	struct bp_file **files;
+	unsigned int nr_files;
+	unsigned int max_files;
+	struct bp_range *ranges;
+	unsigned int nr_ranges;
+	unsigned int max_ranges;
+	unsigned long pages;
+	unsigned long stale_pages;
+	struct hlist_head hash[1 << BP_HASH_BITS];
+};
+
+static struct {
+	unsigned int files;
+	unsigned int ranges;
+	unsigned long pages;
+	unsigned int stale_files;
+	unsigned long stale_pages;
+	unsigned long replayed_pages;
+	unsigned int replay_ms;
+	const char *result;
+} stats;
+
+/*
+ * The reads are recorded into rec under bp_rec_lock, which is all the
+ * page cache miss path takes: a file seen for the first time gets an entry
+ * from the preallocated pool and keeps a reference to its path, which
+ * bp_resolve_work turns into a name later. Everything else is serialized
+ * by bp_mutex, and touches rec only once bp_stop_recorder() has returned.
+ */
+int boot_prefetch_recording;
+static struct bp_trace rec;
+static DEFINE_SPINLOCK(bp_rec_lock);
+static LIST_HEAD(bp_unresolved);
+static DEFINE_MUTEX(bp_resolve_mutex);
+static int state;
+static int save_armed;
+static int ready;
+static DEFINE_MUTEX(bp_mutex);
+/* doing file I/O with bp_mutex held, its reads must not be recorded */
+static struct task_struct *bp_io_task;
+static struct delayed_work bp_stop_work;
+static unsigned long bp_stop_at;
+
+static void bp_free(struct bp_trace *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->nr_files; i++) {
+		struct bp_file *f = t->files[i];
+
+		if (f->filp)
+			fput(f->filp);
+		if (f->where.dentry)
+			path_put(&f->where);
+		if (t->pool)
+			kfree(f->path);
+		else
+			kfree(f);
+	}
+	kfree(t->files);
+	vfree(t->pool);
+	vfree(t->ranges);
+	memset(t, 0, sizeof(*t));
+}
+
+static int bp_alloc(struct bp_trace *t, unsigned int files,
+		    unsigned int ranges)
+{
+	t->max_files = max(files, 1U);
+	t->max_ranges = max(ranges, 1U);
+	if (t->max_ranges > ULONG_MAX / sizeof(*t->ranges))
+		return -EINVAL;
+	t->files = kcalloc(t->max_files, sizeof(*t->files), GFP_KERNEL);
+	t->ranges = vmalloc(t->max_ranges * sizeof(*t->ranges));
+	if (!t->files || !t->ranges) {
+		bp_free(t);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static struct hlist_head *bp_hash(struct bp_trace *t, dev_t dev,
+				  unsigned long ino)
+{
+	return &t->hash[hash_long(ino ^ dev, BP_HASH_BITS)];
+}
+
+static void bp_add_file(struct bp_trace *t, struct bp_file *f, dev_t dev,
+			unsigned long ino)
+{
+	f->dev = dev;
+	f->ino = ino;
+	f->index = t->nr_files;
+	f->last = -1;
+	hlist_add_head(&f->hash, bp_hash(t, dev, ino));
+	t->files[t->nr_files++] = f;
+}
+
+static struct bp_file *bp_new_file(struct bp_trace *t, const char *path,
+				   dev_t dev, unsigned long ino)
+{
+	struct bp_file *f;
+
+	if (t->nr_files >= t->max_files)
+		return NULL;
+	f = kzalloc(sizeof(*f) + strlen(path) + 1, GFP_KERNEL);
+	if (!f)
+		return NULL;
+	f->path = (char *)(f + 1);
+	strcpy(f->path, path);
+	bp_add_file(t, f, dev, ino);
+	return f;
+}
+
+static struct bp_file *bp_find_file(struct bp_trace *t, struct inode *inode)
+{
+	dev_t dev = inode->i_sb->s_dev;
+	struct hlist_node *node;
+	struct bp_file *f;
+
+	hlist_for_each_entry(f, node, bp_hash(t, dev, inode->i_ino), hash)
+		if (f->ino == inode->i_ino && f->dev == dev)
+			return f;
+	return NULL;
+}
+
+/* names the recorded files that don't have a path yet */
+static void bp_resolve(void)
+{
+	struct bp_file *f;
+	struct path where;
+	char *buf, *path;
+	int len;
+
+	buf = __getname();
+	mutex_lock(&bp_resolve_mutex);
+	spin_lock(&bp_rec_lock);
+	while (!list_empty(&bp_unresolved)) {
+		f = list_first_entry(&bp_unresolved, struct bp_file,
+				     unresolved);
+		list_del(&f->unresolved);
+		where = f->where;
+		f->where.dentry = NULL;
+		f->where.mnt = NULL;
+		spin_unlock(&bp_rec_lock);
+
+		path = buf ? d_path(&where, buf, PATH_MAX) : ERR_PTR(-ENOMEM);
+		if (!IS_ERR(path)) {
+			/* unlinked, it won't be there to replay */
+			len = strlen(path);
+			if (path[0] != '/' || strchr(path, '\n') ||
+			    (len > 10 && !strcmp(path + len - 10, " (deleted)")))
+				path = ERR_PTR(-ENOENT);
+		}
+		path = IS_ERR(path) ? NULL : kstrdup(path, GFP_KERNEL);
+		path_put(&where);
+
+		spin_lock(&bp_rec_lock);
+		f->path = path;
+	}
+	spin_unlock(&bp_rec_lock);
+	mutex_unlock(&bp_resolve_mutex);
+	if (buf)
+		__putname(buf);
+}
+
+static void bp_resolve_fn(struct work_struct *work)
+{
+	bp_resolve();
+}
+static DECLARE_WORK(bp_resolve_work, bp_resolve_fn);
+
+/* a file not in the trace yet; called with bp_rec_lock held */
+static struct bp_file *bp_record_file(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	struct bp_file *f;
+
+	if (rec.nr_files >= rec.max_files)
+		return NULL;
+	f = &rec.pool[rec.nr_files];
+	f->size = i_size_read(inode);
+	f->mtime = inode->i_mtime;
+	f->where = filp->f_path;
+	path_get(&f->where);
+	list_add_tail(&f->unresolved, &bp_unresolved);
+	bp_add_file(&rec, f, inode->i_sb->s_dev, inode->i_ino);
+	schedule_work(&bp_resolve_work);
+	return f;
+}
+
+/*
+ * Stops the recorder and names the files it left without a path. Once
+ * this returns, rec is only touched under bp_mutex.
+ */
+static void bp_stop_recorder(void)
+{
+	spin_lock(&bp_rec_lock);
+	boot_prefetch_recording = 0;
+	spin_unlock(&bp_rec_lock);
+	bp_resolve();
+}
+
+static void bp_start_recording(unsigned int ms)
+{
+	bp_stop_recorder();
+	bp_free(&rec);
+	if (!bp_alloc(&rec, max_files, max_ranges))
+		rec.pool = vmalloc(rec.max_files * sizeof(*rec.pool));
+	if (!rec.pool) {
+		bp_free(&rec);
+		stats.result = "out of memory";
+		return;
+	}
+	memset(rec.pool, 0, rec.max_files * sizeof(*rec.pool));
+	state = BP_RECORDING;
+	spin_lock(&bp_rec_lock);
+	boot_prefetch_recording = 1;
+	spin_unlock(&bp_rec_lock);
+	bp_stop_at = jiffies + msecs_to_jiffies(ms);
+	schedule_delayed_work(&bp_stop_work, msecs_to_jiffies(ms));
+}
+
+/* under bp_rec_lock from the recorder, or after bp_stop_recorder() */
+static void bp_stop_recording(const char *why)
+{
+	boot_prefetch_recording = 0;
+	state = BP_RECORDED;
+	stats.files = rec.nr_files;
+	stats.ranges = rec.nr_ranges;
+	stats.pages = rec.pages;
+	pr_info("boot_prefetch: recording stopped (%s), %u files, %u ranges, "
+		"%lu KiB\n", why, rec.nr_files, rec.nr_ranges,
+		rec.pages << (PAGE_SHIFT - 10));
+}
+
+/* adds pages [offset, offset + nr) of filp, called with bp_rec_lock held */
+static void bp_record(struct file *filp, pgoff_t offset, unsigned long nr)
+{
+	struct bp_range *r;
+	struct bp_file *f;
+
+	if (!boot_prefetch_recording)
+		return;
+
+	f = bp_find_file(&rec, filp->f_mapping->host);
+	if (!f) {
+		f = bp_record_file(filp);
+		if (!f)
+			goto full;
+	}
+
+	/* a read continuing or inside the file's latest range extends it */
+	if (f->last >= 0) {
+		r = &rec.ranges[f->last];
+		if (offset >= r->offset && offset <= r->offset + r->nr) {
+			if (offset + nr > r->offset + r->nr) {
+				nr = offset + nr - (r->offset + r->nr);
+				r->nr += nr;
+				f->pages += nr;
+				rec.pages += nr;
+			}
+			return;
+		}
+	}
+
+	if (rec.nr_ranges >= rec.max_ranges ||
+	    rec.pages + nr > (max_kb >> (PAGE_SHIFT - 10)))
+		goto full;
+
+	r = &rec.ranges[rec.nr_ranges];
+	r->file = f->index;
+	r->offset = offset;
+	r->nr = nr;
+	f->last = rec.nr_ranges++;
+	f->pages += nr;
+	rec.pages += nr;
+	return;
+full:
+	bp_stop_recording("trace full");
+}
+
+static int bp_wanted(struct file *filp)
+{
+	return filp && current != bp_io_task &&
+		S_ISREG(filp->f_mapping->host->i_mode);
+}
+
+void __boot_prefetch_record(struct file *filp, pgoff_t offset,
+			    unsigned long nr)
+{
+	if (!nr || !bp_wanted(filp))
+		return;
+	spin_lock(&bp_rec_lock);
+	bp_record(filp, offset, nr);
+	spin_unlock(&bp_rec_lock);
+}
+
+void __boot_prefetch_record_pages(struct file *filp, struct list_head *pages)
+{
+	struct page *page;
+	pgoff_t start = 0;
+	unsigned long nr = 0;
+
+	if (!bp_wanted(filp))
+		return;
+	spin_lock(&bp_rec_lock);
+	/* readahead adds its pages at the head, lowest index last */
+	list_for_each_entry_reverse(page, pages, lru) {
+		if (nr && page->index == start + nr) {
+			nr++;
+			continue;
+		}
+		if (nr)
+			bp_record(filp, start, nr);
+		start = page->index;
+		nr = 1;
+	}
+	if (nr)
+		bp_record(filp, start, nr);
+	spin_unlock(&bp_rec_lock);
+}
+
+struct bp_writer {
+	struct file *file;
+	loff_t pos;
+	char *buf;
+	size_t len;
+	int err;
+};
+
+static void bp_flush(struct bp_writer *w)
+{
+	mm_segment_t old_fs;
+	ssize_t ret;
+
+	if (!w->len || w->err)
+		return;
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	ret = vfs_write(w->file, (char __user *)w->buf, w->len, &w->pos);
+	set_fs(old_fs);
+	if (ret != w->len)
+		w->err = ret < 0 ? ret : -EIO;
+	w->len = 0;
+}
+
+static void bp_emit(struct bp_writer *w, const char *fmt, ...)
+{
+	va_list args;
+
+	if (w->len + BP_LINE_MAX > BP_BUF_SIZE)
+		bp_flush(w);
+	va_start(args, fmt);
+	w->len += vscnprintf(w->buf + w->len, BP_BUF_SIZE - w->len, fmt, args);
+	va_end(args);
+}
+
+/*
+ * Writes the recorded trace to trace_file. The size and mtime of each file
+ * are taken again, so that files written during the boot are stored as the
+ * boot left them. Files that are gone are left out, and so is the trace
+ * file itself.
+ */
+static int bp_save(struct bp_trace *t)
+{
+	unsigned int i, nr_files = 0, nr_ranges = 0;
+	struct bp_writer w = { .pos = 0 };
+	int *map, err;
+
+	map = kmalloc((t->nr_files + 1) * sizeof(*map), GFP_KERNEL);
+	w.buf = kmalloc(BP_BUF_SIZE, GFP_KERNEL);
+	err = -ENOMEM;
+	if (!map || !w.buf)
+		goto out;
+
+	bp_io_task = current;
+	for (i = 0; i < t->nr_files; i++) {
+		struct bp_file *f = t->files[i];
+		struct inode *inode;
+		struct path path;
+
+		map[i] = -1;
+		if (!f->path || !strcmp(f->path, trace_file) ||
+		    kern_path(f->path, LOOKUP_FOLLOW, &path))
+			continue;
+		inode = path.dentry->d_inode;
+		if (inode->i_ino == f->ino && inode->i_sb->s_dev == f->dev) {
+			f->size = i_size_read(inode);
+			f->mtime = inode->i_mtime;
+			map[i] = nr_files++;
+		}
+		path_put(&path);
+	}
+	for (i = 0; i < t->nr_ranges; i++)
+		if (map[t->ranges[i].file] >= 0)
+			nr_ranges++;
+
+	w.file = filp_open(trace_file, O_WRONLY | O_CREAT | O_TRUNC |
+			   O_LARGEFILE, 0600);
+	if (IS_ERR(w.file)) {
+		err = PTR_ERR(w.file);
+		goto out;
+	}
+
+	bp_emit(&w, "boot_prefetch %d %u %u\n", BP_VERSION, nr_files,
+		nr_ranges);
+	for (i = 0; i < t->nr_files; i++) {
+		struct bp_file *f = t->files[i];
+
+		if (map[i] >= 0)
+			bp_emit(&w, "F %u %lu %lld %ld %ld %s\n", f->dev, f->ino,
+				(long long)f->size, f->mtime.tv_sec,
+				f->mtime.tv_nsec, f->path);
+	}
+	for (i = 0; i < t->nr_ranges; i++) {
+		struct bp_range *r = &t->ranges[i];
+
+		if (map[r->file] >= 0)
+			bp_emit(&w, "R %d %lu %lu\n", map[r->file], r->offset,
+				r->nr);
+	}
+	bp_flush(&w);
+	err = w.err;
+	if (!err)
+		err = vfs_fsync(w.file, w.file->f_path.dentry, 0);
+	filp_close(w.file, NULL);
+out:
+	bp_io_task = NULL;
+	kfree(w.buf);
+	kfree(map);
+	if (err)
+		pr_err("boot_prefetch: can't save %s: %d\n", trace_file, err);
+	else
+		pr_info("boot_prefetch: saved %u files, %u ranges to %s\n",
+			nr_files, nr_ranges, trace_file);
+	return err;
+}
+
+/* the recording is over: save it if asked to and let it go */
+static void bp_finish_recording(const char *why)
+{
+	bp_stop_recorder();
+	if (state == BP_RECORDING)
+		bp_stop_recording(why);
+	if (save_armed)
+		stats.result = bp_save(&rec) ? "save failed" : "saved";
+	save_armed = 0;
+	bp_free(&rec);
+	state = BP_OFF;
+}
+
+/*
+ * Parses a trace of size bytes. The counts in its header are only believed
+ * within the recording limits and what a file of that size can hold.
+ */
+static int bp_parse(struct bp_trace *t, char *buf, size_t size)
+{
+	unsigned int version, nr_files, nr_ranges;
+	char *line;
+	int err;
+
+	line = strsep(&buf, "\n");
+	if (sscanf(line, "boot_prefetch %u %u %u", &version, &nr_files,
+		   &nr_ranges) != 3 || version != BP_VERSION)
+		return -EINVAL;
+	if (nr_files > max(max_files, 1) || nr_ranges > max(max_ranges, 1) ||
+	    nr_files > size / BP_MIN_LINE ||
+	    nr_ranges > size / BP_MIN_LINE - nr_files)
+		return -EINVAL;
+	err = bp_alloc(t, nr_files, nr_ranges);
+	if (err)
+		return err;
+
+	while ((line = strsep(&buf, "\n"))) {
+		unsigned long ino, offset, nr;
+		unsigned int dev, file;
+		struct bp_range *r;
+		struct bp_file *f;
+		long sec, nsec;
+		long long size;
+		int pos = 0;
+
+		if (line[0] == 'F') {
+			if (sscanf(line, "F %u %lu %lld %ld %ld %n", &dev, &ino,
+				   &size, &sec, &nsec, &pos) != 5 || !pos ||
+			    !line[pos])
+				return -EINVAL;
+			f = bp_new_file(t, line + pos, dev, ino);
+			if (!f)
+				return -EINVAL;
+			f->size = size;
+			f->mtime.tv_sec = sec;
+			f->mtime.tv_nsec = nsec;
+		} else if (line[0] == 'R') {
+			if (sscanf(line, "R %u %lu %lu", &file, &offset,
+				   &nr) != 3 || file >= t->nr_files ||
+			    t->nr_ranges >= t->max_ranges)
+				return -EINVAL;
+			r = &t->ranges[t->nr_ranges++];
+			r->file = file;
+			r->offset = offset;
+			r->nr = nr;
+			t->files[file]->pages += nr;
+			t->pages += nr;
+		} else if (line[0]) {
+			return -EINVAL;
+		}
+	}
+
+	if (t->nr_files != nr_files || t->nr_ranges != nr_ranges)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Opens the files of a loaded trace. Those that are not the file that was
+ * recorded any more, or were changed since, are stale and not replayed.
+ */
+static void bp_open_files(struct bp_trace *t)
+{
+	struct inode *inode;
+	struct bp_file *f;
+	struct file *filp;
+	unsigned int i;
+
+	for (i = 0; i < t->nr_files; i++) {
+		f = t->files[i];
+		filp = filp_open(f->path, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(filp)) {
+			filp = NULL;
+		} else {
+			inode = filp->f_mapping->host;
+			if (inode->i_ino != f->ino ||
+			    inode->i_sb->s_dev != f->dev ||
+			    i_size_read(inode) != f->size ||
+			    !timespec_equal(&inode->i_mtime, &f->mtime)) {
+				fput(filp);
+				filp = NULL;
+			}
+		}
+		f->filp = filp;
+		if (!filp) {
+			stats.stale_files++;
+			t->stale_pages += f->pages;
+		}
+	}
+}
+
+static struct bp_trace *bp_load(void)
+{
+	struct bp_trace *t;
+	struct file *file;
+	char *buf = NULL;
+	loff_t size;
+	int err;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return ERR_PTR(-ENOMEM);
+
+	bp_io_task = current;
+	file = filp_open(trace_file, O_RDONLY | O_LARGEFILE, 0);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		goto out;
+	}
+	err = -EINVAL;
+	size = i_size_read(file->f_mapping->host);
+	if (size > 0 && size <= BP_MAX_TRACE)
+		buf = vmalloc(size + 1);
+	if (buf && kernel_read(file, 0, buf, size) == size) {
+		buf[size] = '\0';
+		err = bp_parse(t, buf, size);
+	}
+	fput(file);
+	vfree(buf);
+
+	stats.stale_files = 0;
+	if (!err)
+		bp_open_files(t);
+out:
+	bp_io_task = NULL;
+	if (err) {
+		bp_free(t);
+		kfree(t);
+		return ERR_PTR(err);
+	}
+	stats.files = t->nr_files;
+	stats.ranges = t->nr_ranges;
+	stats.pages = t->pages;
+	stats.stale_pages = t->stale_pages;
+	return t;
+}
+
+static int bp_range_cmp(const void *a, const void *b)
+{
+	const struct bp_range *ra = a, *rb = b;
+
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+	if (ra->offset != rb->offset)
+		return ra->offset < rb->offset ? -1 : 1;
+	return 0;
+}
+
+/* merges the sorted ranges of a window and reads them ahead */
+static void bp_replay_window(struct bp_trace *t, struct bp_range *r,
+			     unsigned int n)
+{
+	struct bp_range cur = r[0];
+	struct bp_file *f;
+	unsigned int i;
+	int ret;
+
+	for (i = 1; i <= n; i++) {
+		if (i < n && r[i].file == cur.file &&
+		    r[i].offset <= cur.offset + cur.nr) {
+			cur.nr = max(cur.nr, r[i].offset + r[i].nr - cur.offset);
+			continue;
+		}
+
+		f = t->files[cur.file];
+		if (f->filp) {
+			ret = force_page_cache_readahead(f->filp->f_mapping,
+							 f->filp, cur.offset,
+							 cur.nr);
+			if (ret > 0)
+				stats.replayed_pages += ret;
+		}
+		if (i < n)
+			cur = r[i];
+	}
+}
+
+static int bp_replay_thread(void *data)
+{
+	unsigned long window = max(window_kb >> (PAGE_SHIFT - 10), 1);
+	unsigned long start = jiffies, pages, avail;
+	struct bp_trace *t = data;
+	unsigned int i, n;
+
+	stats.result = "replayed";
+	for (i = 0; i < t->nr_ranges; i = n) {
+		for (n = i, pages = 0; n < t->nr_ranges && pages < window; n++)
+			pages += t->ranges[n].nr;
+
+		/* leave the memory to the boot once it gets short */
+		avail = global_page_state(NR_FREE_PAGES) +
+			global_page_state(NR_INACTIVE_FILE);
+		if (avail < 2 * pages) {
+			stats.result = "replay stopped, memory short";
+			break;
+		}
+
+		sort(t->ranges + i, n - i, sizeof(*t->ranges), bp_range_cmp,
+		     NULL);
+		bp_replay_window(t, t->ranges + i, n - i);
+	}
+
+	mutex_lock(&bp_mutex);
+	stats.replay_ms = jiffies_to_msecs(jiffies - start);
+	bp_free(t);
+	kfree(t);
+	state = BP_OFF;
+	mutex_unlock(&bp_mutex);
+
+	pr_info("boot_prefetch: %s %lu KiB in %u ms\n", stats.result,
+		stats.replayed_pages << (PAGE_SHIFT - 10), stats.replay_ms);
+	return 0;
+}
+
+static int bp_start_replay(struct bp_trace *t)
+{
+	struct task_struct *task;
+
+	/* a recording in progress would only see what the replay misses */
+	bp_stop_recorder();
+	save_armed = 0;
+	bp_free(&rec);
+	cancel_delayed_work(&bp_stop_work);
+
+	stats.replayed_pages = 0;
+	state = BP_REPLAYING;
+	task = kthread_run(bp_replay_thread, t, "kprefetchd");
+	if (IS_ERR(task)) {
+		state = BP_OFF;
+		bp_free(t);
+		kfree(t);
+		return PTR_ERR(task);
+	}
+	return 0;
+}
+
+/*
+ * "boot" replays the saved trace if it is still good, and otherwise has
+ * this boot recorded and saved in its place. The other commands are for
+ * doing it by hand.
+ */
+static int bp_control(const char *cmd)
+{
+	struct bp_trace *t;
+	struct file *file;
+	int err = 0;
+
+	if (state == BP_REPLAYING)
+		return -EBUSY;
+
+	if (sysfs_streq(cmd, "boot") || sysfs_streq(cmd, "replay")) {
+		t = bp_load();
+		if (!IS_ERR(t) && (sysfs_streq(cmd, "replay") ||
+				   t->stale_pages * 100 <= t->pages * stale_pct))
+			return bp_start_replay(t);
+
+		if (IS_ERR(t)) {
+			stats.result = "no trace";
+		} else {
+			stats.result = "trace stale";
+			bp_free(t);
+			kfree(t);
+		}
+		if (sysfs_streq(cmd, "replay"))
+			return -ENOENT;
+
+		save_armed = 1;
+		if (state == BP_OFF)
+			bp_start_recording(record_ms);
+		else if (state == BP_RECORDED)
+			bp_finish_recording(NULL);
+	} else if (sysfs_streq(cmd, "record")) {
+		cancel_delayed_work(&bp_stop_work);
+		save_armed = 1;
+		bp_start_recording(record_ms);
+	} else if (sysfs_streq(cmd, "stop")) {
+		if (state != BP_OFF)
+			bp_finish_recording("stopped");
+	} else if (sysfs_streq(cmd, "discard")) {
+		save_armed = 0;
+		if (state != BP_OFF)
+			bp_finish_recording("discarded");
+		file = filp_open(trace_file, O_WRONLY | O_TRUNC | O_LARGEFILE,
+				 0);
+		if (!IS_ERR(file))
+			filp_close(file, NULL);
+		stats.result = "discarded";
+	} else {
+		err = -EINVAL;
+	}
+	return err;
+}
+
+static int bp_control_set(const char *val, struct kernel_param *kp)
+{
+	int err;
+
+	if (!ready)
+		return -EAGAIN;
+	mutex_lock(&bp_mutex);
+	err = bp_control(val);
+	mutex_unlock(&bp_mutex);
+	return err;
+}
+
+static int bp_control_get(char *buffer, struct kernel_param *kp)
+{
+	return sprintf(buffer, "%s", state_names[state]);
+}
+
+module_param_call(control, bp_control_set, bp_control_get, NULL, 0644);
+
+static void bp_stop_fn(struct work_struct *work)
+{
+	mutex_lock(&bp_mutex);
+	/* the recording may have been restarted since this was queued */
+	if ((state == BP_RECORDING || state == BP_RECORDED) &&
+	    !time_before(jiffies, bp_stop_at))
+		bp_finish_recording("window over");
+	mutex_unlock(&bp_mutex);
+}
+
+static int bp_show(struct seq_file *s, void *unused)
+{
+	mutex_lock(&bp_mutex);
+	seq_printf(s, "state %s, last %s\n", state_names[state],
+		   stats.result ? stats.result : "-");
+	spin_lock(&bp_rec_lock);
+	if (state == BP_RECORDING)
+		seq_printf(s, "recording: %u files, %u ranges, %lu KiB\n",
+			   rec.nr_files, rec.nr_ranges,
+			   rec.pages << (PAGE_SHIFT - 10));
+	spin_unlock(&bp_rec_lock);
+	seq_printf(s, "trace: %u files, %u ranges, %lu KiB\n", stats.files,
+		   stats.ranges, stats.pages << (PAGE_SHIFT - 10));
+	seq_printf(s, "stale: %u files, %lu KiB\n", stats.stale_files,
+		   stats.stale_pages << (PAGE_SHIFT - 10));
+	seq_printf(s, "replayed: %lu KiB in %u ms\n",
+		   stats.replayed_pages << (PAGE_SHIFT - 10), stats.replay_ms);
+	mutex_unlock(&bp_mutex);
+	return 0;
+}
+
+static int bp_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bp_show, NULL);
+}
+
+static const struct file_operations bp_fops = {
+	.open		= bp_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init boot_prefetch_init(void)
+{
+	INIT_DELAYED_WORK(&bp_stop_work, bp_stop_fn);
+	debugfs_create_file("boot_prefetch", S_IRUGO, NULL, NULL, &bp_fops);
+
+	mutex_lock(&bp_mutex);
+	if (record_at_boot)
+		bp_start_recording(record_ms);
+	ready = 1;
+	mutex_unlock(&bp_mutex);
+	return 0;
+}
+late_initcall(boot_prefetch_init);